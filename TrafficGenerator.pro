@@ -1,4 +1,4 @@
-QT       += core gui widgets
+QT       += core gui widgets network
 
 CONFIG += c++11
 
@@ -15,11 +15,17 @@ QMAKE_TARGET_COPYRIGHT   = FeZar97
 # deprecated API in order to know how to port your code away from it.
 DEFINES += QT_DEPRECATED_WARNINGS
 
+include(core.pri)
+
 SOURCES += \
+    consolerunner.cpp \
     main.cpp \
+    templatepoolmodel.cpp \
     widget.cpp
 
 HEADERS += \
+    consolerunner.h \
+    templatepoolmodel.h \
     widget.h
 
 FORMS += \
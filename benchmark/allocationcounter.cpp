@@ -0,0 +1,69 @@
+#include "allocationcounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<qint64> allocationsNb{0};
+
+#if defined(Q_OS_LINUX) && defined(__GLIBC__)
+
+// the executable's definitions take precedence over libc's for every library,
+// the real allocator stays reachable under its internal names
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+
+void* malloc(size_t size) {
+    allocationsNb.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocationsNb.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+    allocationsNb.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+
+}
+
+bool AllocationCounter::isCountingMalloc() {
+    return true;
+}
+
+#else
+
+void* operator new(size_t size) {
+    allocationsNb.fetch_add(1, std::memory_order_relaxed);
+    if(void* pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+bool AllocationCounter::isCountingMalloc() {
+    return false;
+}
+
+#endif
+
+qint64 AllocationCounter::getAllocationsNb() {
+    return allocationsNb.load(std::memory_order_relaxed);
+}
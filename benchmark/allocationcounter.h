@@ -0,0 +1,15 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// process-wide heap allocation count. With glibc every malloc, calloc and realloc
+// is counted, Qt's containers included; elsewhere only operator new is.
+class AllocationCounter {
+
+public:
+    static qint64 getAllocationsNb();
+    static bool isCountingMalloc();
+};
+
+#endif // ALLOCATIONCOUNTER_H
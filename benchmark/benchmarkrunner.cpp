@@ -0,0 +1,483 @@
+#include "benchmarkrunner.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include <climits>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#else
+#include <ctime>
+#endif
+
+#include "allocationcounter.h"
+
+// keeps the measured loops from being optimized out
+static volatile qint64 benchmarkSink = 0;
+
+static void printError(const QString& line) {
+    static QTextStream err(stderr);
+    err << line << '\n';
+    err.flush();
+}
+
+static bool parseSizes(const QString& value, QVector<qint64>& sizes) {
+    sizes.clear();
+    foreach(const QString& item, value.split(',', QString::SkipEmptyParts)) {
+        bool ok;
+        qint64 size = SizeDistribution::parseSize(item, &ok);
+        if(!ok || size < 1)
+            return false;
+        sizes << size;
+    }
+    return !sizes.isEmpty();
+}
+
+static bool parseCounts(const QString& value, QVector<int>& counts, int maxCount) {
+    counts.clear();
+    foreach(const QString& item, value.split(',', QString::SkipEmptyParts)) {
+        bool ok;
+        int count = item.trimmed().toInt(&ok);
+        if(!ok || count < 1 || count > maxCount)
+            return false;
+        counts << count;
+    }
+    return !counts.isEmpty();
+}
+
+BenchmarkRunner::BenchmarkRunner() {
+}
+
+bool BenchmarkRunner::parseArguments(const QStringList& arguments) {
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QString("Traffic Generator %1, generation benchmark").arg(VERSION));
+    parser.addHelpOption();
+
+    QCommandLineOption destinationOption(QStringList() << "d" << "destination",
+                                         "Directory to benchmark, may be repeated, e.g. a tmpfs and a disk. "
+                                         "Work files go to a trafficgen-benchmark subdirectory removed afterwards. "
+                                         "/dev/shm and the temporary directory by default.", "dir");
+    QCommandLineOption sizesOption("sizes",
+                                   "Comma-separated file sizes, K/M/G suffixes allowed.", "list", DEFAULT_BENCHMARK_SIZES);
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+                                     "Comma-separated copy thread counts.", "list", DEFAULT_BENCHMARK_THREADS);
+    QCommandLineOption poolSizesOption("pool-sizes",
+                                       "Comma-separated template pool sizes.", "list", DEFAULT_BENCHMARK_POOLS);
+    QCommandLineOption payloadOption("payload",
+                                     "Comma-separated payloads to measure: templates, synthetic.", "list", "templates,synthetic");
+    QCommandLineOption ioBackendOption("io-backend",
+                                       "File I/O backend: sync or uring.", "backend", IoBackend::toString(SYNC_IO_BACKEND));
+    QCommandLineOption writePolicyOption("write-policy",
+                                         "Write policy to measure, may be repeated: none or a comma-separated list of "
+                                         "prealloc, direct and evict.", "policy");
+    QCommandLineOption writeChunkOption("write-chunk",
+                                        "Size of every write call, 0 writes whole buffers.", "bytes", "0");
+    QCommandLineOption cacheBudgetOption("cache-budget",
+                                         "Template cache budget in MB, 0 disables the cache.", "mb",
+                                         QString::number(DEFAULT_TEMPLATE_CACHE_BUDGET_MB));
+    QCommandLineOption filesOption("files",
+                                   "Files per case at most.", "count", QString::number(DEFAULT_CASE_FILES_NB));
+    QCommandLineOption volumeOption("volume",
+                                    "Volume per case at most, at least one file is written.", "bytes", DEFAULT_CASE_VOLUME);
+    QCommandLineOption durationOption(QStringList() << "t" << "duration",
+                                      "Duration of a case at most, in seconds.", "secs", QString::number(DEFAULT_CASE_DURATION));
+    QCommandLineOption poolBudgetOption("pool-budget",
+                                        "Volume of generated templates at most, larger pools are cut down.", "bytes",
+                                        DEFAULT_POOL_BUDGET);
+    QCommandLineOption noMicroOption("no-micro",
+                                     "Skip the template picking and statistics aggregation benchmarks.");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Result file, CSV for .csv files and JSON lines otherwise; standard output by default.", "file");
+
+    parser.addOptions(QList<QCommandLineOption>() << destinationOption << sizesOption << threadsOption << poolSizesOption
+                                                  << payloadOption << ioBackendOption << writePolicyOption
+                                                  << writeChunkOption << cacheBudgetOption
+                                                  << filesOption << volumeOption << durationOption << poolBudgetOption
+                                                  << noMicroOption << outputOption);
+    parser.process(arguments);
+
+    m_destinationDirs.clear();
+    QStringList destinationDirs = parser.values(destinationOption);
+    if(destinationDirs.isEmpty()) {
+        if(QDir("/dev/shm").exists())
+            destinationDirs << "/dev/shm";
+        destinationDirs << QDir::tempPath();
+    }
+    foreach(const QString& destinationDir, destinationDirs) {
+        if(!QDir(destinationDir).exists()) {
+            printError(QString("Destination directory %1 doesn't exist").arg(destinationDir));
+            return false;
+        }
+        m_destinationDirs << QDir(destinationDir).absolutePath();
+    }
+
+    if(!parseSizes(parser.value(sizesOption), m_sizes)) {
+        printError("Invalid file sizes");
+        return false;
+    }
+    if(!parseCounts(parser.value(threadsOption), m_threadsNbs, MAX_THREADS_NB)) {
+        printError(QString("Invalid thread counts, expected 1..%1").arg(MAX_THREADS_NB));
+        return false;
+    }
+    if(!parseCounts(parser.value(poolSizesOption), m_poolSizes, INT_MAX)) {
+        printError("Invalid pool sizes");
+        return false;
+    }
+
+    m_payloads = parser.value(payloadOption).split(',', QString::SkipEmptyParts);
+    foreach(const QString& payload, m_payloads) {
+        if(payload != "templates" && payload != "synthetic") {
+            printError("Invalid payload, expected templates and/or synthetic");
+            return false;
+        }
+    }
+    if(m_payloads.isEmpty()) {
+        printError("No payload to measure");
+        return false;
+    }
+
+    if(!IoBackend::parse(parser.value(ioBackendOption), m_ioBackend)) {
+        printError("Invalid I/O backend, expected sync or uring");
+        return false;
+    }
+    if(!IoBackend::isSupported(m_ioBackend)) {
+        printError(QString("I/O backend %1 is not supported here").arg(IoBackend::toString(m_ioBackend)));
+        return false;
+    }
+
+    bool ok;
+    qint64 writeChunk = SizeDistribution::parseSize(parser.value(writeChunkOption), &ok);
+    if(!ok || writeChunk < 0 || writeChunk > MAX_WRITE_CHUNK_SIZE) {
+        printError("Invalid write chunk size");
+        return false;
+    }
+    m_writePolicies.clear();
+    QStringList writePolicies = parser.isSet(writePolicyOption) ? parser.values(writePolicyOption) : QStringList() << "none";
+    foreach(const QString& spec, writePolicies) {
+        WritePolicy writePolicy;
+        if(!writePolicy.parse(spec)) {
+            printError(QString("Invalid write policy %1").arg(spec));
+            return false;
+        }
+        writePolicy.setChunkSize(writeChunk);
+        if(writePolicy.isEnabled() && !WritePolicy::isSupported()) {
+            printError("Write policies are not supported here");
+            return false;
+        }
+        m_writePolicies << writePolicy;
+    }
+
+    m_cacheBudgetInMb = parser.value(cacheBudgetOption).toInt(&ok);
+    if(!ok || m_cacheBudgetInMb < 0) {
+        printError("Invalid template cache budget");
+        return false;
+    }
+    m_caseFilesNb = parser.value(filesOption).toLongLong(&ok);
+    if(!ok || m_caseFilesNb < 1) {
+        printError("Invalid files number");
+        return false;
+    }
+    m_caseVolume = SizeDistribution::parseSize(parser.value(volumeOption), &ok);
+    if(!ok || m_caseVolume < 1) {
+        printError("Invalid volume");
+        return false;
+    }
+    m_caseDurationInSecs = parser.value(durationOption).toInt(&ok);
+    if(!ok || m_caseDurationInSecs < 1) {
+        printError("Invalid duration");
+        return false;
+    }
+    m_poolBudget = SizeDistribution::parseSize(parser.value(poolBudgetOption), &ok);
+    if(!ok || m_poolBudget < 1) {
+        printError("Invalid pool budget");
+        return false;
+    }
+    m_microBenchmarks = !parser.isSet(noMicroOption);
+
+    if(parser.isSet(outputOption)) {
+        m_output.setFileName(parser.value(outputOption));
+        m_outputFormat = QFileInfo(m_output.fileName()).suffix().toLower() == "csv" ? CSV_LOG : JSONL_LOG;
+        if(!m_output.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            printError(QString("Can't open %1").arg(m_output.fileName()));
+            return false;
+        }
+    } else if(!m_output.open(stdout, QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    return true;
+}
+
+// process time of every thread, the copy workers included
+double BenchmarkRunner::getCpuTimeInSecs() {
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage))
+        return 0.;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+    return double(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+int BenchmarkRunner::run() {
+    int exitCode = 0;
+
+    if(m_microBenchmarks) {
+        foreach(int poolSize, m_poolSizes) {
+            runPickBenchmark(poolSize);
+        }
+        foreach(int threadsNb, m_threadsNbs) {
+            runTotalsBenchmark(threadsNb);
+        }
+    }
+
+    foreach(const QString& destinationDir, m_destinationDirs) {
+        QDir workDir(QDir(destinationDir).filePath("trafficgen-benchmark"));
+        QString templatesDir = workDir.filePath("templates");
+        QString outputDir = workDir.filePath("output");
+
+        foreach(const QString& payload, m_payloads) {
+            bool synthetic = payload == "synthetic";
+            foreach(qint64 size, m_sizes) {
+                // synthetic files don't use the pool, one pass is enough
+                QVector<int> poolSizes = synthetic ? QVector<int>() << 0 : m_poolSizes;
+                foreach(int poolSize, poolSizes) {
+                    // a pool larger than the budget is cut down, the record tells the actual size
+                    int actualPoolSize = int(qBound(qint64(1), m_poolBudget / size, qint64(poolSize)));
+                    if(!synthetic && !prepareTemplates(templatesDir, size, actualPoolSize)) {
+                        printError(QString("Can't write templates to %1").arg(templatesDir));
+                        exitCode = 2;
+                        continue;
+                    }
+                    foreach(const WritePolicy& writePolicy, m_writePolicies) {
+                        foreach(int threadsNb, m_threadsNbs) {
+                            BenchmarkResult result;
+                            result.name = "generate";
+                            result.destination = destinationDir;
+                            result.payload = payload;
+                            result.writePolicy = writePolicy.toString();
+                            result.fileSize = size;
+                            result.threadsNb = threadsNb;
+                            result.poolSize = synthetic ? 0 : actualPoolSize;
+                            if(!runCase(outputDir, templatesDir, writePolicy, result)) {
+                                printError(QString("Case failed: %1, %2, %3 bytes, %4 threads, pool %5")
+                                           .arg(destinationDir).arg(result.writePolicy).arg(size)
+                                           .arg(threadsNb).arg(result.poolSize));
+                                exitCode = 2;
+                            }
+                            writeResult(result);
+                        }
+                    }
+                }
+            }
+        }
+        workDir.removeRecursively();
+    }
+
+    m_output.close();
+    return exitCode;
+}
+
+// pool files are kept between cases of the same size, only the missing ones are written
+bool BenchmarkRunner::prepareTemplates(const QString& templatesDir, qint64 size, int poolSize) {
+    QDir dir(templatesDir);
+    if(!dir.exists() && !QDir().mkpath(templatesDir))
+        return false;
+
+    QByteArray chunk(int(qMin(size, qint64(TEMPLATE_WRITE_CHUNK_SIZE))), Qt::Uninitialized);
+    for(int i = 0; i < poolSize; i++) {
+        QString path = dir.filePath(QString("template%1.bin").arg(i));
+        if(QFileInfo(path).size() == size)
+            continue;
+
+        QFile file(path);
+        if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+        for(qint64 written = 0; written < size;) {
+            int chunkSize = int(qMin(size - written, qint64(chunk.size())));
+            QRandomGenerator::global()->fillRange(reinterpret_cast<quint32*>(chunk.data()), chunk.size() / int(sizeof(quint32)));
+            if(file.write(chunk.constData(), chunkSize) != chunkSize)
+                return false;
+            written += chunkSize;
+        }
+    }
+    return true;
+}
+
+// a fresh generator for every case, run at unlimited rate until the case limit
+bool BenchmarkRunner::runCase(const QString& outputDir, const QString& templatesDir, const WritePolicy& writePolicy,
+                              BenchmarkResult& result) {
+    QDir(outputDir).removeRecursively();
+    if(!QDir().mkpath(outputDir))
+        return false;
+
+    TrafficGenerator trfGen;
+    QThread trafficThread;
+    m_caseFailed = false;
+    connect(&trfGen, &TrafficGenerator::executeError, this, [this](int) { m_caseFailed = true; }, Qt::DirectConnection);
+    trfGen.moveToThread(&trafficThread);
+    trafficThread.start();
+
+    trfGen.setDestinationDir(outputDir);
+    trfGen.setThreadsNb(result.threadsNb);
+    trfGen.setIoBackend(m_ioBackend);
+    trfGen.setWritePolicy(writePolicy);
+    trfGen.setTemplateCacheBudgetInMb(m_cacheBudgetInMb);
+    trfGen.setTargetRate(0., FILES_PER_SEC);
+    trfGen.setInfectedFileGenerateProbability(0.);
+    trfGen.setSeed(quint64(result.fileSize));
+    if(result.payload == "synthetic") {
+        SizeDistribution sizeDistribution;
+        sizeDistribution.parse(QString("fixed:%1").arg(result.fileSize));
+        trfGen.setSizeDistribution(sizeDistribution);
+        trfGen.setPayloadSource(SYNTHETIC_PAYLOAD);
+    } else {
+        QStringList fileNames;
+        for(int i = 0; i < result.poolSize; i++) {
+            fileNames << QDir(templatesDir).filePath(QString("template%1.bin").arg(i));
+        }
+        trfGen.addCleanFiles(fileNames);
+    }
+
+    qint64 filesNb = qBound(qint64(1), m_caseVolume / result.fileSize, m_caseFilesNb);
+    qint64 startAllocationsNb = AllocationCounter::getAllocationsNb();
+    double startCpuTime = getCpuTimeInSecs();
+    QElapsedTimer timer;
+    timer.start();
+
+    trfGen.start();
+    while(!m_caseFailed && trfGen.getGlobalCnt() + trfGen.getFailedFilesNb() < filesNb &&
+          timer.elapsed() < m_caseDurationInSecs * 1000) {
+        QThread::msleep(PROGRESS_POLL_INTERVAL);
+    }
+    trfGen.stop();
+
+    result.wallTimeInSecs = timer.nsecsElapsed() / 1e9;
+    result.cpuTimeInSecs = getCpuTimeInSecs() - startCpuTime;
+    result.allocationsNb = AllocationCounter::getAllocationsNb() - startAllocationsNb;
+    result.filesNb = trfGen.getGlobalCnt();
+    result.bytes = qint64(trfGen.getTotalVolInBytes());
+    result.failedFilesNb = trfGen.getFailedFilesNb();
+    result.latencyP99InNsecs = trfGen.getCopyLatencyInNsecs(0.99);
+
+    trafficThread.quit();
+    trafficThread.wait();
+    QDir(outputDir).removeRecursively();
+    return !m_caseFailed && !result.failedFilesNb;
+}
+
+// weighted pools go through the alias table, the costlier path
+void BenchmarkRunner::runPickBenchmark(int poolSize) {
+    TemplatePool pool(CLEAN);
+    for(int i = 0; i < poolSize; i++) {
+        pool.add(QString("template%1").arg(i), 1, 1. + i % 7);
+    }
+    pool.buildAliasTable();
+    QRandomGenerator rng(quint32(poolSize));
+
+    BenchmarkResult result;
+    result.name = "pick";
+    result.poolSize = poolSize;
+    qint64 startAllocationsNb = AllocationCounter::getAllocationsNb();
+    double startCpuTime = getCpuTimeInSecs();
+    QElapsedTimer timer;
+    timer.start();
+
+    qint64 checksum = 0;
+    for(int i = 0; i < MICRO_ITERATIONS_NB; i++) {
+        checksum += pool.pick(rng);
+    }
+
+    result.wallTimeInSecs = timer.nsecsElapsed() / 1e9;
+    result.cpuTimeInSecs = getCpuTimeInSecs() - startCpuTime;
+    result.allocationsNb = AllocationCounter::getAllocationsNb() - startAllocationsNb;
+    result.filesNb = MICRO_ITERATIONS_NB;
+    benchmarkSink = checksum;
+    writeResult(result);
+}
+
+// what every statistics reader pays: totals summed over one shard per worker
+void BenchmarkRunner::runTotalsBenchmark(int shardsNb) {
+    Metrics metrics;
+    for(int i = 0; i < shardsNb; i++) {
+        metrics.getShard(i)->addFile(1024, false, 1000);
+    }
+
+    BenchmarkResult result;
+    result.name = "totals";
+    result.threadsNb = shardsNb;
+    qint64 startAllocationsNb = AllocationCounter::getAllocationsNb();
+    double startCpuTime = getCpuTimeInSecs();
+    QElapsedTimer timer;
+    timer.start();
+
+    qint64 checksum = 0;
+    for(int i = 0; i < MICRO_ITERATIONS_NB; i++) {
+        checksum += metrics.getTotals().filesCnt;
+    }
+
+    result.wallTimeInSecs = timer.nsecsElapsed() / 1e9;
+    result.cpuTimeInSecs = getCpuTimeInSecs() - startCpuTime;
+    result.allocationsNb = AllocationCounter::getAllocationsNb() - startAllocationsNb;
+    result.filesNb = MICRO_ITERATIONS_NB;
+    benchmarkSink = checksum;
+    writeResult(result);
+}
+
+// operations are files for the generation cases, calls for the others
+void BenchmarkRunner::writeResult(const BenchmarkResult& result) {
+    double wallTimeInSecs = qMax(result.wallTimeInSecs, 1e-9);
+    double volumeInGb = result.bytes / 1024. / 1024. / 1024.;
+
+    QJsonObject record;
+    record["name"] = result.name;
+    record["destination"] = result.destination;
+    record["payload"] = result.payload;
+    record["write_policy"] = result.writePolicy;
+    record["file_size"] = result.fileSize;
+    record["threads"] = result.threadsNb;
+    record["pool_size"] = result.poolSize;
+    record["operations"] = result.filesNb;
+    record["bytes"] = result.bytes;
+    record["failed"] = result.failedFilesNb;
+    record["wall_s"] = result.wallTimeInSecs;
+    record["cpu_s"] = result.cpuTimeInSecs;
+    record["ops_per_s"] = result.filesNb / wallTimeInSecs;
+    record["ns_per_op"] = result.filesNb ? result.wallTimeInSecs * 1e9 / result.filesNb : 0.;
+    record["mb_per_s"] = result.bytes / 1024. / 1024. / wallTimeInSecs;
+    record["cpu_s_per_gb"] = volumeInGb > 0. ? result.cpuTimeInSecs / volumeInGb : 0.;
+    record["allocations"] = result.allocationsNb;
+    record["allocations_per_op"] = result.filesNb ? double(result.allocationsNb) / result.filesNb : 0.;
+    record["latency_p99_ms"] = result.latencyP99InNsecs / 1e6;
+
+    // the column order is fixed by the header, so CSV doesn't depend on the JSON key order
+    static const QStringList columns = QStringList() << "name" << "destination" << "payload" << "write_policy" << "file_size"
+                                                     << "threads" << "pool_size" << "operations" << "bytes" << "failed"
+                                                     << "wall_s" << "cpu_s" << "ops_per_s" << "ns_per_op" << "mb_per_s"
+                                                     << "cpu_s_per_gb" << "allocations" << "allocations_per_op"
+                                                     << "latency_p99_ms";
+    QByteArray line;
+    if(m_outputFormat == JSONL_LOG) {
+        line = QJsonDocument(record).toJson(QJsonDocument::Compact);
+    } else {
+        if(!m_headerWritten) {
+            m_output.write(columns.join(',').toUtf8() + '\n');
+            m_headerWritten = true;
+        }
+        QStringList values;
+        foreach(const QString& column, columns) {
+            values << record.value(column).toVariant().toString();
+        }
+        line = values.join(',').toUtf8();
+    }
+    m_output.write(line + '\n');
+    m_output.flush();
+}
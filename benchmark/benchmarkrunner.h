@@ -0,0 +1,85 @@
+#ifndef BENCHMARKRUNNER_H
+#define BENCHMARKRUNNER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QFile>
+
+#include "trafficgenerator.h"
+#include "statsexporter.h"
+
+#define     DEFAULT_BENCHMARK_SIZES         "4K,64K,1M,16M,256M,1G"
+#define     DEFAULT_BENCHMARK_THREADS       "1,4,16"
+#define     DEFAULT_BENCHMARK_POOLS         "1,64,1024"
+#define     DEFAULT_CASE_FILES_NB           2000
+#define     DEFAULT_CASE_VOLUME             "1G"
+#define     DEFAULT_CASE_DURATION           10
+#define     DEFAULT_POOL_BUDGET             "1G"
+#define     PROGRESS_POLL_INTERVAL          5
+#define     MICRO_ITERATIONS_NB             1000000
+#define     TEMPLATE_WRITE_CHUNK_SIZE       (1024 * 1024)
+
+// one measured combination, written as one record
+struct BenchmarkResult {
+    QString name;
+    QString destination;
+    QString payload;
+    QString writePolicy;
+    qint64 fileSize{0};
+    int threadsNb{0};
+    int poolSize{0};
+    qint64 filesNb{0};
+    qint64 bytes{0};
+    qint64 failedFilesNb{0};
+    double wallTimeInSecs{0.};
+    double cpuTimeInSecs{0.};
+    qint64 allocationsNb{0};
+    qint64 latencyP99InNsecs{0};
+};
+
+// headless benchmark of the generation hot path: every destination (say a tmpfs
+// and a disk directory) is swept over write policies, file sizes, copy threads
+// and template pool sizes at unlimited rate, each case stopped after a number of files, a volume or
+// a duration. Template picking and statistics aggregation are measured on their
+// own. Results are JSON lines, or CSV for a .csv output file.
+class BenchmarkRunner : public QObject {
+
+    Q_OBJECT
+
+    QStringList m_destinationDirs;
+    QVector<qint64> m_sizes;
+    QVector<int> m_threadsNbs;
+    QVector<int> m_poolSizes;
+    QStringList m_payloads;
+    IO_BACKEND m_ioBackend{SYNC_IO_BACKEND};
+    QVector<WritePolicy> m_writePolicies;
+    int m_cacheBudgetInMb{DEFAULT_TEMPLATE_CACHE_BUDGET_MB};
+    qint64 m_caseFilesNb{DEFAULT_CASE_FILES_NB};
+    qint64 m_caseVolume{0};
+    int m_caseDurationInSecs{DEFAULT_CASE_DURATION};
+    qint64 m_poolBudget{0};
+    bool m_microBenchmarks{true};
+
+    QFile m_output;
+    STATS_LOG_FORMAT m_outputFormat{JSONL_LOG};
+    bool m_headerWritten{false};
+    std::atomic<bool> m_caseFailed{false};
+
+    bool prepareTemplates(const QString& templatesDir, qint64 size, int poolSize);
+    bool runCase(const QString& destinationDir, const QString& templatesDir, const WritePolicy& writePolicy,
+                 BenchmarkResult& result);
+    void runPickBenchmark(int poolSize);
+    void runTotalsBenchmark(int shardsNb);
+    void writeResult(const BenchmarkResult& result);
+
+public:
+    BenchmarkRunner();
+
+    bool parseArguments(const QStringList& arguments);
+    int run();
+
+    static double getCpuTimeInSecs();
+};
+
+#endif // BENCHMARKRUNNER_H
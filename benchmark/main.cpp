@@ -0,0 +1,12 @@
+#include "benchmarkrunner.h"
+
+#include <QCoreApplication>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    BenchmarkRunner runner;
+    if(!runner.parseArguments(a.arguments()))
+        return 1;
+    return runner.run();
+}
@@ -0,0 +1,569 @@
+#include "cluster.h"
+
+#include <QCoreApplication>
+#include <QSysInfo>
+#include <QFile>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#endif
+
+// one compact JSON object per line, both ways
+static void writeMessage(QTcpSocket* socket, const QJsonObject& message) {
+    socket->write(QJsonDocument(message).toJson(QJsonDocument::Compact) + '\n');
+}
+
+// complete lines only, a peer sending a line longer than the limit is dropped
+static bool readMessage(QTcpSocket* socket, QJsonObject& message) {
+    while(socket->canReadLine()) {
+        QJsonDocument document = QJsonDocument::fromJson(socket->readLine(MAX_CONTROL_MESSAGE_SIZE).trimmed());
+        if(document.isObject()) {
+            message = document.object();
+            return true;
+        }
+    }
+    if(socket->bytesAvailable() >= MAX_CONTROL_MESSAGE_SIZE)
+        socket->abort();
+    return false;
+}
+
+static QString rateUnitName(RATE_UNIT rateUnit) {
+    return rateUnit == BYTES_PER_SEC ? "bytes" : "files";
+}
+
+CpuAffinity::CpuAffinity() {
+}
+
+bool CpuAffinity::parse(const QString& list) {
+    QVector<int> cpus;
+    foreach(const QString& item, list.split(',', QString::SkipEmptyParts)) {
+        QStringList bounds = item.trimmed().split('-');
+        bool firstOk;
+        bool lastOk = true;
+        int first = bounds.at(0).toInt(&firstOk);
+        int last = bounds.size() == 2 ? bounds.at(1).toInt(&lastOk) : first;
+        if(bounds.size() > 2 || !firstOk || !lastOk || first < 0 || last < first || last >= MAX_CPUS_NB)
+            return false;
+        for(int cpu = first; cpu <= last; cpu++) {
+            if(!cpus.contains(cpu))
+                cpus << cpu;
+        }
+    }
+    if(cpus.isEmpty())
+        return false;
+
+    std::sort(cpus.begin(), cpus.end());
+    m_cpus = cpus;
+    return true;
+}
+
+// the node's CPU list has the same format as --cpus
+bool CpuAffinity::parseNumaNode(int node) {
+    QFile cpuList(QString("/sys/devices/system/node/node%1/cpulist").arg(node));
+    if(node < 0 || !cpuList.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    return parse(QString::fromLatin1(cpuList.readAll()).trimmed());
+}
+
+QString CpuAffinity::toString() const {
+    QStringList ranges;
+    for(int i = 0; i < m_cpus.size();) {
+        int last = i;
+        while(last + 1 < m_cpus.size() && m_cpus.at(last + 1) == m_cpus.at(last) + 1) {
+            last++;
+        }
+        ranges << (last == i ? QString::number(m_cpus.at(i)) : QString("%1-%2").arg(m_cpus.at(i)).arg(m_cpus.at(last)));
+        i = last + 1;
+    }
+    return ranges.isEmpty() ? QString("all") : ranges.join(',');
+}
+
+bool CpuAffinity::isEnabled() const {
+    return !m_cpus.isEmpty();
+}
+
+// the affinity belongs to each thread, so every task of the process is pinned
+bool CpuAffinity::apply() const {
+#ifdef Q_OS_LINUX
+    if(m_cpus.isEmpty())
+        return true;
+
+    cpu_set_t* cpuSet = CPU_ALLOC(MAX_CPUS_NB);
+    size_t cpuSetSize = CPU_ALLOC_SIZE(MAX_CPUS_NB);
+    CPU_ZERO_S(cpuSetSize, cpuSet);
+    foreach(int cpu, m_cpus) {
+        CPU_SET_S(size_t(cpu), cpuSetSize, cpuSet);
+    }
+
+    bool applied = true;
+    foreach(const QString& task, QDir("/proc/self/task").entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        applied = ::sched_setaffinity(pid_t(task.toInt()), cpuSetSize, cpuSet) == 0 && applied;
+    }
+    CPU_FREE(cpuSet);
+    return applied;
+#else
+    return m_cpus.isEmpty();
+#endif
+}
+
+bool CpuAffinity::isSupported() {
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+// -----------------------------------------------------------------------------------------
+
+ClusterAgent::ClusterAgent(TrafficGenerator* trfGen): m_trfGen(trfGen) {
+    m_startTimer.setSingleShot(true);
+    m_startTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_startTimer, &QTimer::timeout, this, &ClusterAgent::startRequested);
+}
+
+bool ClusterAgent::listen(const QHostAddress& address, quint16 port) {
+    delete m_server;
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection, this, &ClusterAgent::acceptConnection);
+
+    if(!m_server->listen(address, port)) {
+        delete m_server;
+        m_server = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool ClusterAgent::isListening() const {
+    return m_server;
+}
+
+quint16 ClusterAgent::getPort() const {
+    return m_server ? m_server->serverPort() : 0;
+}
+
+void ClusterAgent::setAffinity(const CpuAffinity& affinity) {
+    m_affinity = affinity;
+}
+
+// one coordinator per run, later connections are turned away
+void ClusterAgent::acceptConnection() {
+    while(m_server->hasPendingConnections()) {
+        QTcpSocket* socket = m_server->nextPendingConnection();
+        if(m_socket) {
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+
+        m_socket = socket;
+        connect(m_socket, &QTcpSocket::readyRead, this, &ClusterAgent::readMessages);
+        connect(m_socket, &QTcpSocket::disconnected, this, [this]{
+            m_socket->deleteLater();
+            m_socket = nullptr;
+            m_startTimer.stop();
+            emit coordinatorLost();
+        });
+    }
+}
+
+void ClusterAgent::readMessages() {
+    QJsonObject message;
+    while(m_socket && readMessage(m_socket, message)) {
+        handleMessage(message);
+    }
+}
+
+void ClusterAgent::handleMessage(const QJsonObject& message) {
+    QString type = message.value("type").toString();
+
+    if(type == "hello") {
+        if(message.value("version").toInt() != CLUSTER_PROTOCOL_VERSION) {
+            writeMessage(m_socket, QJsonObject{{"type", "error"}, {"reason", "protocol version mismatch"}});
+            m_socket->disconnectFromHost();
+            return;
+        }
+        bool networkDelivery = m_trfGen->getScanTarget().isEnabled();
+        writeMessage(m_socket, QJsonObject{
+            {"type", "ready"},
+            {"name", QString("%1/%2").arg(QSysInfo::machineHostName()).arg(QCoreApplication::applicationPid())},
+            {"threads", m_trfGen->getThreadsNb()},
+            {"destination", networkDelivery ? m_trfGen->getScanTarget().toString() : m_trfGen->getDestinationDirs().join(", ")},
+            {"cpus", m_affinity.toString()}
+        });
+    } else if(type == "start") {
+        if(m_startRequested)
+            return;
+        m_startRequested = true;
+        m_trfGen->setTargetRate(message.value("rate").toDouble(),
+                                message.value("rate_unit").toString() == rateUnitName(BYTES_PER_SEC) ? BYTES_PER_SEC : FILES_PER_SEC);
+        m_trfGen->setWorkloadRateScale(message.value("share").toDouble(1.));
+        if(message.contains("seed"))
+            m_trfGen->setSeed(message.value("seed").toString().toULongLong());
+        m_startTimer.start(qMax(0, message.value("delay_ms").toInt()));
+    } else if(type == "rate") {
+        if(!m_startRequested)
+            return;
+        // a running profile would lose its phase rate, its rates are scaled instead
+        m_trfGen->setWorkloadRateScale(message.value("share").toDouble(1.));
+        if(m_trfGen->getWorkloadProfile().isEmpty())
+            m_trfGen->setTargetRate(message.value("rate").toDouble(),
+                                    message.value("rate_unit").toString() == rateUnitName(BYTES_PER_SEC) ? BYTES_PER_SEC : FILES_PER_SEC);
+    } else if(type == "report") {
+        sendReport(false);
+    } else if(type == "stop") {
+        m_startTimer.stop();
+        emit stopRequested();
+    }
+}
+
+// latency histograms are sparse, only the used buckets are sent as [bucket, count]
+void ClusterAgent::sendReport(bool final) {
+    if(!m_socket)
+        return;
+
+    QJsonArray latency;
+    QVector<qint64> latencyBuckets = m_trfGen->getCopyLatencyBuckets();
+    for(int i = 0; i < latencyBuckets.size(); i++) {
+        if(latencyBuckets.at(i))
+            latency.append(QJsonArray{i, double(latencyBuckets.at(i))});
+    }
+
+    writeMessage(m_socket, QJsonObject{
+        {"type", "report"},
+        {"final", final},
+        {"running", m_trfGen->getWorkStatus()},
+        {"rate", m_trfGen->getTargetRate()},
+        {"seed", QString::number(m_trfGen->getSeed())},
+        {"work_time_s", m_trfGen->getWorkTimeInSecs()},
+        {"files", double(m_trfGen->getGlobalCnt())},
+        {"infected", double(m_trfGen->getInfectedFilesNb())},
+        {"failed", double(m_trfGen->getFailedFilesNb())},
+        {"bytes", m_trfGen->getTotalVolInBytes()},
+        {"files_rate", m_trfGen->getFilesRate(1)},
+        {"bytes_rate", m_trfGen->getBytesRate(1)},
+        {"latency", latency}
+    });
+}
+
+void ClusterAgent::finish() {
+    if(!m_socket)
+        return;
+
+    sendReport(true);
+    m_socket->disconnect(this);
+    m_socket->flush();
+    m_socket->waitForBytesWritten(CLUSTER_STOP_TIMEOUT);
+    m_socket->disconnectFromHost();
+}
+
+// -----------------------------------------------------------------------------------------
+
+ClusterCoordinator::ClusterCoordinator() {
+    m_connectTimer.setSingleShot(true);
+    m_connectTimer.setInterval(CLUSTER_CONNECT_TIMEOUT);
+    connect(&m_connectTimer, &QTimer::timeout, this, [this]{
+        for(int i = 0; i < m_agents.size(); i++) {
+            if(!m_agents.at(i).ready)
+                loseAgent(i, "no answer");
+        }
+    });
+
+    m_stopTimer.setSingleShot(true);
+    m_stopTimer.setInterval(CLUSTER_STOP_TIMEOUT);
+    connect(&m_stopTimer, &QTimer::timeout, this, [this]{
+        for(int i = 0; i < m_agents.size(); i++) {
+            if(!m_agents.at(i).report.finished)
+                loseAgent(i, "no final report");
+        }
+    });
+}
+
+ClusterCoordinator::~ClusterCoordinator() {
+    foreach(const AgentLink& agent, m_agents) {
+        if(agent.socket)
+            agent.socket->disconnect(this);
+    }
+}
+
+bool ClusterCoordinator::addAgent(const QString& address) {
+    QString host = address.trimmed();
+    int port = DEFAULT_AGENT_PORT;
+    int colonIdx = host.lastIndexOf(':');
+    if(colonIdx >= 0 && (!host.startsWith('[') || host.lastIndexOf(']') < colonIdx)) {
+        bool ok;
+        port = host.mid(colonIdx + 1).toInt(&ok);
+        if(!ok || port < 1 || port > 65535)
+            return false;
+        host = host.left(colonIdx);
+    }
+    if(host.startsWith('[') && host.endsWith(']'))
+        host = host.mid(1, host.size() - 2);
+    if(host.isEmpty() || m_agents.size() >= MAX_AGENTS_NB)
+        return false;
+
+    AgentLink agent;
+    agent.host = host;
+    agent.port = quint16(port);
+    m_agents << agent;
+    return true;
+}
+
+int ClusterCoordinator::getAgentsNb() const {
+    return m_agents.size();
+}
+
+QString ClusterCoordinator::getAgentAddress(int agentIdx) const {
+    const AgentLink& agent = m_agents.at(agentIdx);
+    return QString("%1:%2").arg(agent.host.contains(':') ? QString("[%1]").arg(agent.host) : agent.host).arg(agent.port);
+}
+
+bool ClusterCoordinator::isAgentLost(int agentIdx) const {
+    return m_agents.at(agentIdx).lost;
+}
+
+const AgentReport& ClusterCoordinator::getReport(int agentIdx) const {
+    return m_agents.at(agentIdx).report;
+}
+
+// counters and rates add up, the work time is the longest one
+AgentReport ClusterCoordinator::getTotalReport() const {
+    AgentReport total;
+    total.latencyBuckets.fill(0, LATENCY_BUCKETS_NB);
+    foreach(const AgentLink& agent, m_agents) {
+        const AgentReport& report = agent.report;
+        total.threadsNb += report.threadsNb;
+        total.targetRate += report.targetRate;
+        total.running = total.running || report.running;
+        total.workTimeInSecs = qMax(total.workTimeInSecs, report.workTimeInSecs);
+        total.filesCnt += report.filesCnt;
+        total.infectedFilesCnt += report.infectedFilesCnt;
+        total.failedFilesCnt += report.failedFilesCnt;
+        total.bytes += report.bytes;
+        total.filesRate += report.filesRate;
+        total.bytesRate += report.bytesRate;
+        for(int i = 0; i < report.latencyBuckets.size() && i < LATENCY_BUCKETS_NB; i++) {
+            total.latencyBuckets[i] += report.latencyBuckets.at(i);
+        }
+    }
+    return total;
+}
+
+void ClusterCoordinator::setTargetRate(double targetRate, RATE_UNIT rateUnit) {
+    m_targetRate = targetRate;
+    m_rateUnit = rateUnit;
+}
+
+double ClusterCoordinator::getTargetRate() const {
+    return m_targetRate;
+}
+
+RATE_UNIT ClusterCoordinator::getRateUnit() const {
+    return m_rateUnit;
+}
+
+// every agent gets its own seed derived from this one, so a cluster run replays too
+void ClusterCoordinator::setSeed(quint64 seed) {
+    m_seed = seed;
+    m_seedFixed = true;
+}
+
+void ClusterCoordinator::connectAgents() {
+    for(int i = 0; i < m_agents.size(); i++) {
+        QTcpSocket* socket = new QTcpSocket(this);
+        m_agents[i].socket = socket;
+        connect(socket, &QTcpSocket::connected, this, [this, i]{ sendHello(i); });
+        connect(socket, &QTcpSocket::readyRead, this, [this, i]{ readMessages(i); });
+        connect(socket, &QTcpSocket::stateChanged, this, [this, i](QAbstractSocket::SocketState state) {
+            if(state == QAbstractSocket::UnconnectedState)
+                loseAgent(i, m_agents.at(i).socket->errorString());
+        });
+        socket->connectToHost(m_agents.at(i).host, m_agents.at(i).port);
+    }
+    m_connectTimer.start();
+}
+
+void ClusterCoordinator::sendHello(int agentIdx) {
+    m_agents[agentIdx].helloTimeInNsecs = Metrics::nowInNsecs();
+    writeMessage(m_agents.at(agentIdx).socket, QJsonObject{{"type", "hello"}, {"version", CLUSTER_PROTOCOL_VERSION}});
+}
+
+void ClusterCoordinator::readMessages(int agentIdx) {
+    QJsonObject message;
+    while(m_agents.at(agentIdx).socket && readMessage(m_agents.at(agentIdx).socket, message)) {
+        handleMessage(agentIdx, message);
+    }
+}
+
+void ClusterCoordinator::handleMessage(int agentIdx, const QJsonObject& message) {
+    AgentLink& agent = m_agents[agentIdx];
+    AgentReport& report = agent.report;
+    QString type = message.value("type").toString();
+
+    if(type == "ready") {
+        agent.roundTripInNsecs = Metrics::nowInNsecs() - agent.helloTimeInNsecs;
+        agent.ready = true;
+        report.name = message.value("name").toString();
+        report.threadsNb = qMax(1, message.value("threads").toInt());
+        report.destination = message.value("destination").toString();
+        report.cpus = message.value("cpus").toString();
+        checkReady();
+    } else if(type == "report") {
+        report.finished = message.value("final").toBool();
+        report.running = message.value("running").toBool();
+        report.targetRate = message.value("rate").toDouble();
+        report.seed = message.value("seed").toString().toULongLong();
+        report.workTimeInSecs = message.value("work_time_s").toDouble();
+        report.filesCnt = qint64(message.value("files").toDouble());
+        report.infectedFilesCnt = qint64(message.value("infected").toDouble());
+        report.failedFilesCnt = qint64(message.value("failed").toDouble());
+        report.bytes = qint64(message.value("bytes").toDouble());
+        report.filesRate = message.value("files_rate").toDouble();
+        report.bytesRate = message.value("bytes_rate").toDouble();
+        report.latencyBuckets.fill(0, LATENCY_BUCKETS_NB);
+        foreach(const QJsonValue& bucket, message.value("latency").toArray()) {
+            int bucketIdx = bucket.toArray().at(0).toInt(-1);
+            if(bucketIdx >= 0 && bucketIdx < LATENCY_BUCKETS_NB)
+                report.latencyBuckets[bucketIdx] = qint64(bucket.toArray().at(1).toDouble());
+        }
+        if(report.finished)
+            checkFinished();
+    } else if(type == "error") {
+        loseAgent(agentIdx, message.value("reason").toString());
+    }
+}
+
+// a lost agent keeps its last report, the totals still count what it did
+void ClusterCoordinator::loseAgent(int agentIdx, const QString& reason) {
+    AgentLink& agent = m_agents[agentIdx];
+    if(agent.lost || agent.report.finished)
+        return;
+
+    agent.lost = true;
+    if(agent.socket) {
+        agent.socket->disconnect(this);
+        agent.socket->abort();
+        agent.socket->deleteLater();
+        agent.socket = nullptr;
+    }
+    emit agentFailed(agentIdx, reason);
+    if(m_started && !m_stopping)
+        redistributeRate();
+    checkFinished();
+}
+
+// finished agents stopped on their own, their share isn't given to the others
+bool ClusterCoordinator::isAgentLive(int agentIdx) const {
+    const AgentLink& agent = m_agents.at(agentIdx);
+    return agent.socket && !agent.lost && !agent.report.finished;
+}
+
+// the rate follows the copy threads of the agents that are still there
+double ClusterCoordinator::getThreadsShare(int agentIdx) const {
+    int threadsNb = 0;
+    for(int i = 0; i < m_agents.size(); i++) {
+        if(isAgentLive(i))
+            threadsNb += m_agents.at(i).report.threadsNb;
+    }
+    return double(m_agents.at(agentIdx).report.threadsNb) / qMax(1, threadsNb);
+}
+
+double ClusterCoordinator::getShare(int agentIdx) const {
+    return m_targetRate * getThreadsShare(agentIdx);
+}
+
+void ClusterCoordinator::redistributeRate() {
+    int agentsNb = 0;
+    for(int i = 0; i < m_agents.size(); i++) {
+        if(!isAgentLive(i))
+            continue;
+        writeMessage(m_agents.at(i).socket, QJsonObject{
+            {"type", "rate"},
+            {"rate", getShare(i)},
+            {"rate_unit", rateUnitName(m_rateUnit)},
+            {"share", getThreadsShare(i)}
+        });
+        agentsNb++;
+    }
+    if(agentsNb)
+        emit rateRedistributed(agentsNb);
+}
+
+void ClusterCoordinator::checkReady() {
+    foreach(const AgentLink& agent, m_agents) {
+        if(!agent.ready)
+            return;
+    }
+    m_connectTimer.stop();
+    emit agentsReady();
+}
+
+bool ClusterCoordinator::isStarted() const {
+    return m_started;
+}
+
+// the shares follow the copy threads, agents answering late start late by half their round trip at most
+void ClusterCoordinator::start() {
+    if(m_started)
+        return;
+    m_started = true;
+
+    for(int i = 0; i < m_agents.size(); i++) {
+        AgentLink& agent = m_agents[i];
+        if(!isAgentLive(i))
+            continue;
+
+        QJsonObject message{
+            {"type", "start"},
+            {"rate", getShare(i)},
+            {"rate_unit", rateUnitName(m_rateUnit)},
+            {"share", getThreadsShare(i)},
+            {"delay_ms", int(qMax(qint64(0), CLUSTER_START_DELAY - agent.roundTripInNsecs / 2000000))}
+        };
+        // 64-bit seeds don't fit a JSON number
+        if(m_seedFixed)
+            message.insert("seed", QString::number(PayloadGenerator::deriveSeed(m_seed, quint64(i))));
+        writeMessage(agent.socket, message);
+    }
+    QTimer::singleShot(CLUSTER_START_DELAY, Qt::PreciseTimer, this, &ClusterCoordinator::started);
+}
+
+// the answers come in with the next event loop turns, the totals lag by one request
+void ClusterCoordinator::requestReports() {
+    foreach(const AgentLink& agent, m_agents) {
+        if(agent.socket && !agent.report.finished)
+            writeMessage(agent.socket, QJsonObject{{"type", "report"}});
+    }
+}
+
+void ClusterCoordinator::stop() {
+    if(m_stopping)
+        return;
+    m_stopping = true;
+
+    foreach(const AgentLink& agent, m_agents) {
+        if(agent.socket && !agent.report.finished)
+            writeMessage(agent.socket, QJsonObject{{"type", "stop"}});
+    }
+    m_stopTimer.start();
+    checkFinished();
+}
+
+// agents stopping on their own, at the end of a profile, finish before the coordinator asks
+void ClusterCoordinator::checkFinished() {
+    if(!m_started || m_finished)
+        return;
+    foreach(const AgentLink& agent, m_agents) {
+        if(!agent.lost && !agent.report.finished)
+            return;
+    }
+    m_finished = true;
+    m_stopTimer.stop();
+    emit finished();
+}
@@ -0,0 +1,184 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <QString>
+#include <QJsonObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+
+#include "trafficgenerator.h"
+
+#define     DEFAULT_AGENT_PORT          7345
+#define     DEFAULT_AGENT_ADDRESS       "127.0.0.1"
+#define     CLUSTER_PROTOCOL_VERSION    1
+#define     CLUSTER_START_DELAY         1000
+#define     CLUSTER_CONNECT_TIMEOUT     10000
+#define     CLUSTER_STOP_TIMEOUT        10000
+#define     MAX_CONTROL_MESSAGE_SIZE    (64 * 1024)
+#define     MAX_AGENTS_NB               256
+#define     MAX_CPUS_NB                 4096
+
+// CPUs a process is pinned to: a list such as 0-3,8 or the CPUs of a NUMA node.
+// Every thread already running is pinned and the ones started later inherit it;
+// memory follows the threads through the kernel's local allocation. Linux only.
+class CpuAffinity {
+
+    QVector<int> m_cpus;
+
+public:
+    CpuAffinity();
+
+    bool parse(const QString& list);
+    bool parseNumaNode(int node);
+    QString toString() const;
+    bool isEnabled() const;
+
+    bool apply() const;
+
+    static bool isSupported();
+};
+
+// what an agent last told the coordinator about itself and its run
+struct AgentReport {
+    QString name;
+    int threadsNb{0};
+    QString destination;
+    QString cpus;
+    double targetRate{0.};
+    quint64 seed{0};
+
+    bool running{false};
+    bool finished{false};
+    double workTimeInSecs{0.};
+    qint64 filesCnt{0};
+    qint64 infectedFilesCnt{0};
+    qint64 failedFilesCnt{0};
+    qint64 bytes{0};
+    double filesRate{0.};
+    double bytesRate{0.};
+    QVector<qint64> latencyBuckets;
+};
+
+// agent side of a coordinated run, see ClusterCoordinator. Waits on its control
+// port for one coordinator, which sets the agent's share of the rate and its
+// seed, starts it after a delay, changes the share when another agent is lost
+// and stops it. A workload profile keeps its phases, their rates are scaled by
+// the share. Reports come from the lock-free
+// counters. Losing the coordinator stops the run, so no agent is left loading
+// the scanner on its own.
+class ClusterAgent : public QObject {
+
+    Q_OBJECT
+
+    TrafficGenerator* m_trfGen;
+    QTcpServer* m_server{nullptr};
+    QTcpSocket* m_socket{nullptr};
+    QTimer m_startTimer;
+    CpuAffinity m_affinity;
+    bool m_startRequested{false};
+
+    void acceptConnection();
+    void readMessages();
+    void handleMessage(const QJsonObject& message);
+    void sendReport(bool final);
+
+public:
+    explicit ClusterAgent(TrafficGenerator* trfGen);
+
+    bool listen(const QHostAddress& address, quint16 port);
+    bool isListening() const;
+    quint16 getPort() const;
+
+    // only reported to the coordinator, the caller pins the process
+    void setAffinity(const CpuAffinity& affinity);
+
+    // sends the final report once the run is stopped and waits for it to leave
+    void finish();
+
+signals:
+    void startRequested();
+    void stopRequested();
+    void coordinatorLost();
+};
+
+// splits a global target rate over agents (other TrafficGenerator processes,
+// local or remote) in proportion to their copy threads, starts them together
+// and adds up their reports. The start is sent ahead with the delay corrected
+// by half the round trip of the greeting, so agents begin within a few ms of
+// each other whatever their clocks say. Latency percentiles are computed on the
+// merged histograms. An agent lost during the run has its share spread over
+// the ones still running.
+class ClusterCoordinator : public QObject {
+
+    Q_OBJECT
+
+    struct AgentLink {
+        QString host;
+        quint16 port{0};
+        QTcpSocket* socket{nullptr};
+        qint64 helloTimeInNsecs{0};
+        qint64 roundTripInNsecs{0};
+        bool ready{false};
+        bool lost{false};
+        AgentReport report;
+    };
+
+    QVector<AgentLink> m_agents;
+    double m_targetRate{0.};
+    RATE_UNIT m_rateUnit{FILES_PER_SEC};
+    bool m_seedFixed{false};
+    quint64 m_seed{0};
+
+    QTimer m_connectTimer;
+    QTimer m_stopTimer;
+    bool m_started{false};
+    bool m_stopping{false};
+    bool m_finished{false};
+
+    void sendHello(int agentIdx);
+    void readMessages(int agentIdx);
+    void handleMessage(int agentIdx, const QJsonObject& message);
+    void loseAgent(int agentIdx, const QString& reason);
+    bool isAgentLive(int agentIdx) const;
+    double getThreadsShare(int agentIdx) const;
+    double getShare(int agentIdx) const;
+    void redistributeRate();
+    void checkReady();
+    void checkFinished();
+
+public:
+    ClusterCoordinator();
+    ~ClusterCoordinator();
+
+    // host[:port], IPv6 addresses in brackets
+    bool addAgent(const QString& address);
+    int getAgentsNb() const;
+    QString getAgentAddress(int agentIdx) const;
+    bool isAgentLost(int agentIdx) const;
+    const AgentReport& getReport(int agentIdx) const;
+    AgentReport getTotalReport() const;
+
+    void setTargetRate(double targetRate, RATE_UNIT rateUnit);
+    double getTargetRate() const;
+    RATE_UNIT getRateUnit() const;
+    void setSeed(quint64 seed);
+
+    void connectAgents();
+    bool isStarted() const;
+    void start();
+    void requestReports();
+    void stop();
+
+signals:
+    void agentsReady();
+    void started();
+    void agentFailed(int agentIdx, const QString& reason);
+    void rateRedistributed(int agentsNb);
+    void finished();
+};
+
+#endif // CLUSTER_H
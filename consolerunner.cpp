@@ -0,0 +1,1102 @@
+#include "consolerunner.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+#include <csignal>
+
+#include "networkbackend.h"
+
+static volatile std::sig_atomic_t interruptRequested = 0;
+
+static void handleInterrupt(int) {
+    interruptRequested = 1;
+}
+
+static void printLine(const QString& line) {
+    static QTextStream out(stdout);
+    out << line << '\n';
+    out.flush();
+}
+
+static void printError(const QString& line) {
+    static QTextStream err(stderr);
+    err << line << '\n';
+    err.flush();
+}
+
+// accepts plain bytes or K/M/G suffixed values, 1024-based like the GUI units
+static double parseSize(QString value, bool* ok) {
+    double multiplier = 1.;
+    value = value.trimmed().toUpper();
+    if(value.endsWith("B"))
+        value.chop(1);
+
+    if(value.endsWith("K")) {
+        multiplier = 1024.;
+    } else if(value.endsWith("M")) {
+        multiplier = 1024. * 1024.;
+    } else if(value.endsWith("G")) {
+        multiplier = 1024. * 1024. * 1024.;
+    }
+    if(multiplier > 1.)
+        value.chop(1);
+
+    return value.toDouble(ok) * multiplier;
+}
+
+static QString writePolicyName(const WritePolicy& writePolicy) {
+    if(!writePolicy.getChunkSize())
+        return writePolicy.toString();
+    return QString("%1 in %2 KB chunks").arg(writePolicy.toString()).arg(writePolicy.getChunkSize() / 1024.);
+}
+
+ConsoleRunner::ConsoleRunner() {
+    m_statsTimer.setInterval(DEFAULT_STATS_INTERVAL * 1000);
+    connect(&m_statsTimer, &QTimer::timeout, this, &ConsoleRunner::printStats);
+
+    m_signalTimer.setInterval(SIGNAL_POLL_INTERVAL);
+    connect(&m_signalTimer, &QTimer::timeout, this, &ConsoleRunner::checkSignals);
+
+    connect(&trfGen, &TrafficGenerator::executeError, this, &ConsoleRunner::executeError);
+    connect(&trfGen, &TrafficGenerator::workloadPhaseChanged, this, &ConsoleRunner::printPhase);
+    connect(&trfGen, &TrafficGenerator::workloadFinished, this, &ConsoleRunner::finish);
+
+    connect(&clusterAgent, &ClusterAgent::startRequested, this, [this]{
+        printLine(QString("Coordinated start: rate %1 %2")
+                  .arg(trfGen.getTargetRate())
+                  .arg(trfGen.getRateUnit() == FILES_PER_SEC ? "files/s" : "bytes/s"));
+        run();
+    });
+    connect(&clusterAgent, &ClusterAgent::stopRequested, this, &ConsoleRunner::finish);
+    connect(&clusterAgent, &ClusterAgent::coordinatorLost, this, [this]{
+        printError("Coordinator lost, stopping");
+        m_exitCode = 2;
+        finish();
+    });
+
+    connect(&clusterCoordinator, &ClusterCoordinator::agentsReady, this, [this]{
+        printAgents();
+        clusterCoordinator.start();
+    });
+    connect(&clusterCoordinator, &ClusterCoordinator::started, this, [this]{
+        m_runTimer.start();
+        m_statsTimer.start();
+        if(m_durationInSecs) {
+            QTimer::singleShot(int(m_durationInSecs * 1000), Qt::PreciseTimer, this, &ConsoleRunner::finish);
+        }
+    });
+    connect(&clusterCoordinator, &ClusterCoordinator::agentFailed, this, &ConsoleRunner::agentFailed);
+    connect(&clusterCoordinator, &ClusterCoordinator::rateRedistributed, this, [this](int agentsNb){
+        printLine(QString("Rate %1 %2 spread over %3 remaining agents")
+                  .arg(clusterCoordinator.getTargetRate())
+                  .arg(clusterCoordinator.getRateUnit() == FILES_PER_SEC ? "files/s" : "bytes/s")
+                  .arg(agentsNb));
+    });
+    connect(&clusterCoordinator, &ClusterCoordinator::finished, this, [this]{
+        printClusterSummary();
+        QCoreApplication::exit(m_exitCode);
+    });
+
+    trfGen.moveToThread(&trafficThread);
+    trafficThread.start();
+}
+
+ConsoleRunner::~ConsoleRunner() {
+    trfGen.stop();
+    trafficThread.quit();
+    trafficThread.wait();
+}
+
+bool ConsoleRunner::isRequested(int argc, char *argv[]) {
+    for(int i = 1; i < argc; i++) {
+        if(!qstrcmp(argv[i], "-c") || !qstrcmp(argv[i], "--headless"))
+            return true;
+    }
+    return false;
+}
+
+bool ConsoleRunner::parseArguments(const QStringList& arguments) {
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QString("Traffic Generator %1, headless mode").arg(VERSION));
+    parser.addHelpOption();
+
+    QCommandLineOption headlessOption(QStringList() << "c" << "headless",
+                                      "Run without GUI.");
+    QCommandLineOption cleanDirOption("clean-dir",
+                                      "Directory tree with clean template files, may be repeated.", "dir");
+    QCommandLineOption infectedDirOption("infected-dir",
+                                         "Directory tree with infected template files, may be repeated.", "dir");
+    QCommandLineOption cleanManifestOption("clean-manifest",
+                                           "File listing clean templates, one path per line with an optional "
+                                           "tab-separated weight.", "file");
+    QCommandLineOption infectedManifestOption("infected-manifest",
+                                              "File listing infected templates, same format as --clean-manifest.", "file");
+    QCommandLineOption extensionsOption("extensions",
+                                        "Comma-separated template file extensions to take, all by default.", "list");
+    QCommandLineOption minSizeOption("min-size",
+                                     "Skip templates smaller than this, K/M/G suffixes allowed.", "bytes");
+    QCommandLineOption maxSizeOption("max-size",
+                                     "Skip templates larger than this, K/M/G suffixes allowed.", "bytes");
+    QCommandLineOption indexDirOption("index-dir",
+                                      "Template index directory: saved after scanning the template sources, "
+                                      "loaded instead of scanning when none are given.", "dir");
+    QCommandLineOption destinationOption(QStringList() << "d" << "destination",
+                                         "Destination directory, may be repeated: files are spread over "
+                                         "the roots, each written by its own --threads workers.", "dir");
+    QCommandLineOption subdirsOption("subdirs",
+                                     "Spread files over this many hashed subdirectories of every destination, "
+                                     "0 writes into the destination directly.", "count", "0");
+    QCommandLineOption rateOption(QStringList() << "r" << "rate",
+                                  "Target rate in files/s, 0 for unlimited.", "files");
+    QCommandLineOption byteRateOption("byte-rate",
+                                      "Target rate in bytes/s, K/M/G suffixes allowed.", "bytes");
+    QCommandLineOption probabilityOption(QStringList() << "p" << "infected-probability",
+                                         "Probability of an infected file.", "probability",
+                                         QString::number(DEFAULT_INFECTED_FILE_PROBABILITY));
+    QCommandLineOption durationOption(QStringList() << "t" << "duration",
+                                      "Run duration in seconds, 0 to run until interrupted.", "secs", "0");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+                                     "Number of copy threads.", "count", QString::number(DEFAULT_THREADS_NB));
+    QCommandLineOption statsIntervalOption("stats-interval",
+                                           "Statistics print interval in seconds.", "secs",
+                                           QString::number(DEFAULT_STATS_INTERVAL));
+    QCommandLineOption syntheticOption("synthetic",
+                                       "Generate synthetic files instead of copying templates: fixed:<size>, "
+                                       "uniform:<min>:<max>, lognormal:<median>:<sigma> or histogram:<file>. "
+                                       "Infected templates are spliced into infected files as signatures.", "distribution");
+    QCommandLineOption mutateOption("mutate",
+                                    "Make every copied template unique so the scanner can't answer from its hash "
+                                    "cache: append[:<bytes>] adds a trailer, overwrite[:<bytes>] replaces the last "
+                                    "bytes, patch:<offset>[,<offset>...][:<bytes>] replaces bytes at offsets that "
+                                    "signatures don't cover (negative ones count from the end).", "mutation", "none");
+    QCommandLineOption containerOption("container",
+                                       "Write templates packed in containers instead of one by one: "
+                                       "<zip|tar|tgz>[:<members>[:<depth>[:<level>]]], the last member of every "
+                                       "level but the deepest being a nested container, level the deflate level.", "container", "none");
+    QCommandLineOption containerInfectedOption("container-infected",
+                                               "Share of infected members in containers, the infected probability by default.", "ratio");
+    QCommandLineOption seedOption("seed",
+                                  "Run seed: the same seed replays the same template picks, infection decisions, "
+                                  "sizes and synthetic contents, whatever the threads number. Random by default, "
+                                  "printed at start.", "number");
+    QCommandLineOption profileOption("profile",
+                                     "JSON workload profile: a sequence of phases with their own duration, rate, "
+                                     "ramp, infected probability and synthetic sizes. The run ends with the profile.", "file");
+    QCommandLineOption traceRecordOption("trace-record",
+                                         "Record every generated file to a trace: time, size, class and template.", "file");
+    QCommandLineOption traceReplayOption("trace-replay",
+                                         "Replay a trace instead of generating at a rate, streamed from disk. "
+                                         "Templates named in the trace are used when loaded, otherwise the "
+                                         "closest in size; synthetic files get the exact size.", "file");
+    QCommandLineOption traceSpeedupOption("trace-speedup",
+                                          "Replay speed-up factor.", "factor", "1");
+    QCommandLineOption traceImportOption("trace-import",
+                                         "Convert a capture log (tab or comma separated) into the --trace-replay file "
+                                         "before replaying it.", "log");
+    QCommandLineOption traceColumnsOption("trace-columns",
+                                          "Capture log columns in order: time (seconds or ISO 8601), size, class, "
+                                          "template or skip.", "list", "time,size,class");
+    QCommandLineOption cacheBudgetOption("cache-budget",
+                                         "Template cache budget in MB, 0 disables the cache.", "mb",
+                                         QString::number(DEFAULT_TEMPLATE_CACHE_BUDGET_MB));
+
+    QCommandLineOption ioBackendOption("io-backend",
+                                       "File I/O backend: sync or uring (io_uring, many files in flight per thread, "
+                                       "falls back to sync where unsupported).", "backend",
+                                       IoBackend::toString(SYNC_IO_BACKEND));
+    QCommandLineOption publishOption("publish",
+                                     "How files appear in the destination: direct (written under the final name), "
+                                     "rename (hidden temporary name renamed when complete) or tmpfile (O_TMPFILE "
+                                     "linked when complete).", "mode", OutputFile::toString(DIRECT_PUBLISH));
+    QCommandLineOption fsyncOption("fsync",
+                                   "Durability of written files: none, file (fsync each file before publishing) "
+                                   "or batch (sync the filesystem every --fsync-interval).", "policy",
+                                   OutputFile::toString(NO_FSYNC));
+    QCommandLineOption fsyncIntervalOption("fsync-interval",
+                                           "Batched sync interval in milliseconds.", "msecs",
+                                           QString::number(DEFAULT_FSYNC_INTERVAL));
+    QCommandLineOption writePolicyOption("write-policy",
+                                         "How data reaches the storage: none (page cache) or a comma-separated list of "
+                                         "prealloc (fallocate the known size first), direct (aligned O_DIRECT writes) "
+                                         "and evict (write back and drop each file from the page cache).", "policy", "none");
+    QCommandLineOption writeChunkOption("write-chunk",
+                                        "Size of every write call, K/M suffixes allowed, 0 writes whole buffers.", "bytes", "0");
+    QCommandLineOption scanTargetOption("scan-target",
+                                        "Send files to a scanner instead of writing them: icap://<host>[:<port>]/<service> "
+                                        "(RESPMOD) or http://<host>[:<port>]/<path> (PUT). Every thread keeps one "
+                                        "keep-alive connection.", "url");
+    QCommandLineOption pipelineOption("pipeline",
+                                      "Requests in flight on each scan target connection, more than 1 pipelines them.",
+                                      "depth", QString::number(DEFAULT_PIPELINE_DEPTH));
+    QCommandLineOption standInOption("stand-in",
+                                     "Run a local ICAP/HTTP scanner stand-in on 127.0.0.1:<port>, reporting files with "
+                                     "the EICAR test string or an infected template as infected.", "port");
+    QCommandLineOption maxBacklogOption("max-backlog",
+                                        "Backpressure: pause while this many files wait in the destination, "
+                                        "0 disables it.", "files", "0");
+    QCommandLineOption scanLatencyOption("scan-latency",
+                                         "Measure the time from a file's write until the scanner deletes or moves it.");
+    QCommandLineOption metricsPortOption("metrics-port",
+                                         "Serve Prometheus metrics on http://<address>:<port>/metrics.", "port");
+    QCommandLineOption metricsAddressOption("metrics-address",
+                                            "Address of the metrics endpoint.", "address", DEFAULT_METRICS_ADDRESS);
+    QCommandLineOption statsLogOption("stats-log",
+                                      "Append statistics to a time-series log, JSON lines for .jsonl files, "
+                                      "CSV otherwise.", "file");
+    QCommandLineOption statsLogIntervalOption("stats-log-interval",
+                                              "Statistics log interval in seconds.", "secs",
+                                              QString::number(DEFAULT_STATS_LOG_INTERVAL));
+    QCommandLineOption agentOption("agent",
+                                   "Run as an agent of a coordinated run: wait on this control port for the "
+                                   "coordinator, which sets the rate, starts and stops the run.", "port");
+    QCommandLineOption agentAddressOption("agent-address",
+                                          "Address of the agent control port.", "address", DEFAULT_AGENT_ADDRESS);
+    QCommandLineOption coordinateOption("coordinate",
+                                        "Coordinate agents instead of generating: <host>[:<port>], may be repeated or "
+                                        "comma-separated. The rate is split over the agents by their copy threads, they "
+                                        "start together for --duration and their statistics are added up.", "agents");
+    QCommandLineOption cpusOption("cpus",
+                                  "Pin the process to these CPUs, e.g. 0-3,8.", "list");
+    QCommandLineOption numaNodeOption("numa-node",
+                                      "Pin the process to the CPUs of this NUMA node, so its memory is allocated there.", "node");
+
+    parser.addOptions(QList<QCommandLineOption>() << headlessOption << cleanDirOption << infectedDirOption
+                                                  << cleanManifestOption << infectedManifestOption
+                                                  << extensionsOption << minSizeOption << maxSizeOption
+                                                  << indexDirOption
+                                                  << destinationOption << subdirsOption << rateOption << byteRateOption
+                                                  << probabilityOption << durationOption << threadsOption
+                                                  << statsIntervalOption << syntheticOption << mutateOption << seedOption << profileOption
+                                                  << containerOption << containerInfectedOption
+                                                  << traceRecordOption << traceReplayOption << traceSpeedupOption
+                                                  << traceImportOption << traceColumnsOption << cacheBudgetOption
+                                                  << ioBackendOption << publishOption << fsyncOption << fsyncIntervalOption
+                                                  << writePolicyOption << writeChunkOption
+                                                  << scanTargetOption << pipelineOption << standInOption
+                                                  << maxBacklogOption << scanLatencyOption
+                                                  << metricsPortOption << metricsAddressOption
+                                                  << statsLogOption << statsLogIntervalOption
+                                                  << agentOption << agentAddressOption << coordinateOption
+                                                  << cpusOption << numaNodeOption);
+    parser.process(arguments);
+
+    // a coordinator generates nothing itself, the generation options go to the agents
+    if(parser.isSet(coordinateOption)) {
+        QStringList coordinatorOptions = QStringList() << "c" << "headless" << "coordinate" << "r" << "rate" << "byte-rate"
+                                                       << "t" << "duration" << "seed" << "stats-interval";
+        foreach(const QString& name, parser.optionNames()) {
+            if(!coordinatorOptions.contains(name)) {
+                printError(QString("--%1 is an agent option, --coordinate only takes --rate, --byte-rate, --duration, "
+                                   "--seed and --stats-interval").arg(name));
+                return false;
+            }
+        }
+        foreach(const QString& agents, parser.values(coordinateOption)) {
+            foreach(const QString& address, agents.split(',', QString::SkipEmptyParts)) {
+                if(!clusterCoordinator.addAgent(address)) {
+                    printError(QString("Invalid agent address %1, expected <host>[:<port>] and up to %2 agents")
+                               .arg(address).arg(MAX_AGENTS_NB));
+                    return false;
+                }
+            }
+        }
+        if(!clusterCoordinator.getAgentsNb()) {
+            printError("No agents to coordinate");
+            return false;
+        }
+
+        bool ok = true;
+        if(parser.isSet(rateOption) && parser.isSet(byteRateOption)) {
+            printError("--rate and --byte-rate are mutually exclusive");
+            return false;
+        } else if(parser.isSet(byteRateOption)) {
+            clusterCoordinator.setTargetRate(parseSize(parser.value(byteRateOption), &ok), BYTES_PER_SEC);
+        } else if(parser.isSet(rateOption)) {
+            clusterCoordinator.setTargetRate(parser.value(rateOption).toDouble(&ok), FILES_PER_SEC);
+        }
+        if(!ok || clusterCoordinator.getTargetRate() < 0.) {
+            printError("Invalid rate");
+            return false;
+        }
+
+        if(parser.isSet(seedOption)) {
+            quint64 seed = parser.value(seedOption).toULongLong(&ok, 0);
+            if(!ok) {
+                printError("Invalid seed");
+                return false;
+            }
+            clusterCoordinator.setSeed(seed);
+        }
+
+        m_durationInSecs = parser.value(durationOption).toLongLong(&ok);
+        if(!ok || m_durationInSecs < 0) {
+            printError("Invalid duration");
+            return false;
+        }
+
+        int statsInterval = parser.value(statsIntervalOption).toInt(&ok);
+        if(!ok || statsInterval < 1) {
+            printError("Invalid statistics interval");
+            return false;
+        }
+        m_statsTimer.setInterval(statsInterval * 1000);
+
+        m_coordinating = true;
+        return true;
+    }
+
+    QStringList destinationDirs;
+    foreach(const QString& destinationDir, parser.values(destinationOption)) {
+        if(!QDir(destinationDir).exists()) {
+            printError(QString("Destination directory %1 doesn't exist").arg(destinationDir));
+            return false;
+        }
+        destinationDirs << QDir(destinationDir).absolutePath();
+    }
+    if(destinationDirs.isEmpty() && !parser.isSet(scanTargetOption)) {
+        printError("Destination directory is not set");
+        return false;
+    }
+    trfGen.setDestinationDirs(destinationDirs);
+
+    bool ok = true;
+    int subdirsNb = parser.value(subdirsOption).toInt(&ok);
+    if(!ok || subdirsNb < 0 || subdirsNb > MAX_SUBDIRS_NB) {
+        printError(QString("Invalid subdirectories number, expected 0..%1").arg(MAX_SUBDIRS_NB));
+        return false;
+    }
+    trfGen.setSubdirsNb(subdirsNb);
+
+    TemplateFilter templateFilter;
+    foreach(QString extension, parser.value(extensionsOption).split(',', QString::SkipEmptyParts)) {
+        extension = extension.trimmed();
+        if(extension.startsWith('.'))
+            extension.remove(0, 1);
+        templateFilter.extensions << extension;
+    }
+    if(parser.isSet(minSizeOption))
+        templateFilter.minSize = qint64(parseSize(parser.value(minSizeOption), &ok));
+    if(ok && parser.isSet(maxSizeOption))
+        templateFilter.maxSize = qint64(parseSize(parser.value(maxSizeOption), &ok));
+    if(!ok || templateFilter.minSize < 0 || templateFilter.maxSize < 0) {
+        printError("Invalid template size limit");
+        return false;
+    }
+    trfGen.setTemplateFilter(templateFilter);
+
+    bool templateSourcesSet = false;
+    foreach(FILE_TYPE type, QList<FILE_TYPE>() << CLEAN << INFECTED) {
+        const QCommandLineOption& dirOption = type == CLEAN ? cleanDirOption : infectedDirOption;
+        const QCommandLineOption& manifestOption = type == CLEAN ? cleanManifestOption : infectedManifestOption;
+
+        trfGen.addTemplateDirs(type, parser.values(dirOption));
+        foreach(const QString& manifestFile, parser.values(manifestOption)) {
+            if(trfGen.addTemplateManifest(type, manifestFile) < 0) {
+                printError(QString("Can't read template manifest %1").arg(manifestFile));
+                return false;
+            }
+        }
+        templateSourcesSet |= parser.isSet(dirOption) || parser.isSet(manifestOption);
+    }
+
+    if(parser.isSet(indexDirOption)) {
+        QString indexDir = parser.value(indexDirOption);
+        if(templateSourcesSet && !trfGen.saveTemplateIndex(indexDir)) {
+            printError(QString("Can't save the template index to %1").arg(indexDir));
+        } else if(!templateSourcesSet && !trfGen.loadTemplateIndex(indexDir)) {
+            printError(QString("Can't load the template index from %1").arg(indexDir));
+            return false;
+        }
+    }
+
+    if(parser.isSet(syntheticOption)) {
+        SizeDistribution sizeDistribution;
+        if(!sizeDistribution.parse(parser.value(syntheticOption))) {
+            printError("Invalid synthetic size distribution");
+            return false;
+        }
+        trfGen.setSizeDistribution(sizeDistribution);
+        trfGen.setPayloadSource(SYNTHETIC_PAYLOAD);
+    } else if(!trfGen.getCleanFiles().size() && !trfGen.getInfectedFiles().size()) {
+        printError("No template files found");
+        return false;
+    }
+
+    Mutator mutator;
+    if(!mutator.parse(parser.value(mutateOption))) {
+        printError(QString("Invalid mutation, expected none, append[:<bytes>], overwrite[:<bytes>] "
+                           "or patch:<offsets>[:<bytes>] with up to %1 offsets and %2 bytes")
+                   .arg(MAX_MUTATION_PATCHES_NB).arg(MAX_MUTATION_SIZE));
+        return false;
+    }
+    trfGen.setMutator(mutator);
+
+    ContainerBuilder containerBuilder;
+    if(!containerBuilder.parse(parser.value(containerOption))) {
+        printError(QString("Invalid container, expected none or <zip|tar|tgz>[:<members>[:<depth>[:<level>]]] "
+                           "with up to %1 members, a depth up to %2 and a level from 0 to 9")
+                   .arg(MAX_CONTAINER_MEMBERS_NB).arg(MAX_CONTAINER_DEPTH));
+        return false;
+    }
+    if(parser.isSet(containerInfectedOption)) {
+        double infectedRatio = parser.value(containerInfectedOption).toDouble(&ok);
+        if(!ok || infectedRatio < 0. || infectedRatio > 1.) {
+            printError("Invalid container infected ratio, expected a value from 0 to 1");
+            return false;
+        }
+        containerBuilder.setInfectedRatio(infectedRatio);
+    }
+    if(containerBuilder.isEnabled() && trfGen.getPayloadSource() == SYNTHETIC_PAYLOAD) {
+        printError("--container packs templates, it can't be used with --synthetic");
+        return false;
+    }
+    trfGen.setContainerBuilder(containerBuilder);
+
+    if(parser.isSet(rateOption) && parser.isSet(byteRateOption)) {
+        printError("--rate and --byte-rate are mutually exclusive");
+        return false;
+    } else if(parser.isSet(byteRateOption)) {
+        trfGen.setTargetRate(parseSize(parser.value(byteRateOption), &ok), BYTES_PER_SEC);
+    } else if(parser.isSet(rateOption)) {
+        trfGen.setTargetRate(parser.value(rateOption).toDouble(&ok), FILES_PER_SEC);
+    }
+    if(!ok || trfGen.getTargetRate() < 0.) {
+        printError("Invalid rate");
+        return false;
+    }
+
+    if(parser.isSet(seedOption)) {
+        quint64 seed = parser.value(seedOption).toULongLong(&ok, 0);
+        if(!ok) {
+            printError("Invalid seed");
+            return false;
+        }
+        trfGen.setSeed(seed);
+    }
+
+    if(parser.isSet(profileOption)) {
+        WorkloadProfile workloadProfile;
+        QString error;
+        if(!workloadProfile.load(parser.value(profileOption), &error)) {
+            printError(QString("Invalid workload profile: %1").arg(error));
+            return false;
+        }
+        trfGen.setWorkloadProfile(workloadProfile);
+    }
+
+    if(parser.isSet(traceImportOption) && !parser.isSet(traceReplayOption)) {
+        printError("--trace-import needs --trace-replay to name the trace file");
+        return false;
+    } else if(parser.isSet(traceImportOption)) {
+        QString error;
+        qint64 eventsNb = TraceReader::import(parser.value(traceImportOption), parser.value(traceReplayOption),
+                                              parser.value(traceColumnsOption).split(','), &error);
+        if(eventsNb < 0) {
+            printError(QString("Can't import the capture log: %1").arg(error));
+            return false;
+        }
+        printLine(QString("Imported %1 events into %2").arg(eventsNb).arg(parser.value(traceReplayOption)));
+    }
+
+    if(parser.isSet(traceReplayOption)) {
+        double speedup = parser.value(traceSpeedupOption).toDouble(&ok);
+        if(!ok || speedup <= 0.) {
+            printError("Invalid trace speed-up");
+            return false;
+        }
+        if(parser.isSet(profileOption)) {
+            printError("--trace-replay and --profile are mutually exclusive");
+            return false;
+        }
+        trfGen.setTraceReplay(parser.value(traceReplayOption), speedup);
+    }
+    trfGen.setTraceRecordFile(parser.value(traceRecordOption));
+
+    double probability = parser.value(probabilityOption).toDouble(&ok);
+    if(!ok || probability < 0. || probability > 1.) {
+        printError("Invalid infected file probability");
+        return false;
+    }
+    trfGen.setInfectedFileGenerateProbability(probability);
+
+    m_durationInSecs = parser.value(durationOption).toLongLong(&ok);
+    if(!ok || m_durationInSecs < 0) {
+        printError("Invalid duration");
+        return false;
+    }
+
+    int threadsNb = parser.value(threadsOption).toInt(&ok);
+    if(!ok || threadsNb < 1 || threadsNb > MAX_THREADS_NB) {
+        printError(QString("Invalid threads number, expected 1..%1").arg(MAX_THREADS_NB));
+        return false;
+    }
+    trfGen.setThreadsNb(threadsNb);
+
+    IO_BACKEND ioBackend;
+    if(!IoBackend::parse(parser.value(ioBackendOption), ioBackend)) {
+        printError("Invalid I/O backend, expected sync or uring");
+        return false;
+    }
+    trfGen.setIoBackend(ioBackend);
+    if(trfGen.getIoBackend() != ioBackend) {
+        printError(QString("I/O backend %1 is not supported here, using %2")
+                   .arg(IoBackend::toString(ioBackend))
+                   .arg(IoBackend::toString(trfGen.getIoBackend())));
+    }
+
+    PUBLISH_MODE publishMode;
+    if(!OutputFile::parse(parser.value(publishOption), publishMode)) {
+        printError("Invalid publish mode, expected direct, rename or tmpfile");
+        return false;
+    }
+    trfGen.setPublishMode(publishMode);
+
+    FSYNC_POLICY fsyncPolicy;
+    if(!OutputFile::parse(parser.value(fsyncOption), fsyncPolicy)) {
+        printError("Invalid fsync policy, expected none, file or batch");
+        return false;
+    }
+    int fsyncInterval = parser.value(fsyncIntervalOption).toInt(&ok);
+    if(!ok || fsyncInterval < 1) {
+        printError("Invalid fsync interval");
+        return false;
+    }
+    trfGen.setFsyncPolicy(fsyncPolicy, fsyncInterval);
+
+    WritePolicy writePolicy;
+    if(!writePolicy.parse(parser.value(writePolicyOption))) {
+        printError("Invalid write policy, expected none or a comma-separated list of prealloc, direct and evict");
+        return false;
+    }
+    double writeChunk = parseSize(parser.value(writeChunkOption), &ok);
+    if(!ok || writeChunk < 0. || writeChunk > MAX_WRITE_CHUNK_SIZE) {
+        printError(QString("Invalid write chunk size, expected up to %1 MB").arg(MAX_WRITE_CHUNK_SIZE / 1024 / 1024));
+        return false;
+    }
+    writePolicy.setChunkSize(qint64(writeChunk));
+    if(writePolicy.isEnabled() && !WritePolicy::isSupported()) {
+        printError("Write policies are not supported here");
+        return false;
+    }
+    trfGen.setWritePolicy(writePolicy);
+
+    ScanTarget scanTarget;
+    if(!scanTarget.parse(parser.value(scanTargetOption))) {
+        printError("Invalid scan target, expected icap://<host>[:<port>]/<service> or http://<host>[:<port>]/<path>");
+        return false;
+    }
+    int pipelineDepth = parser.value(pipelineOption).toInt(&ok);
+    if(!ok || pipelineDepth < 1 || pipelineDepth > MAX_PIPELINE_DEPTH) {
+        printError(QString("Invalid pipeline depth, expected 1..%1").arg(MAX_PIPELINE_DEPTH));
+        return false;
+    }
+    scanTarget.setPipelineDepth(pipelineDepth);
+    if(scanTarget.isEnabled() && !NetworkIoBackend::isSupported()) {
+        printError("Network delivery is not supported here");
+        return false;
+    }
+    if(scanTarget.isEnabled() && writePolicy.isEnabled()) {
+        printError("--write-policy and --write-chunk apply to written files, they can't be used with --scan-target");
+        return false;
+    }
+    if(scanTarget.isEnabled() && (parser.isSet(maxBacklogOption) || parser.isSet(scanLatencyOption))) {
+        printError("--max-backlog and --scan-latency watch the destination, they can't be used with --scan-target");
+        return false;
+    }
+    trfGen.setScanTarget(scanTarget);
+
+    // the stand-in knows the infected templates, so it can tell them from clean ones
+    if(parser.isSet(standInOption)) {
+        int port = parser.value(standInOption).toInt(&ok);
+        if(!ok || port < 0 || port > 65535) {
+            printError("Invalid stand-in port");
+            return false;
+        }
+        QStringList signatureFiles;
+        foreach(const TemplateEntry& entry, trfGen.getInfectedFiles().getEntries()) {
+            signatureFiles << entry.path;
+        }
+        scanServer.loadSignatures(signatureFiles);
+        if(!scanServer.listen(QHostAddress::LocalHost, quint16(port))) {
+            printError(QString("Can't listen on 127.0.0.1:%1").arg(port));
+            return false;
+        }
+    }
+
+    if(parser.isSet(agentOption)) {
+        if(parser.isSet(rateOption) || parser.isSet(byteRateOption) || parser.isSet(durationOption)) {
+            printError("The coordinator sets the rate and the duration, --rate, --byte-rate and --duration "
+                       "can't be used with --agent");
+            return false;
+        }
+        int port = parser.value(agentOption).toInt(&ok);
+        QHostAddress address;
+        if(!ok || port < 0 || port > 65535 || !address.setAddress(parser.value(agentAddressOption))) {
+            printError("Invalid agent control endpoint");
+            return false;
+        }
+        if(!clusterAgent.listen(address, quint16(port))) {
+            printError(QString("Can't listen on %1:%2").arg(address.toString()).arg(port));
+            return false;
+        }
+    }
+
+    int statsInterval = parser.value(statsIntervalOption).toInt(&ok);
+    if(!ok || statsInterval < 1) {
+        printError("Invalid statistics interval");
+        return false;
+    }
+    m_statsTimer.setInterval(statsInterval * 1000);
+
+    int cacheBudget = parser.value(cacheBudgetOption).toInt(&ok);
+    if(!ok || cacheBudget < 0) {
+        printError("Invalid template cache budget");
+        return false;
+    }
+    trfGen.setTemplateCacheBudgetInMb(cacheBudget);
+
+    qint64 maxBacklog = parser.value(maxBacklogOption).toLongLong(&ok);
+    if(!ok || maxBacklog < 0) {
+        printError("Invalid backlog limit");
+        return false;
+    }
+    trfGen.setMaxBacklog(maxBacklog);
+    trfGen.setScanLatencyTracking(parser.isSet(scanLatencyOption));
+
+    if(parser.isSet(metricsPortOption)) {
+        int port = parser.value(metricsPortOption).toInt(&ok);
+        QHostAddress address;
+        if(!ok || port < 0 || port > 65535 || !address.setAddress(parser.value(metricsAddressOption))) {
+            printError("Invalid metrics endpoint");
+            return false;
+        }
+        if(!statsExporter.listen(address, quint16(port))) {
+            printError(QString("Can't listen on %1:%2").arg(address.toString()).arg(port));
+            return false;
+        }
+    }
+
+    if(parser.isSet(statsLogOption)) {
+        int statsLogInterval = parser.value(statsLogIntervalOption).toInt(&ok);
+        if(!ok || statsLogInterval < 1) {
+            printError("Invalid statistics log interval");
+            return false;
+        }
+        if(!statsExporter.openLog(parser.value(statsLogOption), statsLogInterval)) {
+            printError(QString("Can't open statistics log %1").arg(parser.value(statsLogOption)));
+            return false;
+        }
+    }
+
+    // last, once the helper threads run; the copy workers started later inherit the affinity
+    if(parser.isSet(cpusOption) && parser.isSet(numaNodeOption)) {
+        printError("--cpus and --numa-node are mutually exclusive");
+        return false;
+    } else if(parser.isSet(cpusOption) && !m_affinity.parse(parser.value(cpusOption))) {
+        printError(QString("Invalid CPU list, expected e.g. 0-3,8 with CPUs below %1").arg(MAX_CPUS_NB));
+        return false;
+    } else if(parser.isSet(numaNodeOption)) {
+        int node = parser.value(numaNodeOption).toInt(&ok);
+        if(!ok || !m_affinity.parseNumaNode(node)) {
+            printError(QString("Unknown NUMA node %1").arg(parser.value(numaNodeOption)));
+            return false;
+        }
+    }
+    if(m_affinity.isEnabled() && (!CpuAffinity::isSupported() || !m_affinity.apply())) {
+        printError(QString("Can't pin the process to CPUs %1").arg(m_affinity.toString()));
+        return false;
+    }
+    clusterAgent.setAffinity(m_affinity);
+
+    return true;
+}
+
+void ConsoleRunner::start() {
+    std::signal(SIGINT, handleInterrupt);
+    std::signal(SIGTERM, handleInterrupt);
+    m_signalTimer.start();
+
+    if(m_coordinating) {
+        printLine(QString("Traffic Generator %1: coordinating %2 agents, rate %3 %4")
+                  .arg(VERSION)
+                  .arg(clusterCoordinator.getAgentsNb())
+                  .arg(clusterCoordinator.getTargetRate())
+                  .arg(clusterCoordinator.getRateUnit() == FILES_PER_SEC ? "files/s" : "bytes/s"));
+        clusterCoordinator.connectAgents();
+        return;
+    }
+
+    printLine(QString("Traffic Generator %1: %2 clean and %3 infected templates, %4 %5 threads, rate %6 -> %7")
+              .arg(VERSION)
+              .arg(trfGen.getCleanFiles().size())
+              .arg(trfGen.getInfectedFiles().size())
+              .arg(trfGen.getThreadsNb())
+              .arg(IoBackend::toString(trfGen.getIoBackend()))
+              .arg(clusterAgent.isListening() ? QString("set by the coordinator") :
+                   QString("%1 %2").arg(trfGen.getTargetRate()).arg(trfGen.getRateUnit() == FILES_PER_SEC ? "files/s" : "bytes/s"))
+              .arg(trfGen.getScanTarget().isEnabled() ? trfGen.getScanTarget().toString() : trfGen.getDestinationDirs().join(", ")));
+    if(statsExporter.getPort()) {
+        printLine(QString("Metrics: http://localhost:%1/metrics").arg(statsExporter.getPort()));
+    }
+    if(!trfGen.getWorkloadProfile().isEmpty()) {
+        printLine(QString("Workload profile \"%1\": %2 phases, %3")
+                  .arg(trfGen.getWorkloadProfile().getName())
+                  .arg(trfGen.getWorkloadProfile().getPhasesNb())
+                  .arg(trfGen.getWorkloadProfile().getRepeatsNb() ?
+                       QString("%1 s").arg(trfGen.getWorkloadProfile().getDurationInSecs()) : QString("repeated until stopped")));
+    }
+
+    if(trfGen.getMutator().isEnabled()) {
+        printLine(QString("Mutation: %1").arg(trfGen.getMutator().toString()));
+    }
+    if(trfGen.getContainerBuilder().isEnabled()) {
+        printLine(QString("Containers: %1").arg(trfGen.getContainerBuilder().toString()));
+    }
+    if(trfGen.getWritePolicy().isEnabled()) {
+        printLine(QString("Write policy: %1%2").arg(writePolicyName(trfGen.getWritePolicy()))
+                  .arg(trfGen.getIoBackend() == URING_IO_BACKEND ? ", files written synchronously by the uring workers" : ""));
+    }
+    if(trfGen.getScanTarget().isEnabled()) {
+        printLine(QString("Scan target: %1 connections, pipeline depth %2, up to %3 requests in flight")
+                  .arg(trfGen.getThreadsNb())
+                  .arg(trfGen.getScanTarget().getPipelineDepth())
+                  .arg(trfGen.getThreadsNb() * trfGen.getScanTarget().getPipelineDepth()));
+    }
+    if(scanServer.getPort()) {
+        printLine(QString("Stand-in scanner: icap://127.0.0.1:%1/ and http://127.0.0.1:%1/").arg(scanServer.getPort()));
+    }
+    if(m_affinity.isEnabled()) {
+        printLine(QString("CPUs: %1").arg(m_affinity.toString()));
+    }
+
+    if(clusterAgent.isListening()) {
+        printLine(QString("Agent: waiting for the coordinator on port %1").arg(clusterAgent.getPort()));
+        return;
+    }
+    run();
+}
+
+void ConsoleRunner::run() {
+    m_runTimer.start();
+    trfGen.start();
+    printLine(QString("Seed: %1").arg(trfGen.getSeed()));
+    m_statsTimer.start();
+
+    if(m_durationInSecs) {
+        QTimer::singleShot(int(m_durationInSecs * 1000), Qt::PreciseTimer, this, &ConsoleRunner::finish);
+    }
+}
+
+void ConsoleRunner::finish() {
+    // the coordinator's summary waits for the agents' final reports
+    if(m_coordinating) {
+        m_statsTimer.stop();
+        m_signalTimer.stop();
+        if(clusterCoordinator.isStarted()) {
+            clusterCoordinator.stop();
+        } else {
+            QCoreApplication::exit(m_exitCode);
+        }
+        return;
+    }
+
+    // an agent stopped before its start still reports, with nothing done
+    if(!m_runTimer.isValid()) {
+        if(clusterAgent.isListening()) {
+            clusterAgent.finish();
+            QCoreApplication::exit(m_exitCode);
+        }
+        return;
+    }
+
+    trfGen.stop();
+    m_statsTimer.stop();
+    m_signalTimer.stop();
+
+    printSummary();
+    m_runTimer.invalidate();
+    clusterAgent.finish();
+
+    QCoreApplication::exit(m_exitCode);
+}
+
+void ConsoleRunner::printStats() {
+    if(m_coordinating) {
+        printClusterStats();
+        return;
+    }
+
+    printLine(QString("[%1 s] files: %2 (infected %3, failed %4), volume: %5 MB, "
+                      "rate 1/10/60 s: %6/%7/%8 files/s %9/%10/%11 MB/s, "
+                      "latency p50/p99/p999: %12/%13/%14 ms")
+              .arg(trfGen.getWorkTimeInSecs(), 8, 'f', 1)
+              .arg(trfGen.getGlobalCnt())
+              .arg(trfGen.getInfectedFilesNb())
+              .arg(trfGen.getFailedFilesNb())
+              .arg(trfGen.getTotalVolInBytes() / 1024. / 1024., 0, 'f', 2)
+              .arg(trfGen.getFilesRate(1), 0, 'f', 1)
+              .arg(trfGen.getFilesRate(10), 0, 'f', 1)
+              .arg(trfGen.getFilesRate(60), 0, 'f', 1)
+              .arg(trfGen.getBytesRate(1) / 1024. / 1024., 0, 'f', 2)
+              .arg(trfGen.getBytesRate(10) / 1024. / 1024., 0, 'f', 2)
+              .arg(trfGen.getBytesRate(60) / 1024. / 1024., 0, 'f', 2)
+              .arg(trfGen.getCopyLatencyInNsecs(0.5) / 1e6, 0, 'f', 3)
+              .arg(trfGen.getCopyLatencyInNsecs(0.99) / 1e6, 0, 'f', 3)
+              .arg(trfGen.getCopyLatencyInNsecs(0.999) / 1e6, 0, 'f', 3));
+
+    // per-root lines only when there is more than one root to compare
+    int rootsNb = trfGen.getScanTarget().isEnabled() ? 1 : trfGen.getDestinationDirs().size();
+    for(int rootIdx = 0; rootsNb > 1 && rootIdx < rootsNb; rootIdx++) {
+        MetricsTotals totals = trfGen.getDestinationTotals(rootIdx);
+        printLine(QString("           %1: files %2 (failed %3), volume %4 MB, pending %5, latency p99 %6 ms")
+                  .arg(trfGen.getDestinationDirs().at(rootIdx))
+                  .arg(totals.filesCnt)
+                  .arg(totals.failedFilesCnt)
+                  .arg(totals.bytes / 1024. / 1024., 0, 'f', 2)
+                  .arg(trfGen.getDestinationPendingJobsNb(rootIdx))
+                  .arg(trfGen.getDestinationLatencyInNsecs(rootIdx, 0.99) / 1e6, 0, 'f', 3));
+    }
+
+    if(trfGen.getPublishMode() != DIRECT_PUBLISH || trfGen.getFsyncPolicy() != NO_FSYNC) {
+        printLine(QString("           publish %1: %2 files, average %3 us; fsync %4: %5 calls, average %6 ms")
+                  .arg(OutputFile::toString(trfGen.getPublishMode()))
+                  .arg(trfGen.getPublishesNb())
+                  .arg(trfGen.getPublishesNb() ? trfGen.getPublishTimeInSecs() * 1e6 / trfGen.getPublishesNb() : 0., 0, 'f', 1)
+                  .arg(OutputFile::toString(trfGen.getFsyncPolicy()))
+                  .arg(trfGen.getSyncsNb())
+                  .arg(trfGen.getSyncsNb() ? trfGen.getSyncTimeInSecs() * 1e3 / trfGen.getSyncsNb() : 0., 0, 'f', 3));
+    }
+
+    if(trfGen.getScanTarget().isEnabled()) {
+        printLine(QString("           verdicts: detected %1, missed %2, false %3")
+                  .arg(trfGen.getDetectionsNb())
+                  .arg(trfGen.getMissedDetectionsNb())
+                  .arg(trfGen.getFalseDetectionsNb()));
+    }
+
+    if(trfGen.getMaxBacklog()) {
+        printLine(QString("           backlog: %1/%2 files, throttled %3 s")
+                  .arg(trfGen.getBacklog())
+                  .arg(trfGen.getMaxBacklog())
+                  .arg(trfGen.getThrottledTimeInSecs(), 0, 'f', 1));
+    }
+
+    if(trfGen.isScanLatencyTracking()) {
+        printLine(QString("           scan latency p50/p99/p999: clean %1/%2/%3 ms (%4 files), "
+                          "infected %5/%6/%7 ms (%8 files), waiting %9")
+                  .arg(trfGen.getScanLatencyInNsecs(CLEAN, 0.5) / 1e6, 0, 'f', 1)
+                  .arg(trfGen.getScanLatencyInNsecs(CLEAN, 0.99) / 1e6, 0, 'f', 1)
+                  .arg(trfGen.getScanLatencyInNsecs(CLEAN, 0.999) / 1e6, 0, 'f', 1)
+                  .arg(trfGen.getScannedFilesNb(CLEAN))
+                  .arg(trfGen.getScanLatencyInNsecs(INFECTED, 0.5) / 1e6, 0, 'f', 1)
+                  .arg(trfGen.getScanLatencyInNsecs(INFECTED, 0.99) / 1e6, 0, 'f', 1)
+                  .arg(trfGen.getScanLatencyInNsecs(INFECTED, 0.999) / 1e6, 0, 'f', 1)
+                  .arg(trfGen.getScannedFilesNb(INFECTED))
+                  .arg(trfGen.getPendingScanFilesNb()));
+    }
+}
+
+void ConsoleRunner::printPhase(int phaseIdx) {
+    const WorkloadPhase& phase = trfGen.getWorkloadProfile().getPhase(phaseIdx);
+    QString rate = phase.rate < 0. ? QString("unchanged") :
+                   phase.isPause() ? QString("0 (paused)") :
+                   phase.rateUnit == FILES_PER_SEC ? QString("%1 files/s").arg(phase.rate) :
+                                                     QString("%1 MB/s").arg(phase.rate / 1024. / 1024., 0, 'f', 2);
+    printLine(QString("[%1 s] phase %2/%3 \"%4\": %5 s, rate %6%7")
+              .arg(trfGen.getWorkTimeInSecs(), 8, 'f', 1)
+              .arg(phaseIdx + 1)
+              .arg(trfGen.getWorkloadProfile().getPhasesNb())
+              .arg(phase.name)
+              .arg(phase.durationInSecs)
+              .arg(rate)
+              .arg(phase.isRamp() ? " (ramp)" : ""));
+}
+
+void ConsoleRunner::printSummary() {
+    double workTimeInSecs = qMax(m_runTimer.elapsed() / 1000., 0.001);
+
+    printLine(QString("Summary: %1 s, %2 files (infected %3, failed %4), %5 MB, average %6 files/s %7 MB/s")
+              .arg(workTimeInSecs, 0, 'f', 3)
+              .arg(trfGen.getGlobalCnt())
+              .arg(trfGen.getInfectedFilesNb())
+              .arg(trfGen.getFailedFilesNb())
+              .arg(trfGen.getTotalVolInBytes() / 1024. / 1024., 0, 'f', 2)
+              .arg(trfGen.getGlobalCnt() / workTimeInSecs, 0, 'f', 1)
+              .arg(trfGen.getTotalVolInBytes() / 1024. / 1024. / workTimeInSecs, 0, 'f', 2));
+
+    if(!trfGen.getTraceReplayFile().isEmpty()) {
+        printLine(QString("Replay: %1 events at %2x, late by %3 ms on average, %4 ms at most")
+                  .arg(trfGen.getReplayedEventsNb())
+                  .arg(trfGen.getTraceSpeedup())
+                  .arg(trfGen.getReplayLateInNsecs() / 1e6, 0, 'f', 3)
+                  .arg(trfGen.getReplayMaxLateInNsecs() / 1e6, 0, 'f', 3));
+    }
+
+    // the same run with another policy gives the figures to compare
+    if(trfGen.getWritePolicy().isEnabled()) {
+        printLine(QString("Write policy %1: %2 files/s %3 MB/s, latency p50/p99 %4/%5 ms")
+                  .arg(writePolicyName(trfGen.getWritePolicy()))
+                  .arg(trfGen.getGlobalCnt() / workTimeInSecs, 0, 'f', 1)
+                  .arg(trfGen.getTotalVolInBytes() / 1024. / 1024. / workTimeInSecs, 0, 'f', 2)
+                  .arg(trfGen.getCopyLatencyInNsecs(0.5) / 1e6, 0, 'f', 3)
+                  .arg(trfGen.getCopyLatencyInNsecs(0.99) / 1e6, 0, 'f', 3));
+    }
+
+    // worker time, so with several threads it can exceed the run time
+    if(trfGen.getFsyncPolicy() != NO_FSYNC) {
+        printLine(QString("Fsync: %1 calls, %2 s of worker time, %3 ms per file written")
+                  .arg(trfGen.getSyncsNb())
+                  .arg(trfGen.getSyncTimeInSecs(), 0, 'f', 3)
+                  .arg(trfGen.getGlobalCnt() ? trfGen.getSyncTimeInSecs() * 1e3 / trfGen.getGlobalCnt() : 0., 0, 'f', 3));
+    }
+
+    // a missed file is an infected one answered as clean, a false detection the other way round
+    if(trfGen.getScanTarget().isEnabled()) {
+        printLine(QString("Verdicts: %1 detected, %2 missed, %3 false detections, latency p50/p99/p999 %4/%5/%6 ms")
+                  .arg(trfGen.getDetectionsNb())
+                  .arg(trfGen.getMissedDetectionsNb())
+                  .arg(trfGen.getFalseDetectionsNb())
+                  .arg(trfGen.getCopyLatencyInNsecs(0.5) / 1e6, 0, 'f', 3)
+                  .arg(trfGen.getCopyLatencyInNsecs(0.99) / 1e6, 0, 'f', 3)
+                  .arg(trfGen.getCopyLatencyInNsecs(0.999) / 1e6, 0, 'f', 3));
+    }
+    if(scanServer.getPort()) {
+        printLine(QString("Stand-in scanner: %1 requests, %2 infected")
+                  .arg(scanServer.getRequestsNb())
+                  .arg(scanServer.getDetectionsNb()));
+    }
+
+    // while the backlog is pinned at the mark the generator runs at the scanner's pace
+    if(trfGen.getMaxBacklog()) {
+        printLine(QString("Backpressure: throttled %1% of the time, sustainable rate over the last 60 s: %2 files/s %3 MB/s")
+                  .arg(trfGen.getThrottledTimeInSecs() * 100. / workTimeInSecs, 0, 'f', 1)
+                  .arg(trfGen.getFilesRate(60), 0, 'f', 1)
+                  .arg(trfGen.getBytesRate(60) / 1024. / 1024., 0, 'f', 2));
+    }
+}
+
+void ConsoleRunner::printAgents() {
+    printLine(QString("Agents: %1 with %2 copy threads, %3")
+              .arg(clusterCoordinator.getAgentsNb())
+              .arg(clusterCoordinator.getTotalReport().threadsNb)
+              .arg(clusterCoordinator.getTargetRate() > 0. ? "rate split by copy threads" : "unlimited rate"));
+    for(int agentIdx = 0; agentIdx < clusterCoordinator.getAgentsNb(); agentIdx++) {
+        const AgentReport& report = clusterCoordinator.getReport(agentIdx);
+        printLine(QString("           %1 %2: %3 threads, CPUs %4 -> %5")
+                  .arg(clusterCoordinator.getAgentAddress(agentIdx))
+                  .arg(report.name)
+                  .arg(report.threadsNb)
+                  .arg(report.cpus)
+                  .arg(report.destination));
+    }
+}
+
+// the reports asked for now are printed at the next interval
+void ConsoleRunner::printClusterStats() {
+    AgentReport total = clusterCoordinator.getTotalReport();
+    int runningAgentsNb = 0;
+    for(int agentIdx = 0; agentIdx < clusterCoordinator.getAgentsNb(); agentIdx++) {
+        if(clusterCoordinator.getReport(agentIdx).running && !clusterCoordinator.isAgentLost(agentIdx))
+            runningAgentsNb++;
+    }
+
+    printLine(QString("[%1 s] agents running: %2/%3, files: %4 (infected %5, failed %6), volume: %7 MB, "
+                      "rate 1 s: %8 files/s %9 MB/s, latency p50/p99/p999: %10/%11/%12 ms")
+              .arg(m_runTimer.elapsed() / 1000., 8, 'f', 1)
+              .arg(runningAgentsNb)
+              .arg(clusterCoordinator.getAgentsNb())
+              .arg(total.filesCnt)
+              .arg(total.infectedFilesCnt)
+              .arg(total.failedFilesCnt)
+              .arg(total.bytes / 1024. / 1024., 0, 'f', 2)
+              .arg(total.filesRate, 0, 'f', 1)
+              .arg(total.bytesRate / 1024. / 1024., 0, 'f', 2)
+              .arg(Metrics::latencyPercentileInNsecs(total.latencyBuckets, 0.5) / 1e6, 0, 'f', 3)
+              .arg(Metrics::latencyPercentileInNsecs(total.latencyBuckets, 0.99) / 1e6, 0, 'f', 3)
+              .arg(Metrics::latencyPercentileInNsecs(total.latencyBuckets, 0.999) / 1e6, 0, 'f', 3));
+
+    clusterCoordinator.requestReports();
+}
+
+void ConsoleRunner::printClusterSummary() {
+    double workTimeInSecs = qMax(m_runTimer.isValid() ? m_runTimer.elapsed() / 1000. : 0., 0.001);
+    AgentReport total = clusterCoordinator.getTotalReport();
+
+    printLine(QString("Summary: %1 s, %2 agents, %3 files (infected %4, failed %5), %6 MB, average %7 files/s %8 MB/s, "
+                      "latency p50/p99/p999 %9/%10/%11 ms")
+              .arg(workTimeInSecs, 0, 'f', 3)
+              .arg(clusterCoordinator.getAgentsNb())
+              .arg(total.filesCnt)
+              .arg(total.infectedFilesCnt)
+              .arg(total.failedFilesCnt)
+              .arg(total.bytes / 1024. / 1024., 0, 'f', 2)
+              .arg(total.filesCnt / workTimeInSecs, 0, 'f', 1)
+              .arg(total.bytes / 1024. / 1024. / workTimeInSecs, 0, 'f', 2)
+              .arg(Metrics::latencyPercentileInNsecs(total.latencyBuckets, 0.5) / 1e6, 0, 'f', 3)
+              .arg(Metrics::latencyPercentileInNsecs(total.latencyBuckets, 0.99) / 1e6, 0, 'f', 3)
+              .arg(Metrics::latencyPercentileInNsecs(total.latencyBuckets, 0.999) / 1e6, 0, 'f', 3));
+
+    // a lost agent is counted up to its last report
+    for(int agentIdx = 0; agentIdx < clusterCoordinator.getAgentsNb(); agentIdx++) {
+        const AgentReport& report = clusterCoordinator.getReport(agentIdx);
+        double agentTimeInSecs = qMax(report.workTimeInSecs, 0.001);
+        QString targetRate = report.targetRate <= 0. ? QString("unlimited") :
+                             QString("%1 %2").arg(report.targetRate)
+                                             .arg(clusterCoordinator.getRateUnit() == FILES_PER_SEC ? "files/s" : "bytes/s");
+        printLine(QString("           %1 %2: %3 files (failed %4), %5 MB, average %6 files/s %7 MB/s, "
+                          "target %8, seed %9%10")
+                  .arg(clusterCoordinator.getAgentAddress(agentIdx))
+                  .arg(report.name)
+                  .arg(report.filesCnt)
+                  .arg(report.failedFilesCnt)
+                  .arg(report.bytes / 1024. / 1024., 0, 'f', 2)
+                  .arg(report.filesCnt / agentTimeInSecs, 0, 'f', 1)
+                  .arg(report.bytes / 1024. / 1024. / agentTimeInSecs, 0, 'f', 2)
+                  .arg(targetRate)
+                  .arg(report.seed)
+                  .arg(clusterCoordinator.isAgentLost(agentIdx) ? ", lost" : ""));
+    }
+}
+
+void ConsoleRunner::checkSignals() {
+    if(interruptRequested) {
+        finish();
+    }
+}
+
+void ConsoleRunner::executeError(int code) {
+    switch(code) {
+        case -1:
+            printError("No template files selected");
+            break;
+        case -2:
+            printError("Can't watch the destination directory for backpressure");
+            break;
+        case -3:
+            printError("Can't open the trace file for recording");
+            break;
+        case -4:
+            printError("Can't open the trace file for replay");
+            break;
+        case -5:
+            printError("Can't create the destination subdirectories");
+            break;
+        default:
+            printError(QString("Generation error %1").arg(code));
+            break;
+    }
+    m_exitCode = 2;
+    // may be raised from start() before the event loop runs
+    QMetaObject::invokeMethod(this, [this]() { finish(); }, Qt::QueuedConnection);
+}
+
+// a run doesn't start short of an agent, the others' shares would be off
+void ConsoleRunner::agentFailed(int agentIdx, const QString& reason) {
+    printError(QString("Agent %1 failed: %2").arg(clusterCoordinator.getAgentAddress(agentIdx)).arg(reason));
+    m_exitCode = 2;
+    if(!clusterCoordinator.isStarted())
+        QCoreApplication::exit(m_exitCode);
+}
@@ -0,0 +1,61 @@
+#ifndef CONSOLERUNNER_H
+#define CONSOLERUNNER_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QStringList>
+#include <QElapsedTimer>
+
+#include "trafficgenerator.h"
+#include "statsexporter.h"
+#include "scanserver.h"
+#include "cluster.h"
+
+#define     DEFAULT_STATS_INTERVAL      1
+#define     SIGNAL_POLL_INTERVAL        200
+
+// headless mode: drives TrafficGenerator from the command line without any widgets
+class ConsoleRunner : public QObject {
+
+    Q_OBJECT
+
+    TrafficGenerator trfGen;
+    QThread trafficThread;
+    StatsExporter statsExporter{&trfGen};
+    ScanServer scanServer;
+    ClusterAgent clusterAgent{&trfGen};
+    ClusterCoordinator clusterCoordinator;
+
+    QTimer m_statsTimer;
+    QTimer m_signalTimer;
+    QElapsedTimer m_runTimer;
+    qint64 m_durationInSecs{0};
+    CpuAffinity m_affinity;
+    bool m_coordinating{false};
+
+    int m_exitCode{0};
+
+public:
+    ConsoleRunner();
+    ~ConsoleRunner();
+
+    static bool isRequested(int argc, char *argv[]);
+
+    bool parseArguments(const QStringList& arguments);
+    void start();
+    void run();
+    void finish();
+
+    void printStats();
+    void printPhase(int phaseIdx);
+    void printSummary();
+    void printAgents();
+    void printClusterStats();
+    void printClusterSummary();
+    void checkSignals();
+    void executeError(int code);
+    void agentFailed(int agentIdx, const QString& reason);
+};
+
+#endif // CONSOLERUNNER_H
@@ -0,0 +1,324 @@
+#include "containerbuilder.h"
+
+#include <QStringList>
+#include <QtEndian>
+
+#include <cstdio>
+#include <cstring>
+
+static void appendLe16(QByteArray& out, quint16 value) {
+    uchar bytes[2];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char*>(bytes), 2);
+}
+
+static void appendLe32(QByteArray& out, quint32 value) {
+    uchar bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char*>(bytes), 4);
+}
+
+// qCompress gives a 4-byte length and a zlib stream, zip and gzip want the
+// raw deflate data between its 2-byte header and 4-byte checksum
+static QByteArray deflate(const uchar* data, qint64 size, int level) {
+    if(size > MAX_CONTAINER_SIZE)
+        return QByteArray();
+    QByteArray compressed = qCompress(data, int(size), level);
+    return compressed.size() > 10 ? compressed.mid(6, compressed.size() - 10) : QByteArray();
+}
+
+class ArchiveWriter {
+
+public:
+    virtual ~ArchiveWriter() {}
+
+    virtual bool add(const QString& name, const uchar* data, qint64 size) = 0;
+    virtual bool finish() = 0;
+};
+
+// every entry has a fixed 1980-01-01 timestamp, so the same members give the same bytes
+class ZipWriter : public ArchiveWriter {
+
+    QByteArray& m_out;
+    int m_compressionLevel;
+    QByteArray m_centralDirectory;
+    int m_entriesNb{0};
+
+public:
+    ZipWriter(QByteArray& out, int compressionLevel): m_out(out), m_compressionLevel(compressionLevel) {
+    }
+
+    bool add(const QString& name, const uchar* data, qint64 size) override {
+        QByteArray encodedName = name.toUtf8();
+        QByteArray compressed;
+        if(m_compressionLevel > 0)
+            compressed = deflate(data, size, m_compressionLevel);
+        bool deflated = !compressed.isEmpty() && compressed.size() < size;
+        qint64 storedSize = deflated ? compressed.size() : size;
+
+        qint64 offset = m_out.size();
+        if(offset + 30 + encodedName.size() + storedSize + m_centralDirectory.size() > MAX_CONTAINER_SIZE)
+            return false;
+        quint32 crc = ContainerBuilder::crc32(data, size);
+
+        appendLe32(m_out, 0x04034b50);
+        appendLe16(m_out, 20);
+        appendLe16(m_out, 0x0800);
+        appendLe16(m_out, deflated ? 8 : 0);
+        appendLe16(m_out, 0);
+        appendLe16(m_out, 0x21);
+        appendLe32(m_out, crc);
+        appendLe32(m_out, quint32(storedSize));
+        appendLe32(m_out, quint32(size));
+        appendLe16(m_out, quint16(encodedName.size()));
+        appendLe16(m_out, 0);
+        m_out += encodedName;
+        m_out.append(deflated ? compressed.constData() : reinterpret_cast<const char*>(data), int(storedSize));
+
+        appendLe32(m_centralDirectory, 0x02014b50);
+        appendLe16(m_centralDirectory, (3 << 8) | 20);
+        appendLe16(m_centralDirectory, 20);
+        appendLe16(m_centralDirectory, 0x0800);
+        appendLe16(m_centralDirectory, deflated ? 8 : 0);
+        appendLe16(m_centralDirectory, 0);
+        appendLe16(m_centralDirectory, 0x21);
+        appendLe32(m_centralDirectory, crc);
+        appendLe32(m_centralDirectory, quint32(storedSize));
+        appendLe32(m_centralDirectory, quint32(size));
+        appendLe16(m_centralDirectory, quint16(encodedName.size()));
+        appendLe16(m_centralDirectory, 0);
+        appendLe16(m_centralDirectory, 0);
+        appendLe16(m_centralDirectory, 0);
+        appendLe16(m_centralDirectory, 0);
+        appendLe32(m_centralDirectory, 0100644u << 16);
+        appendLe32(m_centralDirectory, quint32(offset));
+        m_centralDirectory += encodedName;
+        m_entriesNb++;
+        return true;
+    }
+
+    bool finish() override {
+        qint64 centralDirectoryOffset = m_out.size();
+        m_out += m_centralDirectory;
+
+        appendLe32(m_out, 0x06054b50);
+        appendLe16(m_out, 0);
+        appendLe16(m_out, 0);
+        appendLe16(m_out, quint16(m_entriesNb));
+        appendLe16(m_out, quint16(m_entriesNb));
+        appendLe32(m_out, quint32(m_centralDirectory.size()));
+        appendLe32(m_out, quint32(centralDirectoryOffset));
+        appendLe16(m_out, 0);
+        return true;
+    }
+};
+
+// ustar, names are cut to 99 bytes
+class TarWriter : public ArchiveWriter {
+
+    QByteArray& m_out;
+
+    static void writeOctal(char* field, int width, qint64 value) {
+        std::snprintf(field, size_t(width), "%0*llo", width - 1, static_cast<unsigned long long>(value));
+    }
+
+public:
+    explicit TarWriter(QByteArray& out): m_out(out) {
+    }
+
+    bool add(const QString& name, const uchar* data, qint64 size) override {
+        int paddingSize = int((TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE);
+        if(m_out.size() + TAR_BLOCK_SIZE + size + paddingSize + 2 * TAR_BLOCK_SIZE > MAX_CONTAINER_SIZE)
+            return false;
+
+        char header[TAR_BLOCK_SIZE];
+        std::memset(header, 0, sizeof(header));
+        QByteArray encodedName = name.toUtf8().left(99);
+        std::memcpy(header, encodedName.constData(), size_t(encodedName.size()));
+        writeOctal(header + 100, 8, 0644);
+        writeOctal(header + 108, 8, 0);
+        writeOctal(header + 116, 8, 0);
+        writeOctal(header + 124, 12, size);
+        writeOctal(header + 136, 12, 0);
+        header[156] = '0';
+        std::memcpy(header + 257, "ustar", 6);
+        std::memcpy(header + 263, "00", 2);
+
+        // the checksum is computed with its own field filled with spaces
+        std::memset(header + 148, ' ', 8);
+        unsigned checksum = 0;
+        for(int i = 0; i < TAR_BLOCK_SIZE; i++) {
+            checksum += uchar(header[i]);
+        }
+        writeOctal(header + 148, 7, checksum);
+
+        m_out.append(header, TAR_BLOCK_SIZE);
+        m_out.append(reinterpret_cast<const char*>(data), int(size));
+        m_out.append(paddingSize, '\0');
+        return true;
+    }
+
+    bool finish() override {
+        m_out.append(2 * TAR_BLOCK_SIZE, '\0');
+        return true;
+    }
+};
+
+static bool gzip(const QByteArray& data, int level, QByteArray& out) {
+    QByteArray compressed = deflate(reinterpret_cast<const uchar*>(data.constData()), data.size(), level);
+    if(compressed.isEmpty() || compressed.size() + 18LL > MAX_CONTAINER_SIZE)
+        return false;
+
+    out.reserve(compressed.size() + 18);
+    out.append("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10);
+    out += compressed;
+    appendLe32(out, ContainerBuilder::crc32(reinterpret_cast<const uchar*>(data.constData()), data.size()));
+    appendLe32(out, quint32(data.size()));
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------
+
+ContainerBuilder::ContainerBuilder() {
+}
+
+bool ContainerBuilder::parse(const QString& spec) {
+    QStringList parts = spec.trimmed().toLower().split(':');
+    QString format = parts.value(0);
+
+    CONTAINER_FORMAT parsedFormat;
+    if(format == "none" || format.isEmpty()) {
+        parsedFormat = NO_CONTAINER;
+    } else if(format == "zip") {
+        parsedFormat = ZIP_CONTAINER;
+    } else if(format == "tar") {
+        parsedFormat = TAR_CONTAINER;
+    } else if(format == "tgz" || format == "tar.gz") {
+        parsedFormat = TGZ_CONTAINER;
+    } else {
+        return false;
+    }
+
+    bool membersOk = true, depthOk = true, levelOk = true;
+    int membersNb = parts.size() > 1 ? parts.at(1).toInt(&membersOk) : DEFAULT_CONTAINER_MEMBERS_NB;
+    int depth = parts.size() > 2 ? parts.at(2).toInt(&depthOk) : 1;
+    int compressionLevel = parts.size() > 3 ? parts.at(3).toInt(&levelOk) : DEFAULT_COMPRESSION_LEVEL;
+    if(parts.size() > 4 || !membersOk || !depthOk || !levelOk ||
+       membersNb < 1 || membersNb > MAX_CONTAINER_MEMBERS_NB ||
+       depth < 1 || depth > MAX_CONTAINER_DEPTH ||
+       compressionLevel < 0 || compressionLevel > 9)
+        return false;
+
+    m_format = parsedFormat;
+    m_membersNb = membersNb;
+    m_depth = depth;
+    m_compressionLevel = compressionLevel;
+    return true;
+}
+
+QString ContainerBuilder::toString() const {
+    return m_format == NO_CONTAINER ? QString("none") :
+           QString("%1:%2:%3:%4").arg(getExtension()).arg(m_membersNb).arg(m_depth).arg(m_compressionLevel);
+}
+
+bool ContainerBuilder::isEnabled() const {
+    return m_format != NO_CONTAINER;
+}
+
+CONTAINER_FORMAT ContainerBuilder::getFormat() const {
+    return m_format;
+}
+
+int ContainerBuilder::getMembersNb() const {
+    return m_membersNb;
+}
+
+int ContainerBuilder::getDepth() const {
+    return m_depth;
+}
+
+int ContainerBuilder::getCompressionLevel() const {
+    return m_compressionLevel;
+}
+
+QString ContainerBuilder::getExtension() const {
+    switch(m_format) {
+        case ZIP_CONTAINER:
+            return "zip";
+        case TAR_CONTAINER:
+            return "tar";
+        case TGZ_CONTAINER:
+            return "tgz";
+        default:
+            return QString();
+    }
+}
+
+void ContainerBuilder::setInfectedRatio(double infectedRatio) {
+    m_infectedRatio = qMin(infectedRatio, 1.);
+}
+
+double ContainerBuilder::getInfectedRatio() const {
+    return m_infectedRatio;
+}
+
+bool ContainerBuilder::build(const QVector<ContainerMember>& members, const TemplateLoader& loader, QByteArray& container) const {
+    container.clear();
+    return isEnabled() && buildLevel(members, 0, -1, loader, container) == members.size();
+}
+
+// returns the index of the first member after the level, -1 on failure.
+// A negative membersNb takes the members up to the end of the list.
+int ContainerBuilder::buildLevel(const QVector<ContainerMember>& members, int idx, int membersNb,
+                                 const TemplateLoader& loader, QByteArray& container) const {
+    QByteArray tar;
+    QByteArray& out = m_format == TGZ_CONTAINER ? tar : container;
+    ZipWriter zipWriter(out, m_compressionLevel);
+    TarWriter tarWriter(out);
+    ArchiveWriter& writer = m_format == ZIP_CONTAINER ? static_cast<ArchiveWriter&>(zipWriter) : tarWriter;
+
+    for(int i = 0; membersNb < 0 ? idx < members.size() : i < membersNb; i++) {
+        if(idx >= members.size())
+            return -1;
+
+        const ContainerMember& member = members.at(idx++);
+        bool added;
+        if(member.sourcePath.isEmpty()) {
+            QByteArray nested;
+            idx = buildLevel(members, idx, member.membersNb, loader, nested);
+            added = idx >= 0 && writer.add(member.name, reinterpret_cast<const uchar*>(nested.constData()), nested.size());
+        } else {
+            const uchar* data;
+            qint64 size;
+            added = loader(member.sourcePath, data, size) && writer.add(member.name, data, size);
+        }
+        if(!added)
+            return -1;
+    }
+
+    if(!writer.finish() || (m_format == TGZ_CONTAINER && !gzip(tar, m_compressionLevel, container)))
+        return -1;
+    return idx;
+}
+
+// reflected CRC-32 as used by zip and gzip
+quint32 ContainerBuilder::crc32(const uchar* data, qint64 size, quint32 crc) {
+    static const QVector<quint32> table = [] {
+        QVector<quint32> table(256);
+        for(quint32 i = 0; i < 256; i++) {
+            quint32 value = i;
+            for(int bit = 0; bit < 8; bit++) {
+                value = value & 1 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            table[int(i)] = value;
+        }
+        return table;
+    }();
+
+    const quint32* entries = table.constData();
+    crc = ~crc;
+    for(qint64 i = 0; i < size; i++) {
+        crc = entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
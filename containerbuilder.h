@@ -0,0 +1,73 @@
+#ifndef CONTAINERBUILDER_H
+#define CONTAINERBUILDER_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+
+#include <functional>
+
+#define     DEFAULT_CONTAINER_MEMBERS_NB    8
+#define     MAX_CONTAINER_MEMBERS_NB        1024
+#define     MAX_CONTAINER_DEPTH             8
+#define     DEFAULT_COMPRESSION_LEVEL       6
+#define     MAX_CONTAINER_SIZE              (2047LL * 1024 * 1024)
+#define     TAR_BLOCK_SIZE                  512
+
+enum CONTAINER_FORMAT {
+    NO_CONTAINER,
+    ZIP_CONTAINER,
+    TAR_CONTAINER,
+    TGZ_CONTAINER
+};
+
+// a file inside a container, listed depth first. A nested container has no
+// source, the next membersNb entries (nested ones counting as one) are its content.
+struct ContainerMember {
+    QString sourcePath;
+    QString name;
+    int membersNb{0};
+};
+
+// gives the bytes of a template, they have to stay valid until the next call
+typedef std::function<bool(const QString& path, const uchar*& data, qint64& size)> TemplateLoader;
+
+// <format>[:<members>[:<depth>[:<level>]]]: zip, tar or tgz containers of
+// <members> templates, the last member of every level but the deepest being
+// the next nested container of the same format. Level is the deflate level of
+// zip members and of the whole tgz, 0 stores. Containers are built in memory,
+// so each one stays under the 2 GB a QByteArray holds.
+class ContainerBuilder {
+
+    CONTAINER_FORMAT m_format{NO_CONTAINER};
+    int m_membersNb{DEFAULT_CONTAINER_MEMBERS_NB};
+    int m_depth{1};
+    int m_compressionLevel{DEFAULT_COMPRESSION_LEVEL};
+    double m_infectedRatio{-1.};
+
+    int buildLevel(const QVector<ContainerMember>& members, int idx, int membersNb,
+                   const TemplateLoader& loader, QByteArray& container) const;
+
+public:
+    ContainerBuilder();
+
+    bool parse(const QString& spec);
+    QString toString() const;
+    bool isEnabled() const;
+
+    CONTAINER_FORMAT getFormat() const;
+    int getMembersNb() const;
+    int getDepth() const;
+    int getCompressionLevel() const;
+    QString getExtension() const;
+
+    // share of infected members, negative follows the infected file probability
+    void setInfectedRatio(double infectedRatio);
+    double getInfectedRatio() const;
+
+    bool build(const QVector<ContainerMember>& members, const TemplateLoader& loader, QByteArray& container) const;
+
+    static quint32 crc32(const uchar* data, qint64 size, quint32 crc = 0);
+};
+
+#endif // CONTAINERBUILDER_H
@@ -0,0 +1,514 @@
+#include "copyengine.h"
+#include "networkbackend.h"
+
+#include <QFile>
+#include <QMutexLocker>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <sys/uio.h>
+#endif
+
+static bool writeSynthetic(const CopyJob& job, OutputFile& file, QByteArray& buffer) {
+    if(buffer.size() < PAYLOAD_CHUNK_SIZE)
+        buffer.resize(PAYLOAD_CHUNK_SIZE);
+    uchar* chunk = reinterpret_cast<uchar*>(buffer.data());
+
+    PayloadFiller filler(job.payloadSeed);
+    for(qint64 offset = 0; offset < job.size; offset += PAYLOAD_CHUNK_SIZE) {
+        qint64 chunkSize = qMin(qint64(PAYLOAD_CHUNK_SIZE), job.size - offset);
+        PayloadGenerator::writeChunk(chunk, offset, chunkSize, filler, job.signature, job.signatureOffset);
+        if(!file.write(buffer.constData(), chunkSize))
+            return false;
+    }
+    return true;
+}
+
+// the template runs come straight from the cache mapping, with the patches
+// around them it's a single writev per file. Direct and chunked writes go
+// segment by segment through the file, which aligns or splits them.
+static bool writeMutation(OutputFile& file, const Mutation& mutation) {
+    qint64 offset = 0;
+    while(offset < mutation.getSize()) {
+#ifdef Q_OS_LINUX
+        if(!file.isDirect() && !file.getChunkSize()) {
+            struct iovec segments[2 * MAX_MUTATION_PATCHES_NB + 1];
+            int segmentsNb = 0;
+            for(qint64 segmentOffset = offset; segmentOffset < mutation.getSize() && segmentsNb < 2 * MAX_MUTATION_PATCHES_NB + 1; segmentsNb++) {
+                const uchar* data;
+                qint64 length = mutation.segment(segmentOffset, data);
+                segments[segmentsNb].iov_base = const_cast<uchar*>(data);
+                segments[segmentsNb].iov_len = size_t(length);
+                segmentOffset += length;
+            }
+            ssize_t written = ::writev(file.handle(), segments, segmentsNb);
+            if(written <= 0)
+                return false;
+            offset += written;
+            continue;
+        }
+#endif
+        const uchar* data;
+        qint64 length = mutation.segment(offset, data);
+        if(!file.write(reinterpret_cast<const char*>(data), length))
+            return false;
+        offset += length;
+    }
+    return true;
+}
+
+// a template copied by other means gets its patches written over it, for a
+// reflinked one only the patched blocks are unshared
+static bool patchFile(OutputFile& file, const Mutator& mutator, quint64 seed) {
+    Mutation mutation;
+    mutator.mutate(seed, nullptr, file.size(), mutation);
+    for(int i = 0; i < mutation.getPatchesNb(); i++) {
+        const MutationPatch& patch = mutation.getPatch(i);
+        if(!file.writeAt(patch.offset, reinterpret_cast<const char*>(mutation.getPatchBytes(i)), patch.size))
+            return false;
+    }
+    return true;
+}
+
+static bool copyFile(const QString& sourcePath, OutputFile& file, QByteArray& buffer) {
+    QFile source(sourcePath);
+    if(!source.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        return false;
+
+    if(buffer.size() < PAYLOAD_CHUNK_SIZE)
+        buffer.resize(PAYLOAD_CHUNK_SIZE);
+    forever {
+        qint64 readSize = source.read(buffer.data(), buffer.size());
+        if(readSize <= 0)
+            return readSize == 0;
+        if(!file.write(buffer.constData(), readSize))
+            return false;
+    }
+}
+
+// reflink when the filesystem supports it, otherwise an in-kernel copy,
+// so large templates never pass through user space
+static bool cloneFile(const QString& sourcePath, OutputFile& file) {
+#ifdef Q_OS_LINUX
+    int srcFd = ::open(QFile::encodeName(sourcePath).constData(), O_RDONLY | O_CLOEXEC);
+    if(srcFd < 0)
+        return false;
+
+    int dstFd = file.handle();
+    bool cloned = false;
+#ifdef FICLONE
+    cloned = ::ioctl(dstFd, FICLONE, srcFd) == 0;
+#endif
+    if(!cloned) {
+        struct stat srcStat;
+        cloned = ::fstat(srcFd, &srcStat) == 0;
+
+        off_t left = cloned ? srcStat.st_size : 0;
+        while(left > 0) {
+            ssize_t copied = ::copy_file_range(srcFd, nullptr, dstFd, nullptr, size_t(left), 0);
+            if(copied <= 0) {
+                cloned = false;
+                break;
+            }
+            left -= copied;
+        }
+    }
+
+    ::close(srcFd);
+    return cloned;
+#else
+    Q_UNUSED(sourcePath);
+    Q_UNUSED(file);
+    return false;
+#endif
+}
+
+CopyWorker::CopyWorker(IoBackend* backend): m_backend(backend) {
+}
+
+CopyWorker::~CopyWorker() {
+    delete m_backend;
+}
+
+void CopyWorker::run() {
+    m_backend->run();
+}
+
+// -----------------------------------------------------------------------------------------
+
+CopyEngine::CopyEngine() {
+}
+
+CopyEngine::~CopyEngine() {
+    stop();
+    qDeleteAll(m_roots);
+}
+
+void CopyEngine::setThreadsNb(int threadsNb) {
+    m_threadsNb = qBound(1, threadsNb, MAX_THREADS_NB);
+}
+
+int CopyEngine::getThreadsNb() const {
+    return m_threadsNb;
+}
+
+// takes effect on the next start(), every root gets threadsNb workers
+void CopyEngine::setRootsNb(int rootsNb) {
+    m_rootsNb = qMax(1, rootsNb);
+}
+
+int CopyEngine::getRootsNb() const {
+    return m_rootsNb;
+}
+
+// io_uring falls back to the sync backend where the kernel doesn't support it
+void CopyEngine::setIoBackend(IO_BACKEND ioBackend) {
+    m_ioBackend = IoBackend::isSupported(ioBackend) ? ioBackend : SYNC_IO_BACKEND;
+}
+
+IO_BACKEND CopyEngine::getIoBackend() const {
+    return m_ioBackend;
+}
+
+void CopyEngine::setPublishMode(PUBLISH_MODE publishMode) {
+    m_publishMode = publishMode;
+}
+
+PUBLISH_MODE CopyEngine::getPublishMode() const {
+    return m_publishMode;
+}
+
+// batched syncs flush each root's filesystem at most once per interval
+void CopyEngine::setFsyncPolicy(FSYNC_POLICY fsyncPolicy, int intervalInMsecs) {
+    m_fsyncPolicy = fsyncPolicy;
+    m_fsyncIntervalInMsecs = qMax(1, intervalInMsecs);
+}
+
+FSYNC_POLICY CopyEngine::getFsyncPolicy() const {
+    return m_fsyncPolicy;
+}
+
+int CopyEngine::getFsyncIntervalInMsecs() const {
+    return m_fsyncIntervalInMsecs;
+}
+
+void CopyEngine::setWritePolicy(const WritePolicy& writePolicy) {
+    m_writePolicy = writePolicy;
+}
+
+const WritePolicy& CopyEngine::getWritePolicy() const {
+    return m_writePolicy;
+}
+
+void CopyEngine::setMutator(const Mutator& mutator) {
+    m_mutator = mutator;
+}
+
+const Mutator& CopyEngine::getMutator() const {
+    return m_mutator;
+}
+
+void CopyEngine::setContainerBuilder(const ContainerBuilder& containerBuilder) {
+    m_containerBuilder = containerBuilder;
+}
+
+const ContainerBuilder& CopyEngine::getContainerBuilder() const {
+    return m_containerBuilder;
+}
+
+void CopyEngine::setScanTarget(const ScanTarget& scanTarget) {
+    m_scanTarget = scanTarget;
+}
+
+const ScanTarget& CopyEngine::getScanTarget() const {
+    return m_scanTarget;
+}
+
+void CopyEngine::setTemplateCacheBudgetInBytes(qint64 budgetInBytes) {
+    m_templateCache.setBudgetInBytes(budgetInBytes);
+}
+
+qint64 CopyEngine::getTemplateCacheBudgetInBytes() const {
+    return m_templateCache.getBudgetInBytes();
+}
+
+qint64 CopyEngine::getTemplateCacheUsedInBytes() const {
+    return m_templateCache.getUsedInBytes();
+}
+
+void CopyEngine::start() {
+    QMutexLocker locker(&m_mutex);
+    if(m_running)
+        return;
+
+    m_running = true;
+    while(m_roots.size() < m_rootsNb) {
+        m_roots << new CopyRoot;
+    }
+    for(int rootIdx = 0; rootIdx < m_rootsNb; rootIdx++) {
+        for(int i = 0; i < m_threadsNb; i++) {
+            MetricsShard* shard = m_metrics.getShard(rootIdx * m_threadsNb + i);
+            IoBackend* backend = m_scanTarget.isEnabled() ? new NetworkIoBackend(this, shard, rootIdx) :
+                                                            IoBackend::create(m_ioBackend, this, shard, rootIdx);
+            CopyWorker* worker = new CopyWorker(backend);
+            m_workers << worker;
+            worker->start();
+        }
+    }
+}
+
+void CopyEngine::stop() {
+    {
+        QMutexLocker locker(&m_mutex);
+        if(!m_running)
+            return;
+
+        m_running = false;
+        foreach(CopyRoot* root, m_roots) {
+            root->jobs.clear();
+            root->jobAvailable.wakeAll();
+        }
+    }
+
+    foreach(CopyWorker* worker, m_workers) {
+        worker->wait();
+        delete worker;
+    }
+    m_workers.clear();
+    m_templateCache.clear();
+
+    QMutexLocker locker(&m_mutex);
+    m_jobFinished.wakeAll();
+}
+
+bool CopyEngine::isRunning() const {
+    QMutexLocker locker(&m_mutex);
+    return m_running;
+}
+
+void CopyEngine::enqueue(const CopyJob& job) {
+    QMutexLocker locker(&m_mutex);
+    if(!m_running)
+        return;
+
+    CopyRoot* root = m_roots.at(job.rootIdx);
+    root->jobs.enqueue(job);
+    root->jobAvailable.wakeOne();
+}
+
+void CopyEngine::enqueue(const QVector<CopyJob>& jobs) {
+    QMutexLocker locker(&m_mutex);
+    if(!m_running)
+        return;
+
+    foreach(const CopyJob& job, jobs) {
+        m_roots.at(job.rootIdx)->jobs.enqueue(job);
+    }
+    foreach(CopyRoot* root, m_roots) {
+        root->jobAvailable.wakeAll();
+    }
+}
+
+bool CopyEngine::waitForDone(unsigned long msecs) {
+    QMutexLocker locker(&m_mutex);
+    for(int rootIdx = 0; rootIdx < m_roots.size(); rootIdx++) {
+        while(m_roots.at(rootIdx)->jobs.size() || m_roots.at(rootIdx)->activeJobsNb) {
+            if(!m_jobFinished.wait(&m_mutex, msecs))
+                return false;
+        }
+    }
+    return true;
+}
+
+// keeps producers from running ahead of the workers of the root
+bool CopyEngine::waitForCapacity(int rootIdx, unsigned long msecs) {
+    QMutexLocker locker(&m_mutex);
+    while(m_running && m_roots.at(rootIdx)->jobs.size() >= m_threadsNb * QUEUED_JOBS_PER_THREAD) {
+        if(!m_jobFinished.wait(&m_mutex, msecs))
+            return false;
+    }
+    return m_running;
+}
+
+int CopyEngine::getPendingJobsNb() const {
+    QMutexLocker locker(&m_mutex);
+    int pendingJobsNb = 0;
+    foreach(const CopyRoot* root, m_roots) {
+        pendingJobsNb += root->jobs.size() + root->activeJobsNb;
+    }
+    return pendingJobsNb;
+}
+
+int CopyEngine::getPendingJobsNb(int rootIdx) const {
+    QMutexLocker locker(&m_mutex);
+    return rootIdx < m_roots.size() ? m_roots.at(rootIdx)->jobs.size() + m_roots.at(rootIdx)->activeJobsNb : 0;
+}
+
+// returns false once the engine stops, or right away on an empty queue without wait
+bool CopyEngine::takeJob(int rootIdx, CopyJob& job, bool wait) {
+    QMutexLocker locker(&m_mutex);
+    CopyRoot* root = m_roots.at(rootIdx);
+    while(wait && m_running && root->jobs.isEmpty()) {
+        root->jobAvailable.wait(&m_mutex);
+    }
+    if(!m_running || root->jobs.isEmpty())
+        return false;
+
+    job = root->jobs.dequeue();
+    root->activeJobsNb++;
+    return true;
+}
+
+void CopyEngine::finishJob(int rootIdx) {
+    QMutexLocker locker(&m_mutex);
+    m_roots.at(rootIdx)->activeJobsNb--;
+    m_jobFinished.wakeAll();
+}
+
+// containers have no source of their own, their members are cached one by one
+const uchar* CopyEngine::acquireTemplate(const CopyJob& job, qint64& size) {
+    if(job.synthetic || !job.members.isEmpty() || job.sourcePath.isEmpty() || !m_templateCache.isEnabled())
+        return nullptr;
+    return m_templateCache.acquire(job.sourcePath, size);
+}
+
+// size is what was actually written, containers are only known once built
+bool CopyEngine::copy(const CopyJob& job, QByteArray& buffer, AlignedBuffer& directBuffer, MetricsShard* shard, qint64& size) {
+    qint64 cachedSize = 0;
+    const uchar* cachedData = acquireTemplate(job, cachedSize);
+
+    QByteArray container;
+    if(!job.members.isEmpty() && !buildContainer(job, container, buffer))
+        return false;
+
+    if(m_writePolicy.isDirect() && !directBuffer.reserve(m_writePolicy.getDirectBufferSize()))
+        return false;
+
+    OutputFile file;
+    file.setWritePolicy(m_writePolicy, &directBuffer);
+    if(!file.open(job.destinationPath, m_publishMode))
+        return false;
+    if(m_writePolicy.isPreallocating())
+        file.preallocate(job.members.isEmpty() ? job.size : container.size());
+
+    size = job.size;
+    bool copied;
+    if(!job.members.isEmpty()) {
+        copied = file.write(container.constData(), container.size());
+        size = container.size();
+    } else if(job.synthetic) {
+        copied = writeSynthetic(job, file, buffer);
+    } else if(cachedData && m_mutator.isEnabled()) {
+        Mutation mutation;
+        m_mutator.mutate(job.payloadSeed, cachedData, cachedSize, mutation);
+        copied = writeMutation(file, mutation);
+    } else if(cachedData) {
+        copied = file.write(reinterpret_cast<const char*>(cachedData), cachedSize);
+    } else {
+        // an in-kernel copy would bypass direct writes
+        if(job.size >= LARGE_TEMPLATE_SIZE && !file.isDirect()) {
+            copied = cloneFile(job.sourcePath, file) || (file.truncate() && copyFile(job.sourcePath, file, buffer));
+        } else {
+            copied = copyFile(job.sourcePath, file, buffer);
+        }
+        if(copied && m_mutator.isEnabled())
+            copied = patchFile(file, m_mutator, job.payloadSeed);
+    }
+
+    if(!copied) {
+        file.discard();
+        return false;
+    }
+    return publish(file, job.rootIdx, shard);
+}
+
+// members come from the template cache when they fit, otherwise they are read
+// into the buffer one at a time, which is enough as each is packed before the next
+bool CopyEngine::buildContainer(const CopyJob& job, QByteArray& container, QByteArray& buffer) {
+    return m_containerBuilder.build(job.members, [this, &buffer](const QString& path, const uchar*& data, qint64& size) {
+        data = m_templateCache.isEnabled() ? m_templateCache.acquire(path, size) : nullptr;
+        if(data)
+            return true;
+
+        QFile file(path);
+        if(!file.open(QIODevice::ReadOnly))
+            return false;
+        buffer = file.readAll();
+        data = reinterpret_cast<const uchar*>(buffer.constData());
+        size = buffer.size();
+        return size == file.size();
+    }, container);
+}
+
+// the time spent here is what a durable producer pays on top of a cached one
+bool CopyEngine::sync(int fd, int rootIdx, MetricsShard* shard) {
+    if(m_fsyncPolicy == NO_FSYNC)
+        return true;
+
+    qint64 startTime = Metrics::nowInNsecs();
+    bool synced;
+    if(m_fsyncPolicy == FILE_FSYNC) {
+        synced = OutputFile::syncFile(fd);
+    } else {
+        // the first worker past the interval claims the batch, the others go on
+        std::atomic<qint64>& lastSyncTime = m_roots.at(rootIdx)->lastSyncTimeInNsecs;
+        qint64 lastTime = lastSyncTime.load();
+        if(startTime - lastTime < m_fsyncIntervalInMsecs * 1000000LL ||
+           !lastSyncTime.compare_exchange_strong(lastTime, startTime))
+            return true;
+        synced = OutputFile::syncFileSystem(fd);
+    }
+    shard->addSync(Metrics::nowInNsecs() - startTime);
+    return synced;
+}
+
+bool CopyEngine::publish(OutputFile& file, int rootIdx, MetricsShard* shard) {
+    if(!file.flush() || !sync(file.handle(), rootIdx, shard)) {
+        file.discard();
+        return false;
+    }
+    if(m_writePolicy.isEvicting())
+        file.evict();
+
+    qint64 startTime = Metrics::nowInNsecs();
+    bool committed = file.commit();
+    if(file.getMode() != DIRECT_PUBLISH)
+        shard->addPublish(Metrics::nowInNsecs() - startTime);
+    return committed;
+}
+
+const Metrics& CopyEngine::getMetrics() const {
+    return m_metrics;
+}
+
+qint64 CopyEngine::getCopiedFilesCnt() const {
+    return m_metrics.getTotals().filesCnt;
+}
+
+qint64 CopyEngine::getCopiedBytes() const {
+    return m_metrics.getTotals().bytes;
+}
+
+qint64 CopyEngine::getInfectedFilesCnt() const {
+    return m_metrics.getTotals().infectedFilesCnt;
+}
+
+qint64 CopyEngine::getFailedFilesCnt() const {
+    return m_metrics.getTotals().failedFilesCnt;
+}
+
+MetricsTotals CopyEngine::getRootTotals(int rootIdx) const {
+    return m_metrics.getTotals(rootIdx * m_threadsNb, m_threadsNb);
+}
+
+qint64 CopyEngine::getRootLatencyInNsecs(int rootIdx, double percentile) const {
+    return Metrics::latencyPercentileInNsecs(m_metrics.getLatencyBuckets(rootIdx * m_threadsNb, m_threadsNb), percentile);
+}
+
+void CopyEngine::flushStatistic() {
+    m_metrics.reset();
+}
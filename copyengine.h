@@ -0,0 +1,164 @@
+#ifndef COPYENGINE_H
+#define COPYENGINE_H
+
+#include <QString>
+#include <QQueue>
+#include <QVector>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "templatecache.h"
+#include "payloadgenerator.h"
+#include "metrics.h"
+#include "iobackend.h"
+#include "outputfile.h"
+#include "mutator.h"
+#include "containerbuilder.h"
+#include "scanprotocol.h"
+
+#include <atomic>
+#include <climits>
+
+#define     DEFAULT_THREADS_NB      4
+#define     MAX_THREADS_NB          64
+#define     LARGE_TEMPLATE_SIZE     (64 * 1024 * 1024)
+#define     QUEUED_JOBS_PER_THREAD  4
+
+struct CopyJob {
+    QString sourcePath;
+    QString destinationPath;
+    qint64 size{0};
+    bool infected{false};
+    int rootIdx{0};
+
+    // content seed of synthetic payload and mutation bytes of templates
+    quint64 payloadSeed{0};
+
+    // container of templates built by the worker, sourcePath is empty
+    QVector<ContainerMember> members;
+
+    // synthetic payload, sourcePath is empty
+    bool synthetic{false};
+    const QByteArray* signature{nullptr};
+    qint64 signatureOffset{0};
+};
+
+class CopyEngine;
+
+class CopyWorker : public QThread {
+
+    IoBackend* m_backend;
+
+public:
+    explicit CopyWorker(IoBackend* backend);
+    ~CopyWorker();
+
+protected:
+    void run() override;
+};
+
+// jobs of one destination root, served by its own group of workers
+struct CopyRoot {
+    QQueue<CopyJob> jobs;
+    QWaitCondition jobAvailable;
+    int activeJobsNb{0};
+    std::atomic<qint64> lastSyncTimeInNsecs{0};
+};
+
+// pools of worker threads, one per destination root, pulling copy jobs from the
+// root's queue. Each worker writes through its own instance of the selected I/O
+// backend and counts into its own metrics shard, the shards of root r are
+// r * threadsNb .. (r + 1) * threadsNb - 1.
+class CopyEngine {
+
+    int m_threadsNb{DEFAULT_THREADS_NB};
+    int m_rootsNb{1};
+    IO_BACKEND m_ioBackend{SYNC_IO_BACKEND};
+    PUBLISH_MODE m_publishMode{DIRECT_PUBLISH};
+    FSYNC_POLICY m_fsyncPolicy{NO_FSYNC};
+    int m_fsyncIntervalInMsecs{DEFAULT_FSYNC_INTERVAL};
+    WritePolicy m_writePolicy;
+    Mutator m_mutator;
+    ContainerBuilder m_containerBuilder;
+    ScanTarget m_scanTarget;
+    QVector<CopyWorker*> m_workers;
+
+    QVector<CopyRoot*> m_roots;
+    mutable QMutex m_mutex;
+    QWaitCondition m_jobFinished;
+    bool m_running{false};
+
+    TemplateCache m_templateCache;
+
+    Metrics m_metrics;
+
+public:
+    CopyEngine();
+    ~CopyEngine();
+
+    void setThreadsNb(int threadsNb);
+    int getThreadsNb() const;
+
+    void setRootsNb(int rootsNb);
+    int getRootsNb() const;
+
+    void setIoBackend(IO_BACKEND ioBackend);
+    IO_BACKEND getIoBackend() const;
+
+    void setPublishMode(PUBLISH_MODE publishMode);
+    PUBLISH_MODE getPublishMode() const;
+    void setFsyncPolicy(FSYNC_POLICY fsyncPolicy, int intervalInMsecs = DEFAULT_FSYNC_INTERVAL);
+    FSYNC_POLICY getFsyncPolicy() const;
+    int getFsyncIntervalInMsecs() const;
+
+    // applies to synchronous writes, io_uring workers hand such jobs to them
+    void setWritePolicy(const WritePolicy& writePolicy);
+    const WritePolicy& getWritePolicy() const;
+
+    void setMutator(const Mutator& mutator);
+    const Mutator& getMutator() const;
+
+    void setContainerBuilder(const ContainerBuilder& containerBuilder);
+    const ContainerBuilder& getContainerBuilder() const;
+
+    // an enabled target replaces the I/O backend: jobs are sent to the scanner instead of written
+    void setScanTarget(const ScanTarget& scanTarget);
+    const ScanTarget& getScanTarget() const;
+
+    void setTemplateCacheBudgetInBytes(qint64 budgetInBytes);
+    qint64 getTemplateCacheBudgetInBytes() const;
+    qint64 getTemplateCacheUsedInBytes() const;
+
+    void start();
+    void stop();
+    bool isRunning() const;
+
+    void enqueue(const CopyJob& job);
+    void enqueue(const QVector<CopyJob>& jobs);
+    bool waitForDone(unsigned long msecs = ULONG_MAX);
+    bool waitForCapacity(int rootIdx, unsigned long msecs = ULONG_MAX);
+    int getPendingJobsNb() const;
+    int getPendingJobsNb(int rootIdx) const;
+
+// I/O backend side
+    bool takeJob(int rootIdx, CopyJob& job, bool wait);
+    void finishJob(int rootIdx);
+    bool copy(const CopyJob& job, QByteArray& buffer, AlignedBuffer& directBuffer, MetricsShard* shard, qint64& size);
+    bool buildContainer(const CopyJob& job, QByteArray& container, QByteArray& buffer);
+    bool sync(int fd, int rootIdx, MetricsShard* shard);
+    bool publish(OutputFile& file, int rootIdx, MetricsShard* shard);
+    const uchar* acquireTemplate(const CopyJob& job, qint64& size);
+
+// statistics
+    const Metrics& getMetrics() const;
+    qint64 getCopiedFilesCnt() const;
+    qint64 getCopiedBytes() const;
+    qint64 getInfectedFilesCnt() const;
+    qint64 getFailedFilesCnt() const;
+    MetricsTotals getRootTotals(int rootIdx) const;
+    qint64 getRootLatencyInNsecs(int rootIdx, double percentile) const;
+    void flushStatistic();
+};
+
+#endif // COPYENGINE_H
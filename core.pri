@@ -0,0 +1,48 @@
+# generation core shared by the application and the benchmark: everything
+# but the widgets and the entry points
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/cluster.cpp \
+    $$PWD/containerbuilder.cpp \
+    $$PWD/copyengine.cpp \
+    $$PWD/destinationmonitor.cpp \
+    $$PWD/iobackend.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/mutator.cpp \
+    $$PWD/networkbackend.cpp \
+    $$PWD/outputfile.cpp \
+    $$PWD/payloadgenerator.cpp \
+    $$PWD/ratescheduler.cpp \
+    $$PWD/scanprotocol.cpp \
+    $$PWD/scanserver.cpp \
+    $$PWD/statsexporter.cpp \
+    $$PWD/templatecache.cpp \
+    $$PWD/templateindexer.cpp \
+    $$PWD/templatepool.cpp \
+    $$PWD/tracefile.cpp \
+    $$PWD/trafficgenerator.cpp \
+    $$PWD/workloadprofile.cpp
+
+HEADERS += \
+    $$PWD/cluster.h \
+    $$PWD/containerbuilder.h \
+    $$PWD/copyengine.h \
+    $$PWD/destinationmonitor.h \
+    $$PWD/iobackend.h \
+    $$PWD/metrics.h \
+    $$PWD/mutator.h \
+    $$PWD/networkbackend.h \
+    $$PWD/outputfile.h \
+    $$PWD/payloadgenerator.h \
+    $$PWD/ratescheduler.h \
+    $$PWD/scanprotocol.h \
+    $$PWD/scanserver.h \
+    $$PWD/statsexporter.h \
+    $$PWD/templatecache.h \
+    $$PWD/templateindexer.h \
+    $$PWD/templatepool.h \
+    $$PWD/tracefile.h \
+    $$PWD/trafficgenerator.h \
+    $$PWD/workloadprofile.h
@@ -0,0 +1,311 @@
+#include "destinationmonitor.h"
+
+#include <QDirIterator>
+#include <QFile>
+#include <QSet>
+
+#ifdef Q_OS_LINUX
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+DestinationMonitor::DestinationMonitor() {
+}
+
+DestinationMonitor::~DestinationMonitor() {
+    stopWatching();
+}
+
+void DestinationMonitor::setHighWaterMark(qint64 highWaterMark) {
+    m_highWaterMark = qMax(qint64(0), highWaterMark);
+    m_drained.notify_all();
+}
+
+qint64 DestinationMonitor::getHighWaterMark() const {
+    return m_highWaterMark;
+}
+
+bool DestinationMonitor::isEnabled() const {
+    return m_highWaterMark > 0;
+}
+
+// every output directory gets a watch, the backlog is their sum
+bool DestinationMonitor::startWatching(const QStringList& dirs) {
+    stopWatching();
+
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        m_cancelled = false;
+    }
+    m_throttledTimeInNsecs = 0;
+    m_throttlesNb = 0;
+    m_dirs = dirs;
+
+    {
+        std::lock_guard<std::mutex> locker(m_trackedFilesMutex);
+        m_trackedFiles.clear();
+    }
+    m_scanLatency[CLEAN].reset();
+    m_scanLatency[INFECTED].reset();
+    m_untrackedFilesNb = 0;
+
+#ifdef Q_OS_LINUX
+    m_inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_inotifyFd < 0)
+        return false;
+
+    quint32 mask = IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR;
+    if(m_scanLatencyTracking)
+        mask |= IN_CLOSE_WRITE;
+
+    // listed before the watch is set, so a file created in between is missed rather
+    // than counted twice; the generator has not started writing yet
+    rescan();
+    foreach(const QString& dir, dirs) {
+        if(::inotify_add_watch(m_inotifyFd, QFile::encodeName(dir).constData(), mask) < 0) {
+            ::close(m_inotifyFd);
+            m_inotifyFd = -1;
+            return false;
+        }
+    }
+
+    m_running = true;
+    QThread::start();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void DestinationMonitor::stopWatching() {
+    cancel();
+    m_running = false;
+    wait();
+
+#ifdef Q_OS_LINUX
+    if(m_inotifyFd >= 0) {
+        ::close(m_inotifyFd);
+        m_inotifyFd = -1;
+    }
+#endif
+}
+
+void DestinationMonitor::cancel() {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_cancelled = true;
+    m_drained.notify_all();
+}
+
+bool DestinationMonitor::isWatching() const {
+    return m_running;
+}
+
+// tracked files found on disk are marked, so their queued create events are not counted again.
+// Files that were seen but are gone lost their delete event to an overflow and are dropped.
+void DestinationMonitor::rescan() {
+    QSet<QString> fileNames;
+    qint64 filesNb = 0;
+    foreach(const QString& dir, m_dirs) {
+        QDirIterator it(dir, QDir::Files | QDir::Hidden | QDir::System);
+        while(it.hasNext()) {
+            it.next();
+            if(!OutputFile::isTemporaryName(QFile::encodeName(it.fileName()))) {
+                fileNames << it.fileName();
+                filesNb++;
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(m_trackedFilesMutex);
+        QHash<QString, TrackedFile>::iterator it = m_trackedFiles.begin();
+        while(it != m_trackedFiles.end()) {
+            bool onDisk = fileNames.contains(it.key());
+            if(!onDisk && (it->counted || it->writtenTimeInNsecs)) {
+                it = m_trackedFiles.erase(it);
+                continue;
+            }
+            it->counted = onDisk;
+            ++it;
+        }
+    }
+    m_backlog = filesNb;
+    m_drained.notify_all();
+}
+
+// returns false for a tracked file that is already in the backlog
+bool DestinationMonitor::created(const QString& fileName) {
+    std::lock_guard<std::mutex> locker(m_trackedFilesMutex);
+    QHash<QString, TrackedFile>::iterator it = m_trackedFiles.find(fileName);
+    if(it == m_trackedFiles.end())
+        return true;
+    if(it->counted)
+        return false;
+    it->counted = true;
+    return true;
+}
+
+void DestinationMonitor::removed() {
+    qint64 backlog = m_backlog.load();
+    while(backlog > 0 && !m_backlog.compare_exchange_weak(backlog, backlog - 1)) {
+    }
+
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_drained.notify_one();
+}
+
+// inotify events carry no time, the whole batch is stamped when it's read
+void DestinationMonitor::run() {
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[INOTIFY_BUFFER_SIZE];
+    struct pollfd pollFd = {m_inotifyFd, POLLIN, 0};
+
+    while(m_running) {
+        if(::poll(&pollFd, 1, MONITOR_POLL_INTERVAL) <= 0)
+            continue;
+
+        ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+        qint64 timeInNsecs = Metrics::nowInNsecs();
+        bool tracking = m_scanLatencyTracking;
+        bool atomicPublish = m_atomicPublish;
+
+        for(char* ptr = buffer; length > 0 && ptr < buffer + length; ) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if(event->mask & IN_Q_OVERFLOW) {
+                rescan();
+            } else if(event->mask & IN_ISDIR) {
+                continue;
+            } else if(event->len && OutputFile::isTemporaryName(QByteArray::fromRawData(event->name, int(qstrlen(event->name))))) {
+                continue;
+            } else if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                if(!tracking || !event->len || created(QFile::decodeName(event->name)))
+                    m_backlog++;
+                if(tracking && atomicPublish && event->len)
+                    written(QFile::decodeName(event->name), timeInNsecs);
+            } else if(event->mask & IN_CLOSE_WRITE) {
+                if(tracking && event->len)
+                    written(QFile::decodeName(event->name), timeInNsecs);
+            } else if(event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                removed();
+                if(tracking && event->len)
+                    scanned(QFile::decodeName(event->name), timeInNsecs);
+            }
+        }
+    }
+#endif
+}
+
+void DestinationMonitor::written(const QString& fileName, qint64 timeInNsecs) {
+    std::lock_guard<std::mutex> locker(m_trackedFilesMutex);
+    QHash<QString, TrackedFile>::iterator it = m_trackedFiles.find(fileName);
+    if(it != m_trackedFiles.end() && !it->writtenTimeInNsecs) {
+        it->writtenTimeInNsecs = timeInNsecs;
+    }
+}
+
+// files removed before their writer closed them were not scanned, they are just forgotten
+void DestinationMonitor::scanned(const QString& fileName, qint64 timeInNsecs) {
+    TrackedFile trackedFile;
+    {
+        std::lock_guard<std::mutex> locker(m_trackedFilesMutex);
+        QHash<QString, TrackedFile>::iterator it = m_trackedFiles.find(fileName);
+        if(it == m_trackedFiles.end())
+            return;
+        trackedFile = it.value();
+        m_trackedFiles.erase(it);
+    }
+
+    if(trackedFile.writtenTimeInNsecs) {
+        m_scanLatency[trackedFile.type].addFile(trackedFile.size, trackedFile.type == INFECTED,
+                                                timeInNsecs - trackedFile.writtenTimeInNsecs);
+    }
+}
+
+void DestinationMonitor::setScanLatencyTracking(bool scanLatencyTracking) {
+    m_scanLatencyTracking = scanLatencyTracking;
+}
+
+bool DestinationMonitor::isScanLatencyTracking() const {
+    return m_scanLatencyTracking;
+}
+
+// with atomic publish a file is complete as soon as it shows up under its final name
+void DestinationMonitor::setAtomicPublish(bool atomicPublish) {
+    m_atomicPublish = atomicPublish;
+}
+
+// called by the producer before the job is queued, so the close event can't come first
+void DestinationMonitor::track(const QString& fileName, qint64 size, FILE_TYPE type) {
+    if(!m_scanLatencyTracking || !m_running)
+        return;
+
+    TrackedFile trackedFile;
+    trackedFile.type = type;
+    trackedFile.size = size;
+
+    std::lock_guard<std::mutex> locker(m_trackedFilesMutex);
+    if(m_trackedFiles.size() >= MAX_TRACKED_FILES) {
+        m_untrackedFilesNb++;
+        return;
+    }
+    m_trackedFiles.insert(fileName, trackedFile);
+}
+
+// blocks while the files in the destination plus the ones still being written
+// reach the high-water mark, returns false when cancelled
+bool DestinationMonitor::waitForRoom(const std::function<qint64()>& inFlightNb) {
+    if(!isEnabled() || !m_running || m_backlog + inFlightNb() < m_highWaterMark)
+        return true;
+
+    qint64 startTime = Metrics::nowInNsecs();
+    m_throttlesNb++;
+
+    std::unique_lock<std::mutex> locker(m_mutex);
+    while(!m_cancelled && isEnabled() && m_backlog + inFlightNb() >= m_highWaterMark) {
+        m_drained.wait_for(locker, std::chrono::milliseconds(BACKLOG_WAIT_INTERVAL));
+    }
+    m_throttledTimeInNsecs += Metrics::nowInNsecs() - startTime;
+    return !m_cancelled;
+}
+
+qint64 DestinationMonitor::getBacklog() const {
+    return m_backlog;
+}
+
+qint64 DestinationMonitor::getThrottledTimeInNsecs() const {
+    return m_throttledTimeInNsecs;
+}
+
+qint64 DestinationMonitor::getThrottlesNb() const {
+    return m_throttlesNb;
+}
+
+qint64 DestinationMonitor::getScannedFilesNb(FILE_TYPE type) const {
+    return m_scanLatency[type].filesCnt.load(std::memory_order_relaxed);
+}
+
+qint64 DestinationMonitor::getScannedBytes(FILE_TYPE type) const {
+    return m_scanLatency[type].bytes.load(std::memory_order_relaxed);
+}
+
+qint64 DestinationMonitor::getScanLatencyInNsecs(FILE_TYPE type, double percentile) const {
+    QVector<qint64> buckets;
+    m_scanLatency[type].addLatencyBuckets(buckets);
+    return Metrics::latencyPercentileInNsecs(buckets, percentile);
+}
+
+qint64 DestinationMonitor::getScanLatencySumInNsecs(FILE_TYPE type) const {
+    return m_scanLatency[type].latencySumInNsecs.load(std::memory_order_relaxed);
+}
+
+qint64 DestinationMonitor::getPendingScanFilesNb() const {
+    std::lock_guard<std::mutex> locker(m_trackedFilesMutex);
+    return m_trackedFiles.size();
+}
+
+qint64 DestinationMonitor::getUntrackedFilesNb() const {
+    return m_untrackedFilesNb;
+}
@@ -0,0 +1,102 @@
+#ifndef DESTINATIONMONITOR_H
+#define DESTINATIONMONITOR_H
+
+#include <QThread>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+#include "metrics.h"
+#include "templatepool.h"
+#include "outputfile.h"
+
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+#define     MONITOR_POLL_INTERVAL       100
+#define     BACKLOG_WAIT_INTERVAL       50
+#define     INOTIFY_BUFFER_SIZE         (64 * 1024)
+#define     MAX_TRACKED_FILES           (1024 * 1024)
+
+struct TrackedFile {
+    FILE_TYPE type{CLEAN};
+    qint64 size{0};
+    qint64 writtenTimeInNsecs{0};
+    bool counted{false};
+};
+
+// follows the number of files waiting in the destination directory through
+// inotify: created and moved-in files add to the backlog, deleted and moved-out
+// files (picked up by the scanner) remove from it. The directory is listed only
+// once at start and after an event queue overflow.
+// With scan latency tracking on, every generated file is remembered with its
+// class, stamped when its writer closes it and measured when it disappears.
+// Files published atomically are stamped when they get their final name, their
+// hidden temporary names don't count at all.
+class DestinationMonitor : public QThread {
+
+    QStringList m_dirs;
+    int m_inotifyFd{-1};
+
+    std::atomic<bool> m_running{false};
+    std::atomic<qint64> m_backlog{0};
+    std::atomic<qint64> m_highWaterMark{0};
+
+    std::atomic<qint64> m_throttledTimeInNsecs{0};
+    std::atomic<qint64> m_throttlesNb{0};
+
+    bool m_cancelled{false};
+    std::mutex m_mutex;
+    std::condition_variable m_drained;
+
+    std::atomic<bool> m_scanLatencyTracking{false};
+    std::atomic<bool> m_atomicPublish{false};
+    QHash<QString, TrackedFile> m_trackedFiles;
+    mutable std::mutex m_trackedFilesMutex;
+    MetricsShard m_scanLatency[2];
+    std::atomic<qint64> m_untrackedFilesNb{0};
+
+    void rescan();
+    bool created(const QString& fileName);
+    void removed();
+    void written(const QString& fileName, qint64 timeInNsecs);
+    void scanned(const QString& fileName, qint64 timeInNsecs);
+
+protected:
+    void run() override;
+
+public:
+    DestinationMonitor();
+    ~DestinationMonitor();
+
+    void setHighWaterMark(qint64 highWaterMark);
+    qint64 getHighWaterMark() const;
+    bool isEnabled() const;
+
+    bool startWatching(const QStringList& dirs);
+    void stopWatching();
+    void cancel();
+    bool isWatching() const;
+
+    bool waitForRoom(const std::function<qint64()>& inFlightNb);
+
+    void setScanLatencyTracking(bool scanLatencyTracking);
+    bool isScanLatencyTracking() const;
+    void setAtomicPublish(bool atomicPublish);
+    void track(const QString& fileName, qint64 size, FILE_TYPE type);
+
+    qint64 getBacklog() const;
+    qint64 getThrottledTimeInNsecs() const;
+    qint64 getThrottlesNb() const;
+
+    qint64 getScannedFilesNb(FILE_TYPE type) const;
+    qint64 getScannedBytes(FILE_TYPE type) const;
+    qint64 getScanLatencyInNsecs(FILE_TYPE type, double percentile) const;
+    qint64 getScanLatencySumInNsecs(FILE_TYPE type) const;
+    qint64 getPendingScanFilesNb() const;
+    qint64 getUntrackedFilesNb() const;
+};
+
+#endif // DESTINATIONMONITOR_H
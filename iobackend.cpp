@@ -0,0 +1,577 @@
+#include "iobackend.h"
+#include "copyengine.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#ifdef Q_OS_LINUX
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// the opcodes are enum values, so the 5.6 headers (openat, close, open_flags) are
+// recognised by a feature flag they introduced, older ones get the sync backend
+#ifdef IORING_FEAT_RW_CUR_POS
+#define HAVE_IO_URING
+#endif
+#endif
+#ifdef HAVE_IO_URING
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <cstring>
+#endif
+#endif
+
+IoBackend::IoBackend(CopyEngine* engine, MetricsShard* shard, int rootIdx): m_engine(engine), m_shard(shard), m_rootIdx(rootIdx) {
+}
+
+IoBackend::~IoBackend() {
+}
+
+void IoBackend::copySync(const CopyJob& job) {
+    qint64 startTime = Metrics::nowInNsecs();
+    qint64 size;
+    if(m_engine->copy(job, m_buffer, m_directBuffer, m_shard, size)) {
+        m_shard->addFile(size, job.infected, Metrics::nowInNsecs() - startTime);
+    } else {
+        m_shard->addFailure();
+    }
+    m_engine->finishJob(m_rootIdx);
+}
+
+void IoBackend::runSync() {
+    CopyJob job;
+    while(m_engine->takeJob(m_rootIdx, job, true)) {
+        copySync(job);
+    }
+}
+
+IoBackend* IoBackend::create(IO_BACKEND type, CopyEngine* engine, MetricsShard* shard, int rootIdx) {
+    switch(type) {
+        case URING_IO_BACKEND:
+            return new UringIoBackend(engine, shard, rootIdx);
+        default:
+            return new SyncIoBackend(engine, shard, rootIdx);
+    }
+}
+
+QString IoBackend::toString(IO_BACKEND type) {
+    return type == URING_IO_BACKEND ? "uring" : "sync";
+}
+
+bool IoBackend::parse(const QString& name, IO_BACKEND& type) {
+    if(name == "sync") {
+        type = SYNC_IO_BACKEND;
+    } else if(name == "uring" || name == "io_uring") {
+        type = URING_IO_BACKEND;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------
+
+SyncIoBackend::SyncIoBackend(CopyEngine* engine, MetricsShard* shard, int rootIdx): IoBackend(engine, shard, rootIdx) {
+}
+
+void SyncIoBackend::run() {
+    runSync();
+}
+
+// -----------------------------------------------------------------------------------------
+
+#ifdef HAVE_IO_URING
+
+// the ring is driven through raw syscalls, so there is no liburing dependency
+struct UringIoBackend::Ring {
+    int fd{-1};
+    unsigned entriesNb{0};
+
+    void* sqRing{MAP_FAILED};
+    size_t sqRingSize{0};
+    void* cqRing{MAP_FAILED};
+    size_t cqRingSize{0};
+    void* sqes{MAP_FAILED};
+    size_t sqesSize{0};
+
+    unsigned* sqHead{nullptr};
+    unsigned* sqTail{nullptr};
+    unsigned* sqArray{nullptr};
+    unsigned sqMask{0};
+    unsigned sqLocalTail{0};
+    unsigned pendingNb{0};
+
+    unsigned* cqHead{nullptr};
+    unsigned* cqTail{nullptr};
+    unsigned cqMask{0};
+    struct io_uring_cqe* cqes{nullptr};
+
+    ~Ring();
+
+    bool init(unsigned entries);
+    bool supports(const QVector<int>& opcodes);
+    struct io_uring_sqe* nextSqe();
+    int submitAndWait(unsigned waitNb);
+};
+
+UringIoBackend::Ring::~Ring() {
+    if(sqes != MAP_FAILED)
+        ::munmap(sqes, sqesSize);
+    if(cqRing != MAP_FAILED && cqRing != sqRing)
+        ::munmap(cqRing, cqRingSize);
+    if(sqRing != MAP_FAILED)
+        ::munmap(sqRing, sqRingSize);
+    if(fd >= 0)
+        ::close(fd);
+}
+
+bool UringIoBackend::Ring::init(unsigned entries) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+    if(fd < 0)
+        return false;
+    entriesNb = params.sq_entries;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(singleMap) {
+        sqRingSize = cqRingSize = qMax(sqRingSize, cqRingSize);
+    }
+
+    sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(sqRing == MAP_FAILED)
+        return false;
+    cqRing = singleMap ? sqRing :
+             ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if(cqRing == MAP_FAILED)
+        return false;
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+        return false;
+
+    char* sq = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqLocalTail = *sqTail;
+
+    char* cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+// openat/write/close need 5.6+, older kernels and seccomp sandboxes fall back to sync
+bool UringIoBackend::Ring::supports(const QVector<int>& opcodes) {
+    const int opsNb = 256;
+    QByteArray probeData(int(sizeof(struct io_uring_probe) + opsNb * sizeof(struct io_uring_probe_op)), 0);
+    struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(probeData.data());
+    if(::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, opsNb) < 0)
+        return false;
+
+    foreach(int opcode, opcodes) {
+        if(opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+            return false;
+    }
+    return true;
+}
+
+// every slot has at most one operation queued, so the ring never runs out of entries
+struct io_uring_sqe* UringIoBackend::Ring::nextSqe() {
+    unsigned idx = sqLocalTail & sqMask;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes) + idx;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray[idx] = idx;
+    sqLocalTail++;
+    pendingNb++;
+    return sqe;
+}
+
+int UringIoBackend::Ring::submitAndWait(unsigned waitNb) {
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+
+    int submittedNb;
+    do {
+        submittedNb = int(::syscall(__NR_io_uring_enter, fd, pendingNb, waitNb,
+                                    waitNb ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+    } while(submittedNb < 0 && errno == EINTR);
+
+    if(submittedNb > 0)
+        pendingNb -= unsigned(submittedNb);
+    return submittedNb;
+}
+
+#else
+
+struct UringIoBackend::Ring {
+};
+
+#endif
+
+UringIoBackend::UringIoBackend(CopyEngine* engine, MetricsShard* shard, int rootIdx): IoBackend(engine, shard, rootIdx) {
+}
+
+UringIoBackend::~UringIoBackend() {
+    delete m_ring;
+}
+
+bool IoBackend::isSupported(IO_BACKEND type) {
+    if(type != URING_IO_BACKEND)
+        return true;
+
+#ifdef HAVE_IO_URING
+    static const bool supported = [] {
+        UringIoBackend::Ring ring;
+        return ring.init(4) && ring.supports(QVector<int>() << IORING_OP_OPENAT << IORING_OP_WRITE << IORING_OP_CLOSE);
+    }();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+void UringIoBackend::run() {
+#ifdef HAVE_IO_URING
+    m_ring = new Ring;
+    if(!isSupported(URING_IO_BACKEND) || !m_ring->init(URING_QUEUE_DEPTH)) {
+        delete m_ring;
+        m_ring = nullptr;
+        runSync();
+        return;
+    }
+
+    m_slots.resize(URING_QUEUE_DEPTH);
+    m_freeSlots.clear();
+    for(int i = URING_QUEUE_DEPTH - 1; i >= 0; i--) {
+        m_freeSlots << i;
+    }
+
+    bool stopping = false;
+    bool ringFailed = false;
+    forever {
+        // top the ring up, blocking on the queue only while nothing is in flight
+        while(!stopping && !m_freeSlots.isEmpty()) {
+            CopyJob job;
+            if(!m_engine->takeJob(m_rootIdx, job, m_freeSlots.size() == m_slots.size())) {
+                stopping = !m_engine->isRunning();
+                break;
+            }
+            if(!startJob(job)) {
+                copySync(job);
+            }
+        }
+
+        if(m_freeSlots.size() == m_slots.size()) {
+            if(stopping)
+                break;
+            continue;
+        }
+
+        if(m_ring->submitAndWait(1) < 0 && errno != EAGAIN && errno != EBUSY) {
+            ringFailed = true;
+            break;
+        }
+
+        unsigned head = *m_ring->cqHead;
+        unsigned tail = __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE);
+        for(; head != tail; head++) {
+            const struct io_uring_cqe* cqe = m_ring->cqes + (head & m_ring->cqMask);
+            complete(int(cqe->user_data), cqe->res);
+        }
+        __atomic_store_n(m_ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    // closes that already completed are finished normally, nothing else is advanced
+    unsigned head = *m_ring->cqHead;
+    unsigned tail = __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++) {
+        const struct io_uring_cqe* cqe = m_ring->cqes + (head & m_ring->cqMask);
+        int slotIdx = int(cqe->user_data);
+        if(m_slots.at(slotIdx).state == CLOSING_SLOT)
+            complete(slotIdx, cqe->res);
+    }
+    __atomic_store_n(m_ring->cqHead, head, __ATOMIC_RELEASE);
+
+    // closing the ring cancels whatever the kernel still holds
+    delete m_ring;
+    m_ring = nullptr;
+    for(int i = 0; i < m_slots.size(); i++) {
+        if(m_slots.at(i).state != FREE_SLOT) {
+            // the close may have run already and the number be reused, so it is not closed again
+            if(m_slots.at(i).state == CLOSING_SLOT)
+                m_slots[i].fd = -1;
+            m_slots[i].failed = true;
+            finish(i);
+        }
+    }
+    if(ringFailed) {
+        runSync();
+    }
+#else
+    runSync();
+#endif
+}
+
+// only payloads already in memory go through the ring, and only written the usual way
+bool UringIoBackend::startJob(const CopyJob& job) {
+#ifdef HAVE_IO_URING
+    if(m_engine->getWritePolicy().isEnabled())
+        return false;
+
+    int slotIdx = m_freeSlots.last();
+    Slot& slot = m_slots[slotIdx];
+
+    qint64 size = job.size;
+    const uchar* data = nullptr;
+    if(!job.members.isEmpty()) {
+        if(!m_engine->buildContainer(job, slot.container, m_buffer))
+            return false;
+        data = reinterpret_cast<const uchar*>(slot.container.constData());
+        size = slot.container.size();
+    } else if(!job.synthetic) {
+        data = m_engine->acquireTemplate(job, size);
+        if(!data)
+            return false;
+    }
+    m_freeSlots.removeLast();
+
+    slot.destinationPath = QFile::encodeName(job.destinationPath);
+    slot.publishMode = m_engine->getPublishMode();
+    slot.size = size;
+    slot.infected = job.infected;
+    slot.failed = false;
+    slot.fd = -1;
+    slot.startTimeInNsecs = Metrics::nowInNsecs();
+    slot.data = data;
+    slot.offset = 0;
+
+    slot.mutated = !job.synthetic && job.members.isEmpty() && m_engine->getMutator().isEnabled();
+    if(slot.mutated) {
+        m_engine->getMutator().mutate(job.payloadSeed, data, size, slot.mutation);
+        slot.size = slot.mutation.getSize();
+    }
+
+    slot.synthetic = job.synthetic;
+    if(job.synthetic) {
+        slot.filler.seed(job.payloadSeed);
+        slot.signature = job.signature;
+        slot.signatureOffset = job.signatureOffset;
+        if(slot.chunk.size() < URING_CHUNK_SIZE)
+            slot.chunk.resize(URING_CHUNK_SIZE);
+        slot.chunkOffset = 0;
+        slot.chunkSize = 0;
+    }
+
+    queueOpen(slotIdx);
+    return true;
+#else
+    Q_UNUSED(job);
+    return false;
+#endif
+}
+
+// a tmpfile slot opens the directory, a rename slot the hidden temporary name
+void UringIoBackend::queueOpen(int slotIdx) {
+#ifdef HAVE_IO_URING
+    Slot& slot = m_slots[slotIdx];
+    int flags = O_WRONLY | O_CLOEXEC;
+    if(slot.publishMode == TMPFILE_PUBLISH) {
+        slot.openPath = QFile::encodeName(QFileInfo(QFile::decodeName(slot.destinationPath)).absolutePath());
+        flags |= O_TMPFILE;
+    } else if(slot.publishMode == RENAME_PUBLISH) {
+        slot.openPath = QFile::encodeName(OutputFile::temporaryPath(QFile::decodeName(slot.destinationPath)));
+        flags |= O_CREAT | O_EXCL;
+    } else {
+        slot.openPath = slot.destinationPath;
+        flags |= O_CREAT | O_EXCL;
+    }
+
+    slot.state = OPENING_SLOT;
+    struct io_uring_sqe* sqe = m_ring->nextSqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = quint64(quintptr(slot.openPath.constData()));
+    sqe->len = 0644;
+    sqe->open_flags = quint32(flags);
+    sqe->user_data = quint64(slotIdx);
+#else
+    Q_UNUSED(slotIdx);
+#endif
+}
+
+void UringIoBackend::queueWrite(int slotIdx) {
+#ifdef HAVE_IO_URING
+    Slot& slot = m_slots[slotIdx];
+
+    const uchar* data;
+    qint64 length;
+    if(slot.synthetic) {
+        if(slot.offset >= slot.chunkOffset + slot.chunkSize) {
+            slot.chunkOffset = slot.offset;
+            slot.chunkSize = qMin(qint64(slot.chunk.size()), slot.size - slot.offset);
+            PayloadGenerator::writeChunk(reinterpret_cast<uchar*>(slot.chunk.data()), slot.chunkOffset, slot.chunkSize,
+                                         slot.filler, slot.signature, slot.signatureOffset);
+        }
+        data = reinterpret_cast<const uchar*>(slot.chunk.constData()) + (slot.offset - slot.chunkOffset);
+        length = slot.chunkOffset + slot.chunkSize - slot.offset;
+    } else if(slot.mutated) {
+        length = slot.mutation.segment(slot.offset, data);
+    } else {
+        data = slot.data + slot.offset;
+        length = slot.size - slot.offset;
+    }
+
+    slot.state = WRITING_SLOT;
+    struct io_uring_sqe* sqe = m_ring->nextSqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = slot.fd;
+    sqe->addr = quint64(quintptr(data));
+    sqe->len = unsigned(qMin(length, qint64(URING_MAX_WRITE_SIZE)));
+    sqe->off = quint64(slot.offset);
+    sqe->user_data = quint64(slotIdx);
+#else
+    Q_UNUSED(slotIdx);
+#endif
+}
+
+// per-file syncs go through the ring, batched ones are made at commit
+void UringIoBackend::queueSync(int slotIdx) {
+#ifdef HAVE_IO_URING
+    Slot& slot = m_slots[slotIdx];
+    if(m_engine->getFsyncPolicy() != FILE_FSYNC) {
+        commit(slotIdx);
+        return;
+    }
+
+    slot.state = SYNCING_SLOT;
+    slot.syncStartTimeInNsecs = Metrics::nowInNsecs();
+    struct io_uring_sqe* sqe = m_ring->nextSqe();
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = slot.fd;
+    sqe->user_data = quint64(slotIdx);
+#else
+    Q_UNUSED(slotIdx);
+#endif
+}
+
+// the data is complete: a tmpfile gets its name while the descriptor is still
+// open, a temporary name is renamed once the file is closed
+void UringIoBackend::commit(int slotIdx) {
+    Slot& slot = m_slots[slotIdx];
+    if(m_engine->getFsyncPolicy() == BATCH_FSYNC && !m_engine->sync(slot.fd, m_rootIdx, m_shard))
+        slot.failed = true;
+
+    if(!slot.failed && slot.publishMode == TMPFILE_PUBLISH) {
+        qint64 startTime = Metrics::nowInNsecs();
+        slot.failed = !OutputFile::link(slot.fd, slot.destinationPath);
+        m_shard->addPublish(Metrics::nowInNsecs() - startTime);
+    }
+    queueClose(slotIdx);
+}
+
+void UringIoBackend::queueClose(int slotIdx) {
+#ifdef HAVE_IO_URING
+    Slot& slot = m_slots[slotIdx];
+    slot.state = CLOSING_SLOT;
+    struct io_uring_sqe* sqe = m_ring->nextSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = slot.fd;
+    sqe->user_data = quint64(slotIdx);
+#else
+    Q_UNUSED(slotIdx);
+#endif
+}
+
+// one file moves open -> write (repeated on short writes) -> fsync -> close
+void UringIoBackend::complete(int slotIdx, int result) {
+    Slot& slot = m_slots[slotIdx];
+    switch(slot.state) {
+        case OPENING_SLOT:
+            if(result < 0) {
+                // filesystems without O_TMPFILE get a temporary name instead
+                if(slot.publishMode == TMPFILE_PUBLISH) {
+                    slot.publishMode = RENAME_PUBLISH;
+                    queueOpen(slotIdx);
+                    break;
+                }
+                slot.failed = true;
+                finish(slotIdx);
+                break;
+            }
+            slot.fd = result;
+            if(slot.size > 0) {
+                queueWrite(slotIdx);
+            } else {
+                queueSync(slotIdx);
+            }
+            break;
+        case WRITING_SLOT:
+            if(result <= 0) {
+                slot.failed = true;
+                queueClose(slotIdx);
+                break;
+            }
+            slot.offset += result;
+            if(slot.offset < slot.size) {
+                queueWrite(slotIdx);
+            } else {
+                queueSync(slotIdx);
+            }
+            break;
+        case SYNCING_SLOT:
+            m_shard->addSync(Metrics::nowInNsecs() - slot.syncStartTimeInNsecs);
+            if(result < 0) {
+                slot.failed = true;
+                queueClose(slotIdx);
+            } else {
+                commit(slotIdx);
+            }
+            break;
+        case CLOSING_SLOT:
+            if(result < 0)
+                slot.failed = true;
+            slot.fd = -1;
+            finish(slotIdx);
+            break;
+        default:
+            break;
+    }
+}
+
+void UringIoBackend::finish(int slotIdx) {
+    Slot& slot = m_slots[slotIdx];
+#ifdef HAVE_IO_URING
+    if(slot.fd >= 0) {
+        ::close(slot.fd);
+        slot.fd = -1;
+    }
+#endif
+    if(!slot.failed && slot.publishMode == RENAME_PUBLISH) {
+        qint64 startTime = Metrics::nowInNsecs();
+        slot.failed = !OutputFile::rename(slot.openPath, slot.destinationPath);
+        m_shard->addPublish(Metrics::nowInNsecs() - startTime);
+    }
+
+    if(slot.failed) {
+        // a file that was created but not fully written is not left behind
+        if(slot.state != OPENING_SLOT && slot.publishMode != TMPFILE_PUBLISH)
+            QFile::remove(QFile::decodeName(slot.openPath));
+        m_shard->addFailure();
+    } else {
+        m_shard->addFile(slot.size, slot.infected, Metrics::nowInNsecs() - slot.startTimeInNsecs);
+    }
+    m_engine->finishJob(m_rootIdx);
+
+    slot.container.clear();
+    slot.state = FREE_SLOT;
+    m_freeSlots << slotIdx;
+}
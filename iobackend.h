@@ -0,0 +1,128 @@
+#ifndef IOBACKEND_H
+#define IOBACKEND_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+#include "payloadgenerator.h"
+#include "outputfile.h"
+#include "mutator.h"
+
+#define     URING_QUEUE_DEPTH       64
+#define     URING_CHUNK_SIZE        (256 * 1024)
+#define     URING_MAX_WRITE_SIZE    (1024 * 1024 * 1024)
+
+enum IO_BACKEND {
+    SYNC_IO_BACKEND,
+    URING_IO_BACKEND
+};
+
+class CopyEngine;
+struct CopyJob;
+struct MetricsShard;
+
+// serves the copy jobs of one destination root to one worker thread until the engine stops
+class IoBackend {
+
+protected:
+    CopyEngine* m_engine;
+    MetricsShard* m_shard;
+    int m_rootIdx;
+    QByteArray m_buffer;
+    AlignedBuffer m_directBuffer;
+
+    void copySync(const CopyJob& job);
+    void runSync();
+
+public:
+    IoBackend(CopyEngine* engine, MetricsShard* shard, int rootIdx);
+    virtual ~IoBackend();
+
+    virtual void run() = 0;
+
+    static IoBackend* create(IO_BACKEND type, CopyEngine* engine, MetricsShard* shard, int rootIdx);
+    static bool isSupported(IO_BACKEND type);
+    static QString toString(IO_BACKEND type);
+    static bool parse(const QString& name, IO_BACKEND& type);
+};
+
+// one blocking open/write/close sequence per job, works everywhere
+class SyncIoBackend : public IoBackend {
+
+public:
+    SyncIoBackend(CopyEngine* engine, MetricsShard* shard, int rootIdx);
+
+    void run() override;
+};
+
+// keeps up to URING_QUEUE_DEPTH files in flight from one thread: openat, write,
+// fsync and close of every file go through an io_uring, so a syscall is paid per
+// batch instead of per operation. Only in-memory payloads (cached templates,
+// synthetic files) take the ring, the others are copied synchronously. The
+// atomic publish step (link or rename) and batched syncs are plain calls.
+class UringIoBackend : public IoBackend {
+
+    friend class IoBackend;
+
+    struct Ring;
+
+    enum SLOT_STATE {
+        FREE_SLOT,
+        OPENING_SLOT,
+        WRITING_SLOT,
+        SYNCING_SLOT,
+        CLOSING_SLOT
+    };
+
+    struct Slot {
+        SLOT_STATE state{FREE_SLOT};
+        QByteArray destinationPath;
+        QByteArray openPath;
+        PUBLISH_MODE publishMode{DIRECT_PUBLISH};
+        qint64 size{0};
+        bool infected{false};
+        bool failed{false};
+        int fd{-1};
+        qint64 startTimeInNsecs{0};
+        qint64 syncStartTimeInNsecs{0};
+
+        const uchar* data{nullptr};
+        qint64 offset{0};
+        QByteArray container;
+
+        // a mutated template is written segment by segment from the cache and the patches
+        bool mutated{false};
+        Mutation mutation;
+
+        // synthetic payload is generated chunk by chunk into the slot buffer
+        bool synthetic{false};
+        PayloadFiller filler;
+        const QByteArray* signature{nullptr};
+        qint64 signatureOffset{0};
+        QByteArray chunk;
+        qint64 chunkOffset{0};
+        qint64 chunkSize{0};
+    };
+
+    Ring* m_ring{nullptr};
+    QVector<Slot> m_slots;
+    QVector<int> m_freeSlots;
+
+    bool startJob(const CopyJob& job);
+    void queueOpen(int slotIdx);
+    void queueWrite(int slotIdx);
+    void queueSync(int slotIdx);
+    void commit(int slotIdx);
+    void queueClose(int slotIdx);
+    void complete(int slotIdx, int result);
+    void finish(int slotIdx);
+
+public:
+    UringIoBackend(CopyEngine* engine, MetricsShard* shard, int rootIdx);
+    ~UringIoBackend();
+
+    void run() override;
+};
+
+#endif // IOBACKEND_H
@@ -1,9 +1,19 @@
 #include "widget.h"
+#include "consolerunner.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    if(ConsoleRunner::isRequested(argc, argv)) {
+        QCoreApplication a(argc, argv);
+        ConsoleRunner runner;
+        if(!runner.parseArguments(a.arguments()))
+            return 1;
+        runner.start();
+        return a.exec();
+    }
+
     QApplication a(argc, argv);
     Widget w;
     w.show();
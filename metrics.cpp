@@ -0,0 +1,260 @@
+#include "metrics.h"
+
+#include <QtAlgorithms>
+
+#include <chrono>
+#include <cmath>
+
+MetricsShard::MetricsShard() {
+    reset();
+}
+
+void MetricsShard::reset() {
+    filesCnt.store(0, std::memory_order_relaxed);
+    bytes.store(0, std::memory_order_relaxed);
+    infectedFilesCnt.store(0, std::memory_order_relaxed);
+    failedFilesCnt.store(0, std::memory_order_relaxed);
+    syncsNb.store(0, std::memory_order_relaxed);
+    syncTimeInNsecs.store(0, std::memory_order_relaxed);
+    publishesNb.store(0, std::memory_order_relaxed);
+    publishTimeInNsecs.store(0, std::memory_order_relaxed);
+    detectionsNb.store(0, std::memory_order_relaxed);
+    missedDetectionsNb.store(0, std::memory_order_relaxed);
+    falseDetectionsNb.store(0, std::memory_order_relaxed);
+    for(int i = 0; i < LATENCY_BUCKETS_NB; i++) {
+        latencyBuckets[i].store(0, std::memory_order_relaxed);
+    }
+    latencySumInNsecs.store(0, std::memory_order_relaxed);
+}
+
+// single writer per shard, so a relaxed load + store is enough and cheaper than fetch_add
+static inline void increment(std::atomic<qint64>& counter, qint64 value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void MetricsShard::addFile(qint64 size, bool infected, qint64 latencyInNsecs) {
+    increment(latencyBuckets[Metrics::latencyBucket(latencyInNsecs)], 1);
+    increment(latencySumInNsecs, qMax(latencyInNsecs, qint64(0)));
+    increment(bytes, size);
+    if(infected) {
+        increment(infectedFilesCnt, 1);
+    }
+    increment(filesCnt, 1);
+    if(owner)
+        owner->tick();
+}
+
+void MetricsShard::addFailure() {
+    increment(failedFilesCnt, 1);
+}
+
+void MetricsShard::addSync(qint64 timeInNsecs) {
+    increment(syncTimeInNsecs, timeInNsecs);
+    increment(syncsNb, 1);
+}
+
+void MetricsShard::addPublish(qint64 timeInNsecs) {
+    increment(publishTimeInNsecs, timeInNsecs);
+    increment(publishesNb, 1);
+}
+
+// verdict of a scanner reached over the network against what was sent
+void MetricsShard::addVerdict(bool infected, bool detected) {
+    if(detected) {
+        increment(detectionsNb, 1);
+    }
+    if(infected && !detected) {
+        increment(missedDetectionsNb, 1);
+    } else if(!infected && detected) {
+        increment(falseDetectionsNb, 1);
+    }
+}
+
+void MetricsShard::addLatencyBuckets(QVector<qint64>& buckets) const {
+    buckets.resize(LATENCY_BUCKETS_NB);
+    for(int i = 0; i < LATENCY_BUCKETS_NB; i++) {
+        buckets[i] += latencyBuckets[i].load(std::memory_order_relaxed);
+    }
+}
+
+// -----------------------------------------------------------------------------------------
+
+Metrics::Metrics() {
+    reset();
+}
+
+Metrics::~Metrics() {
+    qDeleteAll(m_shards);
+}
+
+qint64 Metrics::nowInNsecs() {
+    return qint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// log-linear buckets: exact below 16 ns, then 16 sub-buckets per power of two,
+// which keeps every percentile within ~6% of the real value
+int Metrics::latencyBucket(qint64 latencyInNsecs) {
+    if(latencyInNsecs < LATENCY_SUB_BUCKETS_NB)
+        return int(qMax(latencyInNsecs, qint64(0)));
+
+    int exponent = 63 - qCountLeadingZeroBits(quint64(latencyInNsecs));
+    int subBucket = int((latencyInNsecs >> (exponent - 4)) & (LATENCY_SUB_BUCKETS_NB - 1));
+    return (exponent - 3) * LATENCY_SUB_BUCKETS_NB + subBucket;
+}
+
+qint64 Metrics::latencyBucketValue(int bucket) {
+    if(bucket < LATENCY_SUB_BUCKETS_NB)
+        return bucket;
+
+    int exponent = bucket / LATENCY_SUB_BUCKETS_NB + 3;
+    int subBucket = bucket % LATENCY_SUB_BUCKETS_NB;
+    return qint64(LATENCY_SUB_BUCKETS_NB + subBucket) << (exponent - 4);
+}
+
+MetricsShard* Metrics::getShard(int idx) {
+    QWriteLocker locker(&m_shardsLock);
+    while(m_shards.size() <= idx) {
+        m_shards << new MetricsShard;
+        m_shards.last()->owner = this;
+    }
+    return m_shards.at(idx);
+}
+
+int Metrics::getShardsNb() const {
+    QReadLocker locker(&m_shardsLock);
+    return m_shards.size();
+}
+
+void Metrics::reset() {
+    {
+        QReadLocker locker(&m_shardsLock);
+        foreach(MetricsShard* shard, m_shards) {
+            shard->reset();
+        }
+    }
+
+    QMutexLocker locker(&m_historyMutex);
+    m_history.clear();
+    MetricsSample initialSample;
+    initialSample.timeInNsecs = nowInNsecs();
+    m_history << initialSample;
+    m_lastSampleTimeInNsecs.store(initialSample.timeInNsecs, std::memory_order_relaxed);
+}
+
+// the workers tick after every file, so while files are written the history gets a
+// sample every RATE_SAMPLE_INTERVAL however rarely the rates are read. Idle time has
+// nothing to sample, at most the activity of one interval before it is spread over it.
+void Metrics::tick() const {
+    qint64 now = nowInNsecs();
+    qint64 lastSampleTime = m_lastSampleTimeInNsecs.load(std::memory_order_relaxed);
+    if(now - lastSampleTime >= RATE_SAMPLE_INTERVAL &&
+       m_lastSampleTimeInNsecs.compare_exchange_strong(lastSampleTime, now, std::memory_order_relaxed))
+        sample();
+}
+
+MetricsTotals Metrics::getTotals() const {
+    return getTotals(0, -1);
+}
+
+// totals of a group of workers, e.g. the ones writing to one destination root,
+// -1 shards means up to the last one
+MetricsTotals Metrics::getTotals(int firstShardIdx, int shardsNb) const {
+    MetricsTotals totals;
+    QReadLocker locker(&m_shardsLock);
+    foreach(const MetricsShard* shard, m_shards.mid(firstShardIdx, shardsNb)) {
+        totals.filesCnt += shard->filesCnt.load(std::memory_order_relaxed);
+        totals.bytes += shard->bytes.load(std::memory_order_relaxed);
+        totals.infectedFilesCnt += shard->infectedFilesCnt.load(std::memory_order_relaxed);
+        totals.failedFilesCnt += shard->failedFilesCnt.load(std::memory_order_relaxed);
+        totals.syncsNb += shard->syncsNb.load(std::memory_order_relaxed);
+        totals.syncTimeInNsecs += shard->syncTimeInNsecs.load(std::memory_order_relaxed);
+        totals.publishesNb += shard->publishesNb.load(std::memory_order_relaxed);
+        totals.publishTimeInNsecs += shard->publishTimeInNsecs.load(std::memory_order_relaxed);
+        totals.detectionsNb += shard->detectionsNb.load(std::memory_order_relaxed);
+        totals.missedDetectionsNb += shard->missedDetectionsNb.load(std::memory_order_relaxed);
+        totals.falseDetectionsNb += shard->falseDetectionsNb.load(std::memory_order_relaxed);
+        totals.latencySumInNsecs += shard->latencySumInNsecs.load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+// workers and readers drive the history: a sample is stored at most every
+// RATE_SAMPLE_INTERVAL, older than the longest window ones are dropped
+MetricsSample Metrics::sample() const {
+    MetricsTotals totals = getTotals();
+
+    MetricsSample current;
+    current.timeInNsecs = nowInNsecs();
+    current.filesCnt = totals.filesCnt;
+    current.bytes = totals.bytes;
+
+    QMutexLocker locker(&m_historyMutex);
+    if(m_history.isEmpty() || current.timeInNsecs - m_history.last().timeInNsecs >= RATE_SAMPLE_INTERVAL) {
+        m_history << current;
+        m_lastSampleTimeInNsecs.store(current.timeInNsecs, std::memory_order_relaxed);
+    }
+    while(m_history.size() > 2 &&
+          current.timeInNsecs - m_history.at(1).timeInNsecs > RATE_HISTORY_IN_SECS * 1000000000LL) {
+        m_history.removeFirst();
+    }
+    return current;
+}
+
+MetricsSample Metrics::sampleBefore(qint64 timeInNsecs) const {
+    QMutexLocker locker(&m_historyMutex);
+    for(int i = m_history.size() - 1; i >= 0; i--) {
+        if(m_history.at(i).timeInNsecs <= timeInNsecs)
+            return m_history.at(i);
+    }
+    return m_history.isEmpty() ? MetricsSample() : m_history.first();
+}
+
+double Metrics::getFilesRate(int windowInSecs) const {
+    MetricsSample current = sample();
+    MetricsSample previous = sampleBefore(current.timeInNsecs - windowInSecs * 1000000000LL);
+    qint64 periodInNsecs = current.timeInNsecs - previous.timeInNsecs;
+    return periodInNsecs > 0 ? (current.filesCnt - previous.filesCnt) * 1e9 / periodInNsecs : 0.;
+}
+
+double Metrics::getBytesRate(int windowInSecs) const {
+    MetricsSample current = sample();
+    MetricsSample previous = sampleBefore(current.timeInNsecs - windowInSecs * 1000000000LL);
+    qint64 periodInNsecs = current.timeInNsecs - previous.timeInNsecs;
+    return periodInNsecs > 0 ? (current.bytes - previous.bytes) * 1e9 / periodInNsecs : 0.;
+}
+
+QVector<qint64> Metrics::getLatencyBuckets() const {
+    return getLatencyBuckets(0, -1);
+}
+
+QVector<qint64> Metrics::getLatencyBuckets(int firstShardIdx, int shardsNb) const {
+    QVector<qint64> buckets(LATENCY_BUCKETS_NB, 0);
+    QReadLocker locker(&m_shardsLock);
+    foreach(const MetricsShard* shard, m_shards.mid(firstShardIdx, shardsNb)) {
+        shard->addLatencyBuckets(buckets);
+    }
+    return buckets;
+}
+
+qint64 Metrics::getLatencyPercentileInNsecs(double percentile) const {
+    return latencyPercentileInNsecs(getLatencyBuckets(), percentile);
+}
+
+qint64 Metrics::latencyPercentileInNsecs(const QVector<qint64>& buckets, double percentile) {
+    qint64 total = 0;
+    foreach(qint64 bucketCnt, buckets) {
+        total += bucketCnt;
+    }
+    if(!total)
+        return 0;
+
+    qint64 rank = qMax(qint64(1), qint64(std::ceil(percentile * total)));
+    qint64 cumulative = 0;
+    for(int i = 0; i < buckets.size(); i++) {
+        cumulative += buckets.at(i);
+        if(cumulative >= rank)
+            return latencyBucketValue(i);
+    }
+    return latencyBucketValue(buckets.size() - 1);
+}
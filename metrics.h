@@ -0,0 +1,104 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QVector>
+#include <QMutex>
+#include <QReadWriteLock>
+
+#include <atomic>
+
+#define     LATENCY_SUB_BUCKETS_NB      16
+#define     LATENCY_BUCKETS_NB          976
+#define     RATE_SAMPLE_INTERVAL        100000000LL
+#define     RATE_HISTORY_IN_SECS        61
+
+class Metrics;
+
+// counters of one worker thread. Only the owner writes, readers sum all shards,
+// so the copy path never shares a cache line with other workers and takes a lock
+// only for the rate sample it stores once per RATE_SAMPLE_INTERVAL.
+struct MetricsShard {
+    std::atomic<qint64> filesCnt;
+    std::atomic<qint64> bytes;
+    std::atomic<qint64> infectedFilesCnt;
+    std::atomic<qint64> failedFilesCnt;
+    std::atomic<qint64> syncsNb;
+    std::atomic<qint64> syncTimeInNsecs;
+    std::atomic<qint64> publishesNb;
+    std::atomic<qint64> publishTimeInNsecs;
+    std::atomic<qint64> detectionsNb;
+    std::atomic<qint64> missedDetectionsNb;
+    std::atomic<qint64> falseDetectionsNb;
+    std::atomic<qint64> latencyBuckets[LATENCY_BUCKETS_NB];
+    std::atomic<qint64> latencySumInNsecs;
+    const Metrics* owner{nullptr};
+    char padding[64];
+
+    MetricsShard();
+    void reset();
+
+    void addFile(qint64 size, bool infected, qint64 latencyInNsecs);
+    void addFailure();
+    void addSync(qint64 timeInNsecs);
+    void addPublish(qint64 timeInNsecs);
+    void addVerdict(bool infected, bool detected);
+    void addLatencyBuckets(QVector<qint64>& buckets) const;
+};
+
+struct MetricsTotals {
+    qint64 filesCnt{0};
+    qint64 bytes{0};
+    qint64 infectedFilesCnt{0};
+    qint64 failedFilesCnt{0};
+    qint64 syncsNb{0};
+    qint64 syncTimeInNsecs{0};
+    qint64 publishesNb{0};
+    qint64 publishTimeInNsecs{0};
+    qint64 detectionsNb{0};
+    qint64 missedDetectionsNb{0};
+    qint64 falseDetectionsNb{0};
+    qint64 latencySumInNsecs{0};
+};
+
+struct MetricsSample {
+    qint64 timeInNsecs{0};
+    qint64 filesCnt{0};
+    qint64 bytes{0};
+};
+
+class Metrics {
+
+    QVector<MetricsShard*> m_shards;
+    mutable QReadWriteLock m_shardsLock;
+
+    mutable QVector<MetricsSample> m_history;
+    mutable QMutex m_historyMutex;
+    mutable std::atomic<qint64> m_lastSampleTimeInNsecs{0};
+
+    MetricsSample sample() const;
+    MetricsSample sampleBefore(qint64 timeInNsecs) const;
+
+public:
+    Metrics();
+    ~Metrics();
+
+    static qint64 nowInNsecs();
+    static int latencyBucket(qint64 latencyInNsecs);
+    static qint64 latencyBucketValue(int bucket);
+    static qint64 latencyPercentileInNsecs(const QVector<qint64>& buckets, double percentile);
+
+    MetricsShard* getShard(int idx);
+    int getShardsNb() const;
+    void reset();
+    void tick() const;
+
+    MetricsTotals getTotals() const;
+    MetricsTotals getTotals(int firstShardIdx, int shardsNb) const;
+    double getFilesRate(int windowInSecs) const;
+    double getBytesRate(int windowInSecs) const;
+    qint64 getLatencyPercentileInNsecs(double percentile) const;
+    QVector<qint64> getLatencyBuckets() const;
+    QVector<qint64> getLatencyBuckets(int firstShardIdx, int shardsNb) const;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,172 @@
+#include "mutator.h"
+
+#include <QStringList>
+#include <QtEndian>
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <cstring>
+
+#include "payloadgenerator.h"
+
+Mutation::Mutation() {
+}
+
+qint64 Mutation::getSize() const {
+    return m_size;
+}
+
+int Mutation::getPatchesNb() const {
+    return m_patchesNb;
+}
+
+const MutationPatch& Mutation::getPatch(int idx) const {
+    return m_patches[idx];
+}
+
+const uchar* Mutation::getPatchBytes(int idx) const {
+    return m_bytes[idx];
+}
+
+// patches are sorted and don't overlap, so the first one ending after offset decides
+qint64 Mutation::segment(qint64 offset, const uchar*& data) const {
+    for(int i = 0; i < m_patchesNb; i++) {
+        const MutationPatch& patch = m_patches[i];
+        if(offset < patch.offset) {
+            data = m_data + offset;
+            return patch.offset - offset;
+        }
+        if(offset < patch.offset + patch.size) {
+            data = m_bytes[i] + (offset - patch.offset);
+            return patch.offset + patch.size - offset;
+        }
+    }
+    data = m_data + offset;
+    return m_size - offset;
+}
+
+// -----------------------------------------------------------------------------------------
+
+Mutator::Mutator() {
+}
+
+bool Mutator::parse(const QString& spec) {
+    QStringList parts = spec.trimmed().toLower().split(':');
+    QString mode = parts.takeFirst();
+
+    MUTATION_MODE parsedMode;
+    QVector<qint64> offsets;
+    if(mode == "none" || mode.isEmpty()) {
+        parsedMode = NO_MUTATION;
+    } else if(mode == "append") {
+        parsedMode = APPEND_MUTATION;
+    } else if(mode == "overwrite") {
+        parsedMode = OVERWRITE_MUTATION;
+    } else if(mode == "patch" && !parts.isEmpty()) {
+        parsedMode = PATCH_MUTATION;
+        QStringList offsetList = parts.takeFirst().split(',', QString::SkipEmptyParts);
+        if(offsetList.isEmpty() || offsetList.size() > MAX_MUTATION_PATCHES_NB)
+            return false;
+        foreach(const QString& offsetText, offsetList) {
+            bool ok;
+            offsets << offsetText.trimmed().toLongLong(&ok, 0);
+            if(!ok)
+                return false;
+        }
+    } else {
+        return false;
+    }
+
+    int size = DEFAULT_MUTATION_SIZE;
+    if(parsedMode != NO_MUTATION && !parts.isEmpty()) {
+        bool ok;
+        size = parts.takeFirst().toInt(&ok);
+        if(!ok || size < 1 || size > MAX_MUTATION_SIZE)
+            return false;
+    }
+    if(!parts.isEmpty())
+        return false;
+
+    m_mode = parsedMode;
+    m_size = size;
+    m_offsets = offsets;
+    return true;
+}
+
+QString Mutator::toString() const {
+    switch(m_mode) {
+        case APPEND_MUTATION:
+            return QString("append:%1").arg(m_size);
+        case OVERWRITE_MUTATION:
+            return QString("overwrite:%1").arg(m_size);
+        case PATCH_MUTATION: {
+            QStringList offsets;
+            foreach(qint64 offset, m_offsets) {
+                offsets << QString::number(offset);
+            }
+            return QString("patch:%1:%2").arg(offsets.join(',')).arg(m_size);
+        }
+        default:
+            return "none";
+    }
+}
+
+MUTATION_MODE Mutator::getMode() const {
+    return m_mode;
+}
+
+bool Mutator::isEnabled() const {
+    return m_mode != NO_MUTATION;
+}
+
+qint64 Mutator::getOutputSize(qint64 templateSize) const {
+    return m_mode == APPEND_MUTATION ? templateSize + m_size : templateSize;
+}
+
+// data may be null when the template is copied by other means and only the patches are written
+void Mutator::mutate(quint64 seed, const uchar* data, qint64 templateSize, Mutation& mutation) const {
+    mutation.m_data = data;
+    mutation.m_size = getOutputSize(templateSize);
+    mutation.m_patchesNb = 0;
+
+    QVarLengthArray<qint64, MAX_MUTATION_PATCHES_NB> offsets;
+    switch(m_mode) {
+        case APPEND_MUTATION:
+            offsets.append(templateSize);
+            break;
+        case OVERWRITE_MUTATION:
+            offsets.append(templateSize - m_size);
+            break;
+        case PATCH_MUTATION:
+            foreach(qint64 offset, m_offsets) {
+                offsets.append(offset < 0 ? templateSize + offset : offset);
+            }
+            std::sort(offsets.begin(), offsets.end());
+            break;
+        default:
+            return;
+    }
+
+    // patches are kept inside the output and apart from each other
+    PayloadFiller filler(seed);
+    qint64 patchEnd = 0;
+    for(int i = 0; i < offsets.size(); i++) {
+        qint64 offset = qMax(offsets.at(i), patchEnd);
+        int size = int(qMin(qint64(m_size), mutation.m_size - offset));
+        if(size <= 0)
+            continue;
+
+        MutationPatch& patch = mutation.m_patches[mutation.m_patchesNb];
+        patch.offset = offset;
+        patch.size = size;
+        filler.fill(mutation.m_bytes[mutation.m_patchesNb], size);
+        mutation.m_patchesNb++;
+        patchEnd = offset + size;
+    }
+
+    if(mutation.m_patchesNb) {
+        uchar seedBytes[sizeof(seed)];
+        qToLittleEndian(seed, seedBytes);
+        std::memcpy(mutation.m_bytes[0], seedBytes, size_t(qMin(mutation.m_patches[0].size, int(sizeof(seed)))));
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef MUTATOR_H
+#define MUTATOR_H
+
+#include <QString>
+#include <QVector>
+
+#define     DEFAULT_MUTATION_SIZE       16
+#define     MAX_MUTATION_SIZE           256
+#define     MAX_MUTATION_PATCHES_NB     8
+
+enum MUTATION_MODE {
+    NO_MUTATION,
+    APPEND_MUTATION,
+    OVERWRITE_MUTATION,
+    PATCH_MUTATION
+};
+
+struct MutationPatch {
+    qint64 offset{0};
+    int size{0};
+};
+
+// one mutated output: the template bytes with the file's own patches laid over
+// or after them. The template buffer is never modified, writers take the output
+// run by run, so a cached template is written straight from its mapping.
+class Mutation {
+
+    friend class Mutator;
+
+    const uchar* m_data{nullptr};
+    qint64 m_size{0};
+    MutationPatch m_patches[MAX_MUTATION_PATCHES_NB];
+    int m_patchesNb{0};
+    uchar m_bytes[MAX_MUTATION_PATCHES_NB][MAX_MUTATION_SIZE];
+
+public:
+    Mutation();
+
+    qint64 getSize() const;
+    int getPatchesNb() const;
+    const MutationPatch& getPatch(int idx) const;
+    const uchar* getPatchBytes(int idx) const;
+
+    // the longest run of output starting at offset that lies in one buffer
+    qint64 segment(qint64 offset, const uchar*& data) const;
+};
+
+// none, append[:<size>], overwrite[:<size>] or patch:<offset>[,<offset>...][:<size>].
+// Append adds a trailer, overwrite replaces the last bytes, patch replaces bytes
+// at the given offsets (negative ones count from the end) which have to be
+// outside what the scanner's signatures match. The first 8 patch bytes are the
+// file's content seed, distinct for every file of a run, the rest are random.
+class Mutator {
+
+    MUTATION_MODE m_mode{NO_MUTATION};
+    int m_size{DEFAULT_MUTATION_SIZE};
+    QVector<qint64> m_offsets;
+
+public:
+    Mutator();
+
+    bool parse(const QString& spec);
+    QString toString() const;
+    MUTATION_MODE getMode() const;
+    bool isEnabled() const;
+
+    qint64 getOutputSize(qint64 templateSize) const;
+    void mutate(quint64 seed, const uchar* data, qint64 templateSize, Mutation& mutation) const;
+};
+
+#endif // MUTATOR_H
@@ -0,0 +1,459 @@
+#include "networkbackend.h"
+#include "copyengine.h"
+
+#include <QFile>
+#include <QThread>
+#include <QUrl>
+
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define     MSG_NOSIGNAL    0
+#endif
+
+NetworkIoBackend::NetworkIoBackend(CopyEngine* engine, MetricsShard* shard, int rootIdx):
+    IoBackend(engine, shard, rootIdx), m_target(engine->getScanTarget()), m_parser(false) {
+}
+
+NetworkIoBackend::~NetworkIoBackend() {
+    closeSocket();
+}
+
+bool NetworkIoBackend::isSupported() {
+#ifdef Q_OS_UNIX
+    return true;
+#else
+    return false;
+#endif
+}
+
+void NetworkIoBackend::run() {
+#ifdef Q_OS_UNIX
+    int pipelineDepth = m_target.getPipelineDepth();
+    m_requests.resize(pipelineDepth);
+    m_freeRequests.clear();
+    for(int i = pipelineDepth - 1; i >= 0; i--) {
+        m_freeRequests << i;
+    }
+    m_chunk.resize(NETWORK_CHUNK_SIZE);
+    m_receiveBuffer.resize(NETWORK_RECEIVE_SIZE);
+
+    bool stopping = false;
+    forever {
+        // top the pipeline up, blocking on the queue only while nothing is in flight
+        while(!stopping && !m_freeRequests.isEmpty()) {
+            CopyJob job;
+            if(!m_engine->takeJob(m_rootIdx, job, m_pipeline.isEmpty())) {
+                stopping = !m_engine->isRunning();
+                break;
+            }
+            if(!startRequest(job)) {
+                m_shard->addFailure();
+                m_engine->finishJob(m_rootIdx);
+            }
+        }
+
+        if(m_pipeline.isEmpty()) {
+            if(stopping)
+                break;
+            continue;
+        }
+
+        if(m_socket < 0 && !connectToTarget()) {
+            failRequests();
+            QThread::msleep(NETWORK_RECONNECT_DELAY);
+            continue;
+        }
+
+        // with room in the pipeline the queue is checked again soon
+        struct pollfd pollFd;
+        pollFd.fd = m_socket;
+        pollFd.events = short(POLLIN | (m_sentNb < m_pipeline.size() ? POLLOUT : 0));
+        pollFd.revents = 0;
+        int timeout = !stopping && !m_freeRequests.isEmpty() ? NETWORK_POLL_INTERVAL : 1000;
+        if(::poll(&pollFd, 1, timeout) < 0 && errno != EINTR) {
+            dropConnection();
+            continue;
+        }
+
+        bool connected = true;
+        if(pollFd.revents & (POLLIN | POLLHUP | POLLERR))
+            connected = receiveResponses();
+        if(connected && (pollFd.revents & POLLOUT))
+            connected = sendRequests();
+
+        if(!connected) {
+            dropConnection();
+        } else if(!m_pipeline.isEmpty() &&
+                  Metrics::nowInNsecs() - m_lastProgressInNsecs > NETWORK_RESPONSE_TIMEOUT * 1000000LL) {
+            closeSocket();
+            failRequests();
+        }
+    }
+    closeSocket();
+#else
+    CopyJob job;
+    while(m_engine->takeJob(m_rootIdx, job, true)) {
+        m_shard->addFailure();
+        m_engine->finishJob(m_rootIdx);
+    }
+#endif
+}
+
+// the destination path of a network job is only the name the scanner is told
+bool NetworkIoBackend::startRequest(const CopyJob& job) {
+#ifdef Q_OS_UNIX
+    int requestIdx = m_freeRequests.last();
+    Request& request = m_requests[requestIdx];
+
+    request.data = nullptr;
+    request.synthetic = job.synthetic;
+    request.payloadSeed = job.payloadSeed;
+    request.signature = job.signature;
+    request.signatureOffset = job.signatureOffset;
+    request.bodySize = job.size;
+    request.templateSize = job.size;
+
+    if(!job.members.isEmpty()) {
+        if(!m_engine->buildContainer(job, request.container, m_buffer))
+            return false;
+        request.data = reinterpret_cast<const uchar*>(request.container.constData());
+        request.bodySize = request.container.size();
+    } else if(!job.synthetic) {
+        request.data = m_engine->acquireTemplate(job, request.templateSize);
+        if(!request.data) {
+            struct stat sourceStat;
+            request.sourceFd = ::open(QFile::encodeName(job.sourcePath).constData(), O_RDONLY | O_CLOEXEC);
+            if(request.sourceFd < 0 || ::fstat(request.sourceFd, &sourceStat) != 0) {
+                releaseRequest(requestIdx);
+                return false;
+            }
+            request.templateSize = sourceStat.st_size;
+        }
+        request.bodySize = request.templateSize;
+    }
+
+    request.mutated = !job.synthetic && job.members.isEmpty() && m_engine->getMutator().isEnabled();
+    if(request.mutated) {
+        m_engine->getMutator().mutate(job.payloadSeed, request.data, request.templateSize, request.mutation);
+        request.bodySize = request.mutation.getSize();
+    }
+
+    QString name = job.destinationPath.mid(job.destinationPath.lastIndexOf('/') + 1);
+    request.head = m_target.requestHead(name, request.bodySize);
+    request.trailer = m_target.requestTrailer(request.bodySize);
+    request.infected = job.infected;
+    request.retried = false;
+    request.startTimeInNsecs = Metrics::nowInNsecs();
+    rewind(request);
+
+    // an idle connection made no progress, the response timeout starts now
+    if(m_pipeline.isEmpty())
+        m_lastProgressInNsecs = request.startTimeInNsecs;
+    m_freeRequests.removeLast();
+    m_pipeline.enqueue(requestIdx);
+    return true;
+#else
+    Q_UNUSED(job);
+    return false;
+#endif
+}
+
+bool NetworkIoBackend::rewind(Request& request) {
+    request.sentSize = 0;
+    request.chunkOffset = 0;
+    request.chunkSize = 0;
+    if(request.synthetic)
+        request.filler.seed(request.payloadSeed);
+#ifdef Q_OS_UNIX
+    if(request.sourceFd >= 0)
+        return ::lseek(request.sourceFd, 0, SEEK_SET) == 0;
+#endif
+    return true;
+}
+
+// contiguous body bytes at bodyOffset, -1 when the template can't be read
+qint64 NetworkIoBackend::bodySegment(Request& request, qint64 bodyOffset, const uchar*& data) {
+    if(request.data) {
+        if(request.mutated)
+            return request.mutation.segment(bodyOffset, data);
+        data = request.data + bodyOffset;
+        return request.bodySize - bodyOffset;
+    }
+
+    // chunks are made in order, only the request being sent uses the buffer
+    if(bodyOffset < request.chunkOffset || bodyOffset >= request.chunkOffset + request.chunkSize) {
+        request.chunkOffset = bodyOffset;
+        request.chunkSize = qMin(qint64(NETWORK_CHUNK_SIZE), request.bodySize - bodyOffset);
+        if(request.synthetic) {
+            PayloadGenerator::writeChunk(reinterpret_cast<uchar*>(m_chunk.data()), request.chunkOffset, request.chunkSize,
+                                         request.filler, request.signature, request.signatureOffset);
+        } else if(!readChunk(request)) {
+            request.chunkSize = 0;
+            return -1;
+        }
+    }
+    data = reinterpret_cast<const uchar*>(m_chunk.constData()) + (bodyOffset - request.chunkOffset);
+    return request.chunkOffset + request.chunkSize - bodyOffset;
+}
+
+// the template part of the chunk is read, then the patches falling into it are laid over
+bool NetworkIoBackend::readChunk(Request& request) {
+#ifdef Q_OS_UNIX
+    uchar* chunk = reinterpret_cast<uchar*>(m_chunk.data());
+    qint64 readSize = qMin(request.chunkSize, qMax(qint64(0), request.templateSize - request.chunkOffset));
+    for(qint64 done = 0; done < readSize;) {
+        ssize_t result = ::read(request.sourceFd, chunk + done, size_t(readSize - done));
+        if(result <= 0)
+            return false;
+        done += result;
+    }
+
+    for(int i = 0; request.mutated && i < request.mutation.getPatchesNb(); i++) {
+        const MutationPatch& patch = request.mutation.getPatch(i);
+        qint64 from = qMax(patch.offset, request.chunkOffset);
+        qint64 to = qMin(patch.offset + patch.size, request.chunkOffset + request.chunkSize);
+        if(from < to)
+            std::memcpy(chunk + (from - request.chunkOffset), request.mutation.getPatchBytes(i) + (from - patch.offset), size_t(to - from));
+    }
+    return true;
+#else
+    Q_UNUSED(request);
+    return false;
+#endif
+}
+
+// head, body and trailer of a request leave in one sendmsg as long as they are in memory
+bool NetworkIoBackend::sendRequests() {
+#ifdef Q_OS_UNIX
+    while(m_sentNb < m_pipeline.size()) {
+        Request& request = m_requests[m_pipeline.at(m_sentNb)];
+        qint64 headSize = request.head.size();
+        qint64 totalSize = headSize + request.bodySize + request.trailer.size();
+
+        struct iovec segments[NETWORK_SEGMENTS_NB];
+        int segmentsNb = 0;
+        qint64 segmentsSize = 0;
+        for(qint64 offset = request.sentSize; offset < totalSize && segmentsNb < NETWORK_SEGMENTS_NB; segmentsNb++) {
+            const uchar* data;
+            qint64 length;
+            bool chunked = false;
+            if(offset < headSize) {
+                data = reinterpret_cast<const uchar*>(request.head.constData()) + offset;
+                length = headSize - offset;
+            } else if(offset < headSize + request.bodySize) {
+                length = bodySegment(request, offset - headSize, data);
+                if(length < 0)
+                    return false;
+                chunked = !request.data;
+            } else {
+                data = reinterpret_cast<const uchar*>(request.trailer.constData()) + (offset - headSize - request.bodySize);
+                length = totalSize - offset;
+            }
+            segments[segmentsNb].iov_base = const_cast<uchar*>(data);
+            segments[segmentsNb].iov_len = size_t(length);
+            segmentsSize += length;
+            offset += length;
+
+            // the chunk buffer holds one chunk, the next one is made once this is sent
+            if(chunked && offset < headSize + request.bodySize) {
+                segmentsNb++;
+                break;
+            }
+        }
+
+        struct msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = segments;
+        message.msg_iovlen = segmentsNb;
+        ssize_t sent = ::sendmsg(m_socket, &message, MSG_NOSIGNAL);
+        if(sent < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+        request.sentSize += sent;
+        m_lastProgressInNsecs = Metrics::nowInNsecs();
+        if(request.sentSize == totalSize) {
+            m_sentNb++;
+        } else if(sent < segmentsSize) {
+            return true;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+// false once the connection is gone or has to be closed
+bool NetworkIoBackend::receiveResponses() {
+#ifdef Q_OS_UNIX
+    forever {
+        ssize_t received = ::recv(m_socket, m_receiveBuffer.data(), size_t(m_receiveBuffer.size()), 0);
+        if(received < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        if(received == 0) {
+            if(m_parser.finish())
+                completeRequest(m_sentNb == 0);
+            return false;
+        }
+
+        m_lastProgressInNsecs = Metrics::nowInNsecs();
+        for(qint64 used = 0; used < received;) {
+            used += m_parser.parse(m_receiveBuffer.constData() + used, received - used);
+            if(m_parser.isFailed())
+                return false;
+            if(m_parser.isComplete() && !completeRequest(m_sentNb == 0))
+                return false;
+        }
+    }
+#else
+    return false;
+#endif
+}
+
+// the oldest request gets the response. An early one, before the request was
+// fully sent, ends the connection as the rest of the body can't follow it.
+bool NetworkIoBackend::completeRequest(bool early) {
+    int status = m_parser.getStatus();
+    if(status >= 100 && status < 200) {
+        m_parser.reset();
+        return true;
+    }
+    if(m_pipeline.isEmpty())
+        return false;
+
+    int requestIdx = m_pipeline.dequeue();
+    m_sentNb = qMax(0, m_sentNb - 1);
+    const Request& request = m_requests.at(requestIdx);
+
+    SCAN_VERDICT verdict = ScanTarget::verdict(m_parser);
+    if(verdict == ERROR_VERDICT) {
+        m_shard->addFailure();
+    } else {
+        m_shard->addFile(request.bodySize, request.infected, Metrics::nowInNsecs() - request.startTimeInNsecs);
+        m_shard->addVerdict(request.infected, verdict == INFECTED_VERDICT);
+    }
+    releaseRequest(requestIdx);
+    m_engine->finishJob(m_rootIdx);
+
+    bool keepAlive = m_parser.keepsAlive();
+    m_parser.reset();
+    return keepAlive && !early;
+}
+
+void NetworkIoBackend::releaseRequest(int requestIdx) {
+    Request& request = m_requests[requestIdx];
+#ifdef Q_OS_UNIX
+    if(request.sourceFd >= 0)
+        ::close(request.sourceFd);
+#endif
+    request.sourceFd = -1;
+    request.container.clear();
+    request.data = nullptr;
+    if(!m_freeRequests.contains(requestIdx))
+        m_freeRequests << requestIdx;
+}
+
+void NetworkIoBackend::failRequests() {
+    while(!m_pipeline.isEmpty()) {
+        releaseRequest(m_pipeline.dequeue());
+        m_shard->addFailure();
+        m_engine->finishJob(m_rootIdx);
+    }
+    m_sentNb = 0;
+    m_parser.reset();
+}
+
+// blocking resolve, non-blocking connect bounded by NETWORK_CONNECT_TIMEOUT
+bool NetworkIoBackend::connectToTarget() {
+#ifdef Q_OS_UNIX
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addresses = nullptr;
+    if(::getaddrinfo(QUrl::toAce(m_target.getHost()).constData(), QByteArray::number(m_target.getPort()).constData(),
+                     &hints, &addresses) != 0)
+        return false;
+
+    for(struct addrinfo* address = addresses; address && m_socket < 0; address = address->ai_next) {
+        m_socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if(m_socket < 0)
+            continue;
+        ::fcntl(m_socket, F_SETFD, FD_CLOEXEC);
+        ::fcntl(m_socket, F_SETFL, ::fcntl(m_socket, F_GETFL) | O_NONBLOCK);
+
+        bool connected = ::connect(m_socket, address->ai_addr, address->ai_addrlen) == 0;
+        if(!connected && errno == EINPROGRESS) {
+            struct pollfd pollFd;
+            pollFd.fd = m_socket;
+            pollFd.events = POLLOUT;
+            pollFd.revents = 0;
+            int error = 0;
+            socklen_t errorSize = sizeof(error);
+            connected = ::poll(&pollFd, 1, NETWORK_CONNECT_TIMEOUT) == 1 &&
+                        ::getsockopt(m_socket, SOL_SOCKET, SO_ERROR, &error, &errorSize) == 0 && !error;
+        }
+        if(!connected)
+            closeSocket();
+    }
+    ::freeaddrinfo(addresses);
+    if(m_socket < 0)
+        return false;
+
+    // heads are small and pipelined requests should not wait for each other's acks
+    int enabled = 1;
+    ::setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+#ifdef SO_NOSIGPIPE
+    ::setsockopt(m_socket, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+    m_lastProgressInNsecs = Metrics::nowInNsecs();
+    return true;
+#else
+    return false;
+#endif
+}
+
+// requests that had started to go out are sent again on the next connection,
+// unless it already happened to them once
+void NetworkIoBackend::dropConnection() {
+    closeSocket();
+    m_parser.reset();
+    m_sentNb = 0;
+
+    QQueue<int> pipeline;
+    pipeline.swap(m_pipeline);
+    foreach(int requestIdx, pipeline) {
+        Request& request = m_requests[requestIdx];
+        bool started = request.sentSize > 0;
+        if(started && (request.retried || !rewind(request))) {
+            releaseRequest(requestIdx);
+            m_shard->addFailure();
+            m_engine->finishJob(m_rootIdx);
+            continue;
+        }
+        request.retried = request.retried || started;
+        m_pipeline.enqueue(requestIdx);
+    }
+}
+
+void NetworkIoBackend::closeSocket() {
+#ifdef Q_OS_UNIX
+    if(m_socket >= 0)
+        ::close(m_socket);
+#endif
+    m_socket = -1;
+}
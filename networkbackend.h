@@ -0,0 +1,90 @@
+#ifndef NETWORKBACKEND_H
+#define NETWORKBACKEND_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QQueue>
+
+#include "iobackend.h"
+#include "scanprotocol.h"
+
+#define     NETWORK_CHUNK_SIZE          (256 * 1024)
+#define     NETWORK_RECEIVE_SIZE        (64 * 1024)
+#define     NETWORK_SEGMENTS_NB         32
+#define     NETWORK_POLL_INTERVAL       10
+#define     NETWORK_CONNECT_TIMEOUT     5000
+#define     NETWORK_RESPONSE_TIMEOUT    30000
+#define     NETWORK_RECONNECT_DELAY     100
+
+// delivers the jobs of a worker to the scan target over one keep-alive connection
+// instead of writing files. Up to the pipeline depth requests are in flight, sent
+// in order and answered in order. Cached templates and containers are sent with
+// sendmsg straight from memory, synthetic payload and uncached templates go
+// through a chunk buffer. A request cut by a closed connection is sent again once
+// on the next one, a second cut or no answer within NETWORK_RESPONSE_TIMEOUT
+// counts it as failed. Latency runs from taking the job to the verdict.
+class NetworkIoBackend : public IoBackend {
+
+    struct Request {
+        QByteArray head;
+        QByteArray trailer;
+        qint64 bodySize{0};
+        qint64 sentSize{0};
+        bool infected{false};
+        bool retried{false};
+        qint64 startTimeInNsecs{0};
+
+        const uchar* data{nullptr};
+        QByteArray container;
+
+        // mutation patches of a cached template, or overlaid on chunks of an uncached one
+        bool mutated{false};
+        Mutation mutation;
+
+        // synthetic payload is generated and uncached templates are read chunk by chunk
+        bool synthetic{false};
+        quint64 payloadSeed{0};
+        PayloadFiller filler;
+        const QByteArray* signature{nullptr};
+        qint64 signatureOffset{0};
+        int sourceFd{-1};
+        qint64 templateSize{0};
+        qint64 chunkOffset{0};
+        qint64 chunkSize{0};
+    };
+
+    ScanTarget m_target;
+    int m_socket{-1};
+    QVector<Request> m_requests;
+    QVector<int> m_freeRequests;
+    QQueue<int> m_pipeline;
+    int m_sentNb{0};
+    QByteArray m_chunk;
+    QByteArray m_receiveBuffer;
+    MessageParser m_parser;
+    qint64 m_lastProgressInNsecs{0};
+
+    bool startRequest(const CopyJob& job);
+    bool rewind(Request& request);
+    qint64 bodySegment(Request& request, qint64 bodyOffset, const uchar*& data);
+    bool readChunk(Request& request);
+    bool sendRequests();
+    bool receiveResponses();
+    bool completeRequest(bool early);
+    void releaseRequest(int requestIdx);
+    void failRequests();
+    bool connectToTarget();
+    void dropConnection();
+    void closeSocket();
+
+public:
+    NetworkIoBackend(CopyEngine* engine, MetricsShard* shard, int rootIdx);
+    ~NetworkIoBackend();
+
+    void run() override;
+
+    static bool isSupported();
+};
+
+#endif // NETWORKBACKEND_H
@@ -0,0 +1,402 @@
+#include "outputfile.h"
+
+#include <QFileInfo>
+#include <QStringList>
+
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+WritePolicy::WritePolicy() {
+}
+
+bool WritePolicy::parse(const QString& spec) {
+    bool preallocating = false;
+    bool direct = false;
+    bool evicting = false;
+    if(spec.trimmed() != "none") {
+        foreach(const QString& item, spec.split(',')) {
+            QString flag = item.trimmed();
+            if(flag == "prealloc") {
+                preallocating = true;
+            } else if(flag == "direct") {
+                direct = true;
+            } else if(flag == "evict") {
+                evicting = true;
+            } else if(!flag.isEmpty()) {
+                return false;
+            }
+        }
+    }
+
+    m_preallocating = preallocating;
+    m_direct = direct;
+    m_evicting = evicting;
+    return true;
+}
+
+QString WritePolicy::toString() const {
+    QStringList flags;
+    if(m_preallocating)
+        flags << "prealloc";
+    if(m_direct)
+        flags << "direct";
+    if(m_evicting)
+        flags << "evict";
+    return flags.isEmpty() ? QString("none") : flags.join(',');
+}
+
+bool WritePolicy::isEnabled() const {
+    return m_preallocating || m_direct || m_evicting || m_chunkSize;
+}
+
+bool WritePolicy::isPreallocating() const {
+    return m_preallocating;
+}
+
+bool WritePolicy::isDirect() const {
+    return m_direct;
+}
+
+bool WritePolicy::isEvicting() const {
+    return m_evicting;
+}
+
+void WritePolicy::setChunkSize(qint64 chunkSize) {
+    m_chunkSize = qBound(qint64(0), chunkSize, qint64(MAX_WRITE_CHUNK_SIZE));
+}
+
+qint64 WritePolicy::getChunkSize() const {
+    return m_chunkSize;
+}
+
+// direct writes need whole aligned blocks, the chunk is rounded up to one
+qint64 WritePolicy::getDirectBufferSize() const {
+    if(!m_chunkSize)
+        return DEFAULT_DIRECT_BUFFER_SIZE;
+    return (m_chunkSize + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+}
+
+bool WritePolicy::isSupported() {
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+// -----------------------------------------------------------------------------------------
+
+AlignedBuffer::AlignedBuffer() {
+}
+
+AlignedBuffer::~AlignedBuffer() {
+    qFreeAligned(m_data);
+}
+
+bool AlignedBuffer::reserve(qint64 size) {
+    if(m_size >= size)
+        return true;
+
+    qFreeAligned(m_data);
+    m_data = static_cast<char*>(qMallocAligned(size_t(size), DIRECT_IO_ALIGNMENT));
+    m_size = m_data ? size : 0;
+    return m_data;
+}
+
+char* AlignedBuffer::data() {
+    return m_data;
+}
+
+qint64 AlignedBuffer::size() const {
+    return m_size;
+}
+
+// -----------------------------------------------------------------------------------------
+
+OutputFile::OutputFile() {
+}
+
+OutputFile::~OutputFile() {
+    discard();
+}
+
+void OutputFile::setWritePolicy(const WritePolicy& policy, AlignedBuffer* directBuffer) {
+    m_directRequested = policy.isDirect() && directBuffer && directBuffer->size() >= DIRECT_IO_ALIGNMENT;
+    m_chunkSize = policy.getChunkSize();
+    m_directBuffer = directBuffer;
+}
+
+bool OutputFile::open(const QString& path, PUBLISH_MODE mode) {
+    m_path = path;
+    m_mode = mode;
+
+    if(mode == TMPFILE_PUBLISH) {
+#ifdef Q_OS_LINUX
+        QByteArray dirPath = QFile::encodeName(QFileInfo(path).absolutePath());
+        int fd = ::open(dirPath.constData(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+        if(fd >= 0) {
+            if(m_file.open(fd, QIODevice::WriteOnly | QIODevice::Unbuffered, QFileDevice::AutoCloseHandle))
+                return startWriting();
+            ::close(fd);
+            return false;
+        }
+#endif
+        m_mode = RENAME_PUBLISH;
+    }
+
+    m_file.setFileName(m_mode == RENAME_PUBLISH ? temporaryPath(path) : path);
+    return m_file.open(QIODevice::WriteOnly | QIODevice::NewOnly | QIODevice::Unbuffered) && startWriting();
+}
+
+// O_DIRECT can only be switched on once the file is open. Filesystems that
+// refuse it (tmpfs before 6.6) get buffered writes.
+bool OutputFile::startWriting() {
+    m_direct = false;
+    m_stagedSize = 0;
+#ifdef Q_OS_LINUX
+    if(m_directRequested) {
+        int flags = ::fcntl(m_file.handle(), F_GETFL);
+        m_direct = flags >= 0 && ::fcntl(m_file.handle(), F_SETFL, flags | O_DIRECT) == 0;
+    }
+#endif
+    return true;
+}
+
+bool OutputFile::write(const char* data, qint64 size) {
+    return m_direct ? writeDirect(data, size) : writeChunked(data, size);
+}
+
+bool OutputFile::writeChunked(const char* data, qint64 size) {
+    qint64 chunkSize = m_chunkSize ? m_chunkSize : size;
+    for(qint64 offset = 0; offset < size; offset += chunkSize) {
+        qint64 length = qMin(chunkSize, size - offset);
+        if(m_file.write(data + offset, length) != length)
+            return false;
+    }
+    return true;
+}
+
+// whole aligned blocks go out straight from the caller's memory when it is
+// aligned (mapped templates are), through the aligned buffer otherwise
+bool OutputFile::writeDirect(const char* data, qint64 size) {
+    qint64 bufferSize = m_directBuffer->size() / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    while(size > 0) {
+        if(!m_stagedSize && quintptr(data) % DIRECT_IO_ALIGNMENT == 0 && size >= DIRECT_IO_ALIGNMENT) {
+            qint64 length = qMin(size, bufferSize) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+            if(m_file.write(data, length) != length)
+                return false;
+            data += length;
+            size -= length;
+            continue;
+        }
+
+        qint64 length = qMin(size, bufferSize - m_stagedSize);
+        std::memcpy(m_directBuffer->data() + m_stagedSize, data, size_t(length));
+        m_stagedSize += length;
+        data += length;
+        size -= length;
+        if(m_stagedSize == bufferSize) {
+            if(m_file.write(m_directBuffer->data(), bufferSize) != bufferSize)
+                return false;
+            m_stagedSize = 0;
+        }
+    }
+    return true;
+}
+
+// the tail that doesn't fill an aligned block is written without O_DIRECT
+bool OutputFile::flush() {
+    if(!m_direct)
+        return true;
+
+    m_direct = false;
+#ifdef Q_OS_LINUX
+    int flags = ::fcntl(m_file.handle(), F_GETFL);
+    if(flags < 0 || ::fcntl(m_file.handle(), F_SETFL, flags & ~O_DIRECT) < 0)
+        return false;
+#endif
+    bool flushed = !m_stagedSize || m_file.write(m_directBuffer->data(), m_stagedSize) == m_stagedSize;
+    m_stagedSize = 0;
+    return flushed;
+}
+
+bool OutputFile::writeAt(qint64 offset, const char* data, qint64 size) {
+    return flush() && m_file.seek(offset) && write(data, size);
+}
+
+// drops what was written so far, e.g. before retrying a failed in-kernel copy
+bool OutputFile::truncate() {
+    m_stagedSize = 0;
+    return flush() && m_file.resize(0) && m_file.seek(0);
+}
+
+// the blocks are reserved without changing the size, so a shorter file has no hole at its end
+void OutputFile::preallocate(qint64 size) {
+#ifdef Q_OS_LINUX
+    if(size > 0)
+        ::fallocate(m_file.handle(), FALLOC_FL_KEEP_SIZE, 0, off_t(size));
+#else
+    Q_UNUSED(size);
+#endif
+}
+
+// written back and waited for first, dirty pages can't be dropped
+void OutputFile::evict() {
+#ifdef Q_OS_LINUX
+    int fd = m_file.handle();
+    ::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
+int OutputFile::handle() const {
+    return m_file.handle();
+}
+
+qint64 OutputFile::size() const {
+    return m_file.size();
+}
+
+PUBLISH_MODE OutputFile::getMode() const {
+    return m_mode;
+}
+
+bool OutputFile::isDirect() const {
+    return m_direct;
+}
+
+qint64 OutputFile::getChunkSize() const {
+    return m_chunkSize;
+}
+
+bool OutputFile::commit() {
+    bool committed = m_file.isOpen() && flush();
+    switch(m_mode) {
+        case TMPFILE_PUBLISH:
+            committed = committed && link(m_file.handle(), QFile::encodeName(m_path));
+            m_file.close();
+            break;
+        case RENAME_PUBLISH:
+            m_file.close();
+            committed = committed && rename(QFile::encodeName(m_file.fileName()), QFile::encodeName(m_path));
+            if(!committed)
+                QFile::remove(m_file.fileName());
+            break;
+        default:
+            m_file.close();
+            break;
+    }
+    return committed;
+}
+
+// an O_TMPFILE inode without a name goes away with its descriptor
+void OutputFile::discard() {
+    if(!m_file.isOpen())
+        return;
+
+    m_file.close();
+    if(m_mode != TMPFILE_PUBLISH)
+        QFile::remove(m_file.fileName());
+}
+
+QString OutputFile::temporaryPath(const QString& path) {
+    int nameIdx = path.lastIndexOf('/') + 1;
+    return path.left(nameIdx) + TEMPORARY_FILE_PREFIX + path.mid(nameIdx) + TEMPORARY_FILE_SUFFIX;
+}
+
+bool OutputFile::isTemporaryName(const QByteArray& fileName) {
+    return fileName.startsWith(TEMPORARY_FILE_PREFIX) && fileName.endsWith(TEMPORARY_FILE_SUFFIX);
+}
+
+// destination names are unique, so a plain rename never replaces anything
+bool OutputFile::rename(const QByteArray& fromPath, const QByteArray& toPath) {
+#ifdef Q_OS_UNIX
+    return ::rename(fromPath.constData(), toPath.constData()) == 0;
+#else
+    return QFile::rename(QFile::decodeName(fromPath), QFile::decodeName(toPath));
+#endif
+}
+
+// linkat with AT_EMPTY_PATH needs CAP_DAC_READ_SEARCH, the /proc link works for everyone
+bool OutputFile::link(int fd, const QByteArray& path) {
+#ifdef Q_OS_LINUX
+    QByteArray fdPath = "/proc/self/fd/" + QByteArray::number(fd);
+    return ::linkat(AT_FDCWD, fdPath.constData(), AT_FDCWD, path.constData(), AT_SYMLINK_FOLLOW) == 0;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(path);
+    return false;
+#endif
+}
+
+// both are no-ops where there is nothing to call
+bool OutputFile::syncFile(int fd) {
+#ifdef Q_OS_UNIX
+    return ::fsync(fd) == 0;
+#else
+    Q_UNUSED(fd);
+    return true;
+#endif
+}
+
+// flushes the whole filesystem holding fd: one call covers every file written since the last one
+bool OutputFile::syncFileSystem(int fd) {
+#ifdef Q_OS_LINUX
+    return ::syncfs(fd) == 0;
+#else
+    return syncFile(fd);
+#endif
+}
+
+QString OutputFile::toString(PUBLISH_MODE mode) {
+    switch(mode) {
+        case RENAME_PUBLISH:
+            return "rename";
+        case TMPFILE_PUBLISH:
+            return "tmpfile";
+        default:
+            return "direct";
+    }
+}
+
+bool OutputFile::parse(const QString& name, PUBLISH_MODE& mode) {
+    if(name == "direct") {
+        mode = DIRECT_PUBLISH;
+    } else if(name == "rename") {
+        mode = RENAME_PUBLISH;
+    } else if(name == "tmpfile") {
+        mode = TMPFILE_PUBLISH;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+QString OutputFile::toString(FSYNC_POLICY policy) {
+    switch(policy) {
+        case FILE_FSYNC:
+            return "file";
+        case BATCH_FSYNC:
+            return "batch";
+        default:
+            return "none";
+    }
+}
+
+bool OutputFile::parse(const QString& name, FSYNC_POLICY& policy) {
+    if(name == "none") {
+        policy = NO_FSYNC;
+    } else if(name == "file") {
+        policy = FILE_FSYNC;
+    } else if(name == "batch") {
+        policy = BATCH_FSYNC;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,138 @@
+#ifndef OUTPUTFILE_H
+#define OUTPUTFILE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+
+#define     TEMPORARY_FILE_PREFIX       "."
+#define     TEMPORARY_FILE_SUFFIX       ".tmp"
+#define     DEFAULT_FSYNC_INTERVAL      1000
+#define     DIRECT_IO_ALIGNMENT         4096
+#define     DEFAULT_DIRECT_BUFFER_SIZE  (1024 * 1024)
+#define     MAX_WRITE_CHUNK_SIZE        (64 * 1024 * 1024)
+
+enum PUBLISH_MODE {
+    DIRECT_PUBLISH,
+    RENAME_PUBLISH,
+    TMPFILE_PUBLISH
+};
+
+enum FSYNC_POLICY {
+    NO_FSYNC,
+    FILE_FSYNC,
+    BATCH_FSYNC
+};
+
+// how file data reaches the storage: prealloc reserves the blocks of the known
+// size with fallocate first, direct writes with O_DIRECT in aligned blocks
+// around the page cache, evict writes the file back with sync_file_range and
+// drops it from the page cache before publishing, so the scanner reads from the
+// disk. The chunk size splits the writes, 0 writes whole buffers (and direct
+// writes in DEFAULT_DIRECT_BUFFER_SIZE blocks). Linux only.
+class WritePolicy {
+
+    bool m_preallocating{false};
+    bool m_direct{false};
+    bool m_evicting{false};
+    qint64 m_chunkSize{0};
+
+public:
+    WritePolicy();
+
+    // none, or a comma-separated list of prealloc, direct and evict
+    bool parse(const QString& spec);
+    QString toString() const;
+    bool isEnabled() const;
+
+    bool isPreallocating() const;
+    bool isDirect() const;
+    bool isEvicting() const;
+
+    void setChunkSize(qint64 chunkSize);
+    qint64 getChunkSize() const;
+    qint64 getDirectBufferSize() const;
+
+    static bool isSupported();
+};
+
+// aligned memory for O_DIRECT writes, kept by every worker for its whole run
+class AlignedBuffer {
+
+    char* m_data{nullptr};
+    qint64 m_size{0};
+
+    Q_DISABLE_COPY(AlignedBuffer)
+
+public:
+    AlignedBuffer();
+    ~AlignedBuffer();
+
+    bool reserve(qint64 size);
+    char* data();
+    qint64 size() const;
+};
+
+// a destination file being written. Direct files are created under their final
+// name. In the atomic modes the data goes to a hidden ".<name>.tmp" next to it,
+// or to an anonymous O_TMPFILE inode, and commit() renames or links it into
+// place, so a watcher never sees a partially written file under its final name.
+// Without O_TMPFILE support (not Linux, or the filesystem) the temporary name is used.
+class OutputFile {
+
+    QFile m_file;
+    QString m_path;
+    PUBLISH_MODE m_mode{DIRECT_PUBLISH};
+
+    bool m_directRequested{false};
+    bool m_direct{false};
+    qint64 m_chunkSize{0};
+    AlignedBuffer* m_directBuffer{nullptr};
+    qint64 m_stagedSize{0};
+
+    bool startWriting();
+    bool writeChunked(const char* data, qint64 size);
+    bool writeDirect(const char* data, qint64 size);
+
+public:
+    OutputFile();
+    ~OutputFile();
+
+    // before open(), the buffer is only needed by direct writes
+    void setWritePolicy(const WritePolicy& policy, AlignedBuffer* directBuffer);
+
+    bool open(const QString& path, PUBLISH_MODE mode);
+    bool write(const char* data, qint64 size);
+    bool writeAt(qint64 offset, const char* data, qint64 size);
+    bool truncate();
+    int handle() const;
+    qint64 size() const;
+    PUBLISH_MODE getMode() const;
+    bool isDirect() const;
+    qint64 getChunkSize() const;
+
+    // best effort, filesystems without support are written as usual
+    void preallocate(qint64 size);
+    void evict();
+    // writes out what direct writes still hold, the file is buffered afterwards
+    bool flush();
+
+    // closes the file under its final name
+    bool commit();
+    // closes and removes an uncommitted file
+    void discard();
+
+    static QString temporaryPath(const QString& path);
+    static bool isTemporaryName(const QByteArray& fileName);
+    static bool rename(const QByteArray& fromPath, const QByteArray& toPath);
+    static bool link(int fd, const QByteArray& path);
+    static bool syncFile(int fd);
+    static bool syncFileSystem(int fd);
+
+    static QString toString(PUBLISH_MODE mode);
+    static bool parse(const QString& name, PUBLISH_MODE& mode);
+    static QString toString(FSYNC_POLICY policy);
+    static bool parse(const QString& name, FSYNC_POLICY& policy);
+};
+
+#endif // OUTPUTFILE_H
@@ -0,0 +1,241 @@
+#include "payloadgenerator.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+static quint64 splitMix64(quint64& state) {
+    quint64 z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+SizeDistribution::SizeDistribution() {
+}
+
+qint64 SizeDistribution::parseSize(QString value, bool* ok) {
+    qint64 multiplier = 1;
+    value = value.trimmed().toUpper();
+    if(value.endsWith("B"))
+        value.chop(1);
+
+    if(value.endsWith("K")) {
+        multiplier = 1024;
+    } else if(value.endsWith("M")) {
+        multiplier = 1024 * 1024;
+    } else if(value.endsWith("G")) {
+        multiplier = 1024 * 1024 * 1024;
+    }
+    if(multiplier > 1)
+        value.chop(1);
+
+    return qint64(value.toDouble(ok) * multiplier);
+}
+
+bool SizeDistribution::loadHistogram(const QString& fileName) {
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    m_bucketBounds.clear();
+    m_bucketCumulativeWeights.clear();
+
+    double totalWeight = 0.;
+    QTextStream in(&file);
+    while(!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList fields = line.replace(',', ' ').replace(';', ' ').simplified().split(' ');
+        if(fields.size() < 2)
+            return false;
+
+        bool boundOk, weightOk;
+        qint64 bound = parseSize(fields.at(0), &boundOk);
+        double weight = fields.at(1).toDouble(&weightOk);
+        if(!boundOk || !weightOk || bound < 1 || weight < 0. ||
+           (m_bucketBounds.size() && bound <= m_bucketBounds.last()))
+            return false;
+
+        totalWeight += weight;
+        m_bucketBounds << bound;
+        m_bucketCumulativeWeights << totalWeight;
+    }
+    return m_bucketBounds.size() && totalWeight > 0.;
+}
+
+bool SizeDistribution::parse(const QString& spec) {
+    QStringList fields = spec.split(':');
+    QString type = fields.takeFirst().toLower();
+    bool ok = false, secondOk = false;
+
+    if(type == "fixed" && fields.size() == 1) {
+        m_type = FIXED_SIZE;
+        m_fixedSize = parseSize(fields.at(0), &ok);
+        return ok && m_fixedSize > 0;
+    }
+
+    if(type == "uniform" && fields.size() == 2) {
+        m_type = UNIFORM_SIZE;
+        m_minSize = parseSize(fields.at(0), &ok);
+        m_maxSize = parseSize(fields.at(1), &secondOk);
+        return ok && secondOk && m_minSize > 0 && m_minSize <= m_maxSize;
+    }
+
+    if(type == "lognormal" && fields.size() == 2) {
+        m_type = LOG_NORMAL_SIZE;
+        qint64 median = parseSize(fields.at(0), &ok);
+        m_logNormalSigma = fields.at(1).toDouble(&secondOk);
+        m_logNormalMu = std::log(double(qMax(median, qint64(1))));
+        return ok && secondOk && median > 0 && m_logNormalSigma >= 0.;
+    }
+
+    if(type == "histogram" && fields.size() >= 1) {
+        m_type = HISTOGRAM_SIZE;
+        return loadHistogram(fields.join(':'));
+    }
+
+    return false;
+}
+
+QString SizeDistribution::toString() const {
+    switch(m_type) {
+        case FIXED_SIZE:
+            return QString("fixed %1 bytes").arg(m_fixedSize);
+        case UNIFORM_SIZE:
+            return QString("uniform %1..%2 bytes").arg(m_minSize).arg(m_maxSize);
+        case LOG_NORMAL_SIZE:
+            return QString("log-normal, median %1 bytes, sigma %2").arg(qint64(std::exp(m_logNormalMu))).arg(m_logNormalSigma);
+        case HISTOGRAM_SIZE:
+            return QString("histogram, %1 buckets").arg(m_bucketBounds.size());
+    }
+    return QString();
+}
+
+SIZE_DISTRIBUTION SizeDistribution::getType() const {
+    return m_type;
+}
+
+qint64 SizeDistribution::nextSize(QRandomGenerator& rng) const {
+    switch(m_type) {
+        case FIXED_SIZE:
+            return m_fixedSize;
+
+        case UNIFORM_SIZE:
+            return m_minSize + qint64(rng.bounded(double(m_maxSize - m_minSize + 1)));
+
+        case LOG_NORMAL_SIZE: {
+            std::lognormal_distribution<double> distribution(m_logNormalMu, m_logNormalSigma);
+            return qBound(qint64(1), qint64(distribution(rng)), qint64(1) << 40);
+        }
+
+        case HISTOGRAM_SIZE: {
+            double point = rng.bounded(m_bucketCumulativeWeights.last());
+            int bucket = int(std::upper_bound(m_bucketCumulativeWeights.constBegin(),
+                                              m_bucketCumulativeWeights.constEnd(), point) - m_bucketCumulativeWeights.constBegin());
+            bucket = qMin(bucket, m_bucketBounds.size() - 1);
+            qint64 lowerBound = bucket ? m_bucketBounds.at(bucket - 1) + 1 : 1;
+            return lowerBound + qint64(rng.bounded(double(m_bucketBounds.at(bucket) - lowerBound + 1)));
+        }
+    }
+    return DEFAULT_SYNTHETIC_FILE_SIZE;
+}
+
+// -----------------------------------------------------------------------------------------
+
+PayloadFiller::PayloadFiller(quint64 seed) {
+    this->seed(seed);
+}
+
+void PayloadFiller::seed(quint64 seed) {
+    for(int lane = 0; lane < 4; lane++) {
+        m_s0[lane] = splitMix64(seed);
+        m_s1[lane] = splitMix64(seed);
+    }
+}
+
+void PayloadFiller::fill(uchar* data, qint64 size) {
+    quint64 block[4];
+
+    while(size > 0) {
+        for(int lane = 0; lane < 4; lane++) {
+            quint64 s1 = m_s0[lane];
+            const quint64 s0 = m_s1[lane];
+            m_s0[lane] = s0;
+            s1 ^= s1 << 23;
+            m_s1[lane] = s1 ^ s0 ^ (s1 >> 18) ^ (s0 >> 5);
+            block[lane] = m_s1[lane] + s0;
+        }
+
+        qint64 blockSize = qMin(size, qint64(sizeof(block)));
+        std::memcpy(data, block, size_t(blockSize));
+        data += blockSize;
+        size -= blockSize;
+    }
+}
+
+// -----------------------------------------------------------------------------------------
+
+PayloadGenerator::PayloadGenerator() {
+}
+
+void PayloadGenerator::setSizeDistribution(const SizeDistribution& sizeDistribution) {
+    m_sizeDistribution = sizeDistribution;
+}
+
+const SizeDistribution& PayloadGenerator::getSizeDistribution() const {
+    return m_sizeDistribution;
+}
+
+void PayloadGenerator::setSignatures(const QVector<QByteArray>& signatures) {
+    m_signatures = signatures;
+}
+
+void PayloadGenerator::loadSignatures(const QStringList& fileNames) {
+    m_signatures.clear();
+    foreach(const QString& fileName, fileNames) {
+        QFile file(fileName);
+        if(file.size() > 0 && file.size() <= MAX_SIGNATURE_SIZE && file.open(QIODevice::ReadOnly)) {
+            m_signatures << file.readAll();
+        }
+    }
+}
+
+int PayloadGenerator::getSignaturesNb() const {
+    return m_signatures.size();
+}
+
+const QByteArray& PayloadGenerator::getSignature(int idx) const {
+    return m_signatures.at(idx);
+}
+
+// independent seed of one stream of a run: one per purpose, or one per file
+quint64 PayloadGenerator::deriveSeed(quint64 seed, quint64 streamIdx) {
+    quint64 state = seed ^ splitMix64(streamIdx);
+    return splitMix64(state);
+}
+
+// fills one chunk of a synthetic file located at chunkOffset inside it and
+// overlays the part of the signature that falls into the chunk
+void PayloadGenerator::writeChunk(uchar* chunk, qint64 chunkOffset, qint64 chunkSize,
+                                  PayloadFiller& filler, const QByteArray* signature, qint64 signatureOffset) {
+    filler.fill(chunk, chunkSize);
+
+    if(!signature)
+        return;
+
+    qint64 overlapBegin = qMax(chunkOffset, signatureOffset);
+    qint64 overlapEnd = qMin(chunkOffset + chunkSize, signatureOffset + signature->size());
+    if(overlapBegin < overlapEnd) {
+        std::memcpy(chunk + (overlapBegin - chunkOffset),
+                    signature->constData() + (overlapBegin - signatureOffset),
+                    size_t(overlapEnd - overlapBegin));
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef PAYLOADGENERATOR_H
+#define PAYLOADGENERATOR_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QRandomGenerator>
+
+#define     DEFAULT_SYNTHETIC_FILE_SIZE     (64 * 1024)
+#define     PAYLOAD_CHUNK_SIZE              (4 * 1024 * 1024)
+#define     MAX_SIGNATURE_SIZE              (1024 * 1024)
+
+enum PAYLOAD_SOURCE {
+    TEMPLATE_PAYLOAD,
+    SYNTHETIC_PAYLOAD
+};
+
+enum SIZE_DISTRIBUTION {
+    FIXED_SIZE,
+    UNIFORM_SIZE,
+    LOG_NORMAL_SIZE,
+    HISTOGRAM_SIZE
+};
+
+// fixed:<size>, uniform:<min>:<max>, lognormal:<median>:<sigma> or histogram:<file>,
+// sizes accept K/M/G suffixes. Histogram file lines are "<upper bound> <weight>",
+// a bucket is picked by weight and the size is uniform inside it.
+class SizeDistribution {
+
+    SIZE_DISTRIBUTION m_type{FIXED_SIZE};
+    qint64 m_fixedSize{DEFAULT_SYNTHETIC_FILE_SIZE};
+    qint64 m_minSize{1};
+    qint64 m_maxSize{DEFAULT_SYNTHETIC_FILE_SIZE};
+    double m_logNormalMu{0.};
+    double m_logNormalSigma{0.};
+
+    QVector<qint64> m_bucketBounds;
+    QVector<double> m_bucketCumulativeWeights;
+
+    bool loadHistogram(const QString& fileName);
+
+public:
+    SizeDistribution();
+
+    bool parse(const QString& spec);
+    QString toString() const;
+    SIZE_DISTRIBUTION getType() const;
+
+    qint64 nextSize(QRandomGenerator& rng) const;
+
+    static qint64 parseSize(QString value, bool* ok);
+};
+
+// four xorshift128+ lanes advanced in lockstep, the compiler turns the lane
+// loop into vector instructions
+class PayloadFiller {
+
+    quint64 m_s0[4];
+    quint64 m_s1[4];
+
+public:
+    explicit PayloadFiller(quint64 seed = 0);
+
+    void seed(quint64 seed);
+    void fill(uchar* data, qint64 size);
+};
+
+// content source for synthetic files: random bytes, optionally with a real
+// signature spliced in at a random offset
+class PayloadGenerator {
+
+    SizeDistribution m_sizeDistribution;
+    QVector<QByteArray> m_signatures;
+
+public:
+    PayloadGenerator();
+
+    void setSizeDistribution(const SizeDistribution& sizeDistribution);
+    const SizeDistribution& getSizeDistribution() const;
+
+    void setSignatures(const QVector<QByteArray>& signatures);
+    void loadSignatures(const QStringList& fileNames);
+    int getSignaturesNb() const;
+
+    const QByteArray& getSignature(int idx) const;
+    static quint64 deriveSeed(quint64 seed, quint64 streamIdx);
+    static void writeChunk(uchar* chunk, qint64 chunkOffset, qint64 chunkSize,
+                           PayloadFiller& filler, const QByteArray* signature, qint64 signatureOffset);
+};
+
+#endif // PAYLOADGENERATOR_H
@@ -0,0 +1,159 @@
+#include "ratescheduler.h"
+
+#include <cmath>
+
+RateScheduler::RateScheduler() {
+    reset();
+}
+
+void RateScheduler::setRate(double rate, RATE_UNIT rateUnit) {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    resume();
+    m_rate = rate;
+    m_rateUnit = rateUnit;
+    m_rampDurationInSecs = 0.;
+}
+
+// the rate goes from fromRate now to toRate after durationInSecs and stays there
+void RateScheduler::setRamp(double fromRate, double toRate, double durationInSecs, RATE_UNIT rateUnit) {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    resume();
+    m_rate = toRate;
+    m_rateUnit = rateUnit;
+    m_rampFromRate = qMax(0., fromRate);
+    m_rampDurationInSecs = qMax(0., durationInSecs);
+    m_rampEndTime = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_rampDurationInSecs));
+}
+
+double RateScheduler::getRate() const {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    return m_rate;
+}
+
+RATE_UNIT RateScheduler::getRateUnit() const {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    return m_rateUnit;
+}
+
+void RateScheduler::pause() {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_paused = true;
+}
+
+bool RateScheduler::isPaused() const {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    return m_paused;
+}
+
+// the schedule restarts from now, a pause isn't a backlog to catch up in a burst
+void RateScheduler::resume() {
+    if(m_paused)
+        m_theoreticalArrivalTime = Clock::now();
+    m_paused = false;
+}
+
+void RateScheduler::setBurstInSecs(double burstInSecs) {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_burstInSecs = qMax(0., burstInSecs);
+}
+
+double RateScheduler::getBurstInSecs() const {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    return m_burstInSecs;
+}
+
+void RateScheduler::setDeadline(double inSecs) {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_deadlineSet = inSecs >= 0.;
+    m_deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(qMax(0., inSecs)));
+}
+
+bool RateScheduler::isDeadlineReached() const {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    return m_deadlineSet && Clock::now() >= m_deadline;
+}
+
+void RateScheduler::reset() {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_theoreticalArrivalTime = Clock::now();
+    m_startTime = m_theoreticalArrivalTime;
+    m_deadlineSet = false;
+    m_cancelled = false;
+}
+
+void RateScheduler::cancel() {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_cancelled = true;
+    m_cancelCondition.notify_all();
+}
+
+bool RateScheduler::acquire(qint64 sizeInBytes) {
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    Clock::time_point now = Clock::now();
+    Clock::duration burst = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_burstInSecs));
+    if(m_theoreticalArrivalTime < now - burst) {
+        m_theoreticalArrivalTime = now - burst;
+    }
+
+    for(;;) {
+        if(m_cancelled)
+            return false;
+        now = Clock::now();
+        if(m_deadlineSet && now >= m_deadline)
+            return false;
+        if(m_paused) {
+            if(m_deadlineSet)
+                m_cancelCondition.wait_until(locker, m_deadline);
+            else
+                m_cancelCondition.wait(locker);
+            continue;
+        }
+        if(now >= m_theoreticalArrivalTime)
+            break;
+        m_cancelCondition.wait_until(locker, m_deadlineSet ? qMin(m_deadline, m_theoreticalArrivalTime) : m_theoreticalArrivalTime);
+    }
+
+    if(m_rate > 0.) {
+        double cost = m_rateUnit == FILES_PER_SEC ? 1. : double(sizeInBytes);
+        m_theoreticalArrivalTime += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(advanceInSecs(cost)));
+    }
+    return true;
+}
+
+// blocks until timeInSecs after reset(), replayed traces are paced by their own
+// timestamps instead of a rate. False when cancelled.
+bool RateScheduler::waitUntil(double timeInSecs, qint64& lateInNsecs) {
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    Clock::time_point time = m_startTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeInSecs));
+    while(!m_cancelled && Clock::now() < time) {
+        m_cancelCondition.wait_until(locker, time);
+    }
+    lateInNsecs = qMax(qint64(0), qint64(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - time).count()));
+    return !m_cancelled;
+}
+
+// time needed to deliver cost starting at the theoretical arrival time: on a
+// ramp the rate is r + slope * t, so cost = r * t + slope * t^2 / 2
+double RateScheduler::advanceInSecs(double cost) const {
+    double rampLeftInSecs = m_rampDurationInSecs > 0. ?
+                            std::chrono::duration<double>(m_rampEndTime - m_theoreticalArrivalTime).count() : 0.;
+    if(rampLeftInSecs <= 0.)
+        return cost / m_rate;
+
+    double slope = (m_rate - m_rampFromRate) / m_rampDurationInSecs;
+    double rate = qBound(qMin(m_rampFromRate, m_rate), m_rate - slope * rampLeftInSecs, qMax(m_rampFromRate, m_rate));
+
+    double rampCost = (rate + m_rate) / 2. * rampLeftInSecs;
+    if(cost >= rampCost)
+        return rampLeftInSecs + (cost - rampCost) / m_rate;
+
+    // the stable root form also covers a zero slope and a zero starting rate
+    return 2. * cost / (rate + std::sqrt(qMax(0., rate * rate + 2. * slope * cost)));
+}
+
+qint64 RateScheduler::getLagInNsecs() const {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    return qint64(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_theoreticalArrivalTime).count());
+}
@@ -0,0 +1,76 @@
+#ifndef RATESCHEDULER_H
+#define RATESCHEDULER_H
+
+#include <QtGlobal>
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#define     DEFAULT_BURST_IN_SECS       0.2
+
+enum RATE_UNIT {
+    FILES_PER_SEC,
+    BYTES_PER_SEC
+};
+
+// virtual-clock token bucket: every admitted file moves the theoretical
+// arrival time forward by cost / rate, so pacing is tied to absolute time
+// and doesn't accumulate sleep errors. When copies run slow the schedule
+// falls behind and is caught up without sleeping, but never by more than
+// the burst window. A ramp changes the rate linearly over time, the arrival
+// time then advances by integrating the rate instead of dividing by it.
+// A deadline bounds the wait: a file whose slot comes after it is refused,
+// so a workload phase ends on time even at one file a minute. Paused, it
+// admits nothing until the rate is set again.
+class RateScheduler {
+
+    typedef std::chrono::steady_clock Clock;
+
+    double m_rate{1.};
+    RATE_UNIT m_rateUnit{FILES_PER_SEC};
+    double m_burstInSecs{DEFAULT_BURST_IN_SECS};
+
+    double m_rampFromRate{0.};
+    double m_rampDurationInSecs{0.};
+    Clock::time_point m_rampEndTime;
+
+    Clock::time_point m_theoreticalArrivalTime;
+    Clock::time_point m_startTime;
+    Clock::time_point m_deadline;
+    bool m_deadlineSet{false};
+    bool m_paused{false};
+    bool m_cancelled{false};
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cancelCondition;
+
+    double advanceInSecs(double cost) const;
+    void resume();
+
+public:
+    RateScheduler();
+
+    void setRate(double rate, RATE_UNIT rateUnit);
+    void setRamp(double fromRate, double toRate, double durationInSecs, RATE_UNIT rateUnit);
+    double getRate() const;
+    RATE_UNIT getRateUnit() const;
+    void pause();
+    bool isPaused() const;
+
+    void setBurstInSecs(double burstInSecs);
+    double getBurstInSecs() const;
+
+    // in seconds from now, a negative time clears it
+    void setDeadline(double inSecs);
+    bool isDeadlineReached() const;
+
+    void reset();
+    void cancel();
+    // false when cancelled or when the deadline comes first, paused it waits for either
+    bool acquire(qint64 sizeInBytes);
+    bool waitUntil(double timeInSecs, qint64& lateInNsecs);
+    qint64 getLagInNsecs() const;
+};
+
+#endif // RATESCHEDULER_H
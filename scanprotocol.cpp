@@ -0,0 +1,352 @@
+#include "scanprotocol.h"
+
+#include <QUrl>
+
+#include <cstring>
+
+MessageParser::MessageParser(bool request): m_request(request) {
+}
+
+// servers keep request bodies to look into them, clients only count responses
+void MessageParser::setKeptBodySize(qint64 keptBodySize) {
+    m_keptBodySize = qMax(qint64(0), keptBodySize);
+}
+
+void MessageParser::reset() {
+    m_state = HEAD_STATE;
+    m_line.clear();
+    m_headSize = 0;
+    m_startLine.clear();
+    m_headers.clear();
+    m_left = 0;
+    m_chunkedAfterSkip = false;
+    m_skippedSize = 0;
+    m_responseHeadOffset = -1;
+    m_responseHead.clear();
+    m_body.clear();
+    m_bodySize = 0;
+}
+
+qint64 MessageParser::parse(const char* data, qint64 size) {
+    qint64 used = 0;
+    while(used < size && m_state != COMPLETE_STATE && m_state != ERROR_STATE) {
+        const char* input = data + used;
+        qint64 left = size - used;
+
+        // counted states take bytes as they are, the others collect a line
+        if(m_state == SKIP_STATE || m_state == BODY_STATE || m_state == CHUNK_DATA_STATE || m_state == UNTIL_CLOSE_STATE) {
+            qint64 taken = m_state == UNTIL_CLOSE_STATE ? left : qMin(left, m_left);
+            if(m_state != SKIP_STATE) {
+                if(m_body.size() < m_keptBodySize)
+                    m_body.append(input, int(qMin(taken, m_keptBodySize - m_body.size())));
+                m_bodySize += taken;
+            } else {
+                keepResponseHead(input, taken);
+            }
+            used += taken;
+            if(m_state == UNTIL_CLOSE_STATE)
+                continue;
+
+            m_left -= taken;
+            if(m_left)
+                continue;
+            if(m_state == SKIP_STATE) {
+                m_state = m_chunkedAfterSkip ? CHUNK_SIZE_STATE : COMPLETE_STATE;
+            } else {
+                m_state = m_state == CHUNK_DATA_STATE ? CHUNK_END_STATE : COMPLETE_STATE;
+            }
+            continue;
+        }
+
+        const char* newline = static_cast<const char*>(std::memchr(input, '\n', size_t(left)));
+        qint64 taken = newline ? newline - input + 1 : left;
+        m_line.append(input, int(taken));
+        used += taken;
+        m_headSize += taken;
+        if(m_line.size() > MAX_MESSAGE_HEAD_SIZE || (m_state == HEAD_STATE && m_headSize > MAX_MESSAGE_HEAD_SIZE)) {
+            m_state = ERROR_STATE;
+            break;
+        }
+        if(!newline)
+            continue;
+
+        QByteArray line = m_line;
+        m_line.clear();
+        line.chop(line.endsWith("\r\n") ? 2 : 1);
+        parseLine(line);
+    }
+    return used;
+}
+
+void MessageParser::parseLine(const QByteArray& line) {
+    switch(m_state) {
+        case HEAD_STATE:
+            if(m_startLine.isEmpty()) {
+                // empty lines between pipelined messages are tolerated
+                if(!line.isEmpty())
+                    m_startLine = line.split(' ');
+            } else if(line.isEmpty()) {
+                startBody();
+            } else {
+                int colonIdx = line.indexOf(':');
+                if(colonIdx <= 0) {
+                    m_state = ERROR_STATE;
+                    break;
+                }
+                m_headers.insert(line.left(colonIdx).trimmed().toLower(), line.mid(colonIdx + 1).trimmed());
+            }
+            break;
+        case CHUNK_SIZE_STATE: {
+            // chunk extensions such as ICAP's "; ieof" are ignored
+            int extensionIdx = line.indexOf(';');
+            bool ok;
+            m_left = line.left(extensionIdx < 0 ? line.size() : extensionIdx).trimmed().toLongLong(&ok, 16);
+            if(!ok || m_left < 0) {
+                m_state = ERROR_STATE;
+            } else {
+                m_state = m_left ? CHUNK_DATA_STATE : TRAILER_STATE;
+            }
+            break;
+        }
+        case CHUNK_END_STATE:
+            m_state = line.isEmpty() ? CHUNK_SIZE_STATE : ERROR_STATE;
+            break;
+        case TRAILER_STATE:
+            if(line.isEmpty())
+                m_state = COMPLETE_STATE;
+            break;
+        default:
+            break;
+    }
+}
+
+// decides how the body is delimited once the head is read
+void MessageParser::startBody() {
+    if(m_startLine.size() < 2) {
+        m_state = ERROR_STATE;
+        return;
+    }
+
+    if(isIcap()) {
+        // the last Encapsulated entry is the offset of the body, or null-body when there is none
+        QList<QByteArray> entries = getHeader("encapsulated").split(',');
+        foreach(const QByteArray& entry, entries) {
+            QList<QByteArray> parts = entry.trimmed().split('=');
+            if(parts.size() == 2 && parts.at(0).trimmed() == "res-hdr")
+                m_responseHeadOffset = parts.at(1).trimmed().toLongLong();
+        }
+        QList<QByteArray> lastEntry = entries.last().trimmed().split('=');
+        if(lastEntry.size() != 2) {
+            m_state = COMPLETE_STATE;
+            return;
+        }
+        bool ok;
+        m_left = lastEntry.at(1).trimmed().toLongLong(&ok);
+        if(!ok || m_left < 0) {
+            m_state = ERROR_STATE;
+            return;
+        }
+        m_chunkedAfterSkip = lastEntry.at(0).trimmed() != "null-body";
+        m_state = m_left ? SKIP_STATE : m_chunkedAfterSkip ? CHUNK_SIZE_STATE : COMPLETE_STATE;
+        return;
+    }
+
+    int status = getStatus();
+    if(getHeader("transfer-encoding").toLower().contains("chunked")) {
+        m_state = CHUNK_SIZE_STATE;
+    } else if(!getHeader("content-length").isEmpty()) {
+        bool ok;
+        m_left = getHeader("content-length").toLongLong(&ok);
+        if(!ok || m_left < 0) {
+            m_state = ERROR_STATE;
+            return;
+        }
+        m_state = m_left ? BODY_STATE : COMPLETE_STATE;
+    } else if(!m_request && status >= 200 && status != 204 && status != 304) {
+        m_state = UNTIL_CLOSE_STATE;
+    } else {
+        m_state = COMPLETE_STATE;
+    }
+}
+
+// the skipped encapsulated headers are only looked into for the response status line
+void MessageParser::keepResponseHead(const char* data, qint64 size) {
+    if(m_responseHeadOffset >= 0) {
+        qint64 begin = qMax(qint64(0), m_responseHeadOffset - m_skippedSize);
+        qint64 end = qMin(size, m_responseHeadOffset + MAX_STATUS_LINE_SIZE - m_skippedSize);
+        if(begin < end)
+            m_responseHead.append(data + begin, int(end - begin));
+    }
+    m_skippedSize += size;
+}
+
+bool MessageParser::finish() {
+    if(m_state == UNTIL_CLOSE_STATE)
+        m_state = COMPLETE_STATE;
+    return m_state == COMPLETE_STATE;
+}
+
+bool MessageParser::isComplete() const {
+    return m_state == COMPLETE_STATE;
+}
+
+bool MessageParser::isFailed() const {
+    return m_state == ERROR_STATE;
+}
+
+bool MessageParser::isIcap() const {
+    return m_startLine.value(m_request ? 2 : 0).startsWith("ICAP/");
+}
+
+bool MessageParser::keepsAlive() const {
+    QByteArray connection = getHeader("connection").toLower();
+    if(connection.contains("close"))
+        return false;
+    if(m_startLine.value(m_request ? 2 : 0) == "HTTP/1.0")
+        return connection.contains("keep-alive");
+    return true;
+}
+
+QByteArray MessageParser::getMethod() const {
+    return m_request ? m_startLine.value(0) : QByteArray();
+}
+
+int MessageParser::getStatus() const {
+    return m_request ? 0 : m_startLine.value(1).toInt();
+}
+
+int MessageParser::getEncapsulatedStatus() const {
+    QList<QByteArray> statusLine = m_responseHead.left(m_responseHead.indexOf('\n')).trimmed().split(' ');
+    return statusLine.value(0).startsWith("HTTP/") ? statusLine.value(1).toInt() : 0;
+}
+
+QByteArray MessageParser::getHeader(const QByteArray& name) const {
+    return m_headers.value(name);
+}
+
+qint64 MessageParser::getBodySize() const {
+    return m_bodySize;
+}
+
+const QByteArray& MessageParser::getBody() const {
+    return m_body;
+}
+
+// -----------------------------------------------------------------------------------------
+
+ScanTarget::ScanTarget() {
+}
+
+bool ScanTarget::parse(const QString& url) {
+    if(url.trimmed().isEmpty() || url.trimmed() == "none") {
+        m_protocol = NO_SCAN_PROTOCOL;
+        return true;
+    }
+
+    QUrl parsedUrl(url.trimmed(), QUrl::StrictMode);
+    QString scheme = parsedUrl.scheme().toLower();
+    SCAN_PROTOCOL protocol = scheme == "icap" ? ICAP_SCAN_PROTOCOL : scheme == "http" ? HTTP_SCAN_PROTOCOL : NO_SCAN_PROTOCOL;
+    if(!parsedUrl.isValid() || protocol == NO_SCAN_PROTOCOL || parsedUrl.host().isEmpty())
+        return false;
+
+    m_protocol = protocol;
+    m_host = parsedUrl.host();
+    m_port = quint16(parsedUrl.port(protocol == ICAP_SCAN_PROTOCOL ? DEFAULT_ICAP_PORT : DEFAULT_HTTP_PORT));
+    m_path = parsedUrl.path(QUrl::FullyEncoded).toLatin1();
+    if(m_path.isEmpty())
+        m_path = "/";
+    return true;
+}
+
+QString ScanTarget::toString() const {
+    if(m_protocol == NO_SCAN_PROTOCOL)
+        return "none";
+    return QString("%1://%2:%3%4").arg(m_protocol == ICAP_SCAN_PROTOCOL ? "icap" : "http")
+                                  .arg(m_host.contains(':') ? QString("[%1]").arg(m_host) : m_host)
+                                  .arg(m_port)
+                                  .arg(QString::fromLatin1(m_path));
+}
+
+bool ScanTarget::isEnabled() const {
+    return m_protocol != NO_SCAN_PROTOCOL;
+}
+
+SCAN_PROTOCOL ScanTarget::getProtocol() const {
+    return m_protocol;
+}
+
+QString ScanTarget::getHost() const {
+    return m_host;
+}
+
+quint16 ScanTarget::getPort() const {
+    return m_port;
+}
+
+void ScanTarget::setPipelineDepth(int pipelineDepth) {
+    m_pipelineDepth = qBound(1, pipelineDepth, MAX_PIPELINE_DEPTH);
+}
+
+int ScanTarget::getPipelineDepth() const {
+    return m_pipelineDepth;
+}
+
+// an ICAP request carries the file as the body of an encapsulated response to a GET
+// of its name, with Allow: 204 so clean files come back without their content
+QByteArray ScanTarget::requestHead(const QString& name, qint64 bodySize) const {
+    QByteArray encodedName = QUrl::toPercentEncoding(name);
+    QByteArray hostHeader = "Host: " + QUrl::toAce(m_host) + ':' + QByteArray::number(m_port) + "\r\n";
+    QByteArray head;
+    head.reserve(512);
+
+    if(m_protocol == ICAP_SCAN_PROTOCOL) {
+        QByteArray requestHeader = "GET /" + encodedName + " HTTP/1.1\r\n" + hostHeader + "\r\n";
+        QByteArray responseHeader = "HTTP/1.1 200 OK\r\n"
+                                    "Content-Type: application/octet-stream\r\n"
+                                    "Content-Length: " + QByteArray::number(bodySize) + "\r\n\r\n";
+        head += "RESPMOD icap://" + QUrl::toAce(m_host) + ':' + QByteArray::number(m_port) + m_path + " ICAP/1.0\r\n";
+        head += hostHeader;
+        head += "Allow: 204\r\n";
+        head += "Encapsulated: req-hdr=0, res-hdr=" + QByteArray::number(requestHeader.size()) +
+                ", res-body=" + QByteArray::number(requestHeader.size() + responseHeader.size()) + "\r\n\r\n";
+        head += requestHeader;
+        head += responseHeader;
+        if(bodySize)
+            head += QByteArray::number(bodySize, 16) + "\r\n";
+    } else {
+        head += "PUT " + m_path + (m_path.endsWith('/') ? "" : "/") + encodedName + " HTTP/1.1\r\n";
+        head += hostHeader;
+        head += "Content-Type: application/octet-stream\r\n";
+        head += "Content-Length: " + QByteArray::number(bodySize) + "\r\n\r\n";
+    }
+    return head;
+}
+
+QByteArray ScanTarget::requestTrailer(qint64 bodySize) const {
+    if(m_protocol != ICAP_SCAN_PROTOCOL)
+        return QByteArray();
+    return bodySize ? "\r\n0\r\n\r\n" : "0\r\n\r\n";
+}
+
+// ICAP answers 204 for an unmodified file and 200 with a replaced response for a
+// blocked one, but servers ignoring Allow: 204 echo clean files with 200 too, so
+// only a reported infection or a blocked encapsulated response is a detection.
+// HTTP scanners answer 2xx, refuse infected uploads with 403 or report them in
+// one of the usual headers.
+SCAN_VERDICT ScanTarget::verdict(const MessageParser& response) {
+    int status = response.getStatus();
+    bool infectionReported = !response.getHeader("x-infection-found").isEmpty() ||
+                             !response.getHeader("x-virus-id").isEmpty() ||
+                             !response.getHeader("x-violations-found").isEmpty();
+    if(response.isIcap()) {
+        if(status == 204)
+            return CLEAN_VERDICT;
+        if(status != 200)
+            return ERROR_VERDICT;
+        return infectionReported || response.getEncapsulatedStatus() == 403 ? INFECTED_VERDICT : CLEAN_VERDICT;
+    }
+
+    if(status == 403 || (status >= 200 && status < 300 && infectionReported))
+        return INFECTED_VERDICT;
+    return status >= 200 && status < 300 ? CLEAN_VERDICT : ERROR_VERDICT;
+}
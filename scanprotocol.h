@@ -0,0 +1,123 @@
+#ifndef SCANPROTOCOL_H
+#define SCANPROTOCOL_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+
+#define     DEFAULT_ICAP_PORT           1344
+#define     DEFAULT_HTTP_PORT           80
+#define     DEFAULT_PIPELINE_DEPTH      1
+#define     MAX_PIPELINE_DEPTH          256
+#define     MAX_MESSAGE_HEAD_SIZE       (64 * 1024)
+#define     MAX_STATUS_LINE_SIZE        256
+
+enum SCAN_PROTOCOL {
+    NO_SCAN_PROTOCOL,
+    ICAP_SCAN_PROTOCOL,
+    HTTP_SCAN_PROTOCOL
+};
+
+enum SCAN_VERDICT {
+    CLEAN_VERDICT,
+    INFECTED_VERDICT,
+    ERROR_VERDICT
+};
+
+// incremental framing of one HTTP/1.1 or ICAP/1.0 message at a time, fed with
+// whatever the socket gave. Bodies are counted, and their beginning kept on
+// request; ICAP bodies are found through the Encapsulated header and are chunked.
+class MessageParser {
+
+    enum PARSER_STATE {
+        HEAD_STATE,
+        SKIP_STATE,
+        BODY_STATE,
+        CHUNK_SIZE_STATE,
+        CHUNK_DATA_STATE,
+        CHUNK_END_STATE,
+        TRAILER_STATE,
+        UNTIL_CLOSE_STATE,
+        COMPLETE_STATE,
+        ERROR_STATE
+    };
+
+    bool m_request;
+    qint64 m_keptBodySize{0};
+
+    PARSER_STATE m_state{HEAD_STATE};
+    QByteArray m_line;
+    qint64 m_headSize{0};
+    QList<QByteArray> m_startLine;
+    QHash<QByteArray, QByteArray> m_headers;
+    qint64 m_left{0};
+    bool m_chunkedAfterSkip{false};
+    qint64 m_skippedSize{0};
+    qint64 m_responseHeadOffset{-1};
+    QByteArray m_responseHead;
+    QByteArray m_body;
+    qint64 m_bodySize{0};
+
+    void parseLine(const QByteArray& line);
+    void startBody();
+    void keepResponseHead(const char* data, qint64 size);
+
+public:
+    explicit MessageParser(bool request = false);
+
+    void setKeptBodySize(qint64 keptBodySize);
+    void reset();
+
+    // returns the bytes used, stops right after the end of a message
+    qint64 parse(const char* data, qint64 size);
+    // end of stream, completes a message delimited by the connection close
+    bool finish();
+
+    bool isComplete() const;
+    bool isFailed() const;
+    bool isIcap() const;
+    bool keepsAlive() const;
+
+    QByteArray getMethod() const;
+    int getStatus() const;
+    // status of the HTTP response an ICAP answer encapsulates, 0 without one
+    int getEncapsulatedStatus() const;
+    QByteArray getHeader(const QByteArray& name) const;
+    qint64 getBodySize() const;
+    const QByteArray& getBody() const;
+};
+
+// icap://host[:port]/service sends RESPMOD requests, http://host[:port]/path
+// PUTs every file under the path. Each worker keeps one connection alive and
+// pipelines up to the pipeline depth requests on it.
+class ScanTarget {
+
+    SCAN_PROTOCOL m_protocol{NO_SCAN_PROTOCOL};
+    QString m_host;
+    quint16 m_port{0};
+    QByteArray m_path;
+    int m_pipelineDepth{DEFAULT_PIPELINE_DEPTH};
+
+public:
+    ScanTarget();
+
+    bool parse(const QString& url);
+    QString toString() const;
+    bool isEnabled() const;
+
+    SCAN_PROTOCOL getProtocol() const;
+    QString getHost() const;
+    quint16 getPort() const;
+
+    void setPipelineDepth(int pipelineDepth);
+    int getPipelineDepth() const;
+
+    // the body goes between the two, so it can be sent from where it is
+    QByteArray requestHead(const QString& name, qint64 bodySize) const;
+    QByteArray requestTrailer(qint64 bodySize) const;
+
+    static SCAN_VERDICT verdict(const MessageParser& response);
+};
+
+#endif // SCANPROTOCOL_H
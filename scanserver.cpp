@@ -0,0 +1,153 @@
+#include "scanserver.h"
+
+#include <QFile>
+
+#include "payloadgenerator.h"
+
+ScanServer::ScanServer() {
+    moveToThread(&m_thread);
+    m_thread.start();
+}
+
+ScanServer::~ScanServer() {
+    QMetaObject::invokeMethod(this, [this]{ shutdown(); }, Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void ScanServer::loadSignatures(const QStringList& fileNames) {
+    m_signatures.clear();
+    foreach(const QString& fileName, fileNames) {
+        QFile file(fileName);
+        if(file.size() > 0 && file.size() <= MAX_SIGNATURE_SIZE && file.open(QIODevice::ReadOnly)) {
+            m_signatures << file.readAll();
+        }
+    }
+}
+
+// the server socket has to live in the server thread, so the call hops there and waits
+bool ScanServer::listen(const QHostAddress& address, quint16 port) {
+    bool listening = false;
+    QMetaObject::invokeMethod(this, [&]{ listening = startListening(address, port); }, Qt::BlockingQueuedConnection);
+    return listening;
+}
+
+quint16 ScanServer::getPort() const {
+    return m_port;
+}
+
+qint64 ScanServer::getRequestsNb() const {
+    return m_requestsNb;
+}
+
+qint64 ScanServer::getDetectionsNb() const {
+    return m_detectionsNb;
+}
+
+bool ScanServer::startListening(const QHostAddress& address, quint16 port) {
+    delete m_server;
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection, this, &ScanServer::acceptConnections);
+
+    if(!m_server->listen(address, port)) {
+        delete m_server;
+        m_server = nullptr;
+        m_port = 0;
+        return false;
+    }
+    m_port = m_server->serverPort();
+    return true;
+}
+
+void ScanServer::shutdown() {
+    delete m_server;
+    m_server = nullptr;
+    m_port = 0;
+    qDeleteAll(m_parsers);
+    m_parsers.clear();
+}
+
+void ScanServer::acceptConnections() {
+    while(m_server->hasPendingConnections()) {
+        QTcpSocket* socket = m_server->nextPendingConnection();
+        MessageParser* parser = new MessageParser(true);
+        parser->setKeptBodySize(MAX_SCANNED_BODY_SIZE);
+        m_parsers.insert(socket, parser);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]{ readRequests(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]{
+            delete m_parsers.take(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+// pipelined requests are answered one after the other as they complete
+void ScanServer::readRequests(QTcpSocket* socket) {
+    MessageParser* parser = m_parsers.value(socket);
+    if(!parser)
+        return;
+
+    QByteArray data = socket->readAll();
+    for(qint64 used = 0; used < data.size();) {
+        used += parser->parse(data.constData() + used, data.size() - used);
+        if(parser->isFailed()) {
+            socket->write("HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            socket->disconnectFromHost();
+            return;
+        }
+        if(!parser->isComplete())
+            continue;
+
+        socket->write(answer(*parser));
+        bool keepAlive = parser->keepsAlive();
+        parser->reset();
+        if(!keepAlive) {
+            socket->disconnectFromHost();
+            return;
+        }
+    }
+}
+
+QByteArray ScanServer::answer(const MessageParser& request) {
+    QByteArray method = request.getMethod();
+    bool scanned = method == "RESPMOD" || method == "REQMOD" || method == "PUT" || method == "POST";
+    QByteArray threat = scanned ? detect(request.getBody()) : QByteArray();
+    if(scanned) {
+        m_requestsNb++;
+        if(!threat.isEmpty())
+            m_detectionsNb++;
+    }
+    QByteArray infectionHeader = "X-Infection-Found: Type=0; Resolution=2; Threat=" + threat + ";\r\n";
+
+    if(request.isIcap()) {
+        QByteArray head = "ISTag: \"TrafficGenerator\"\r\n";
+        if(method == "OPTIONS")
+            return "ICAP/1.0 200 OK\r\n" + head + "Methods: RESPMOD, REQMOD\r\nAllow: 204\r\nEncapsulated: null-body=0\r\n\r\n";
+        if(!scanned)
+            return "ICAP/1.0 405 Method Not Allowed\r\n" + head + "Encapsulated: null-body=0\r\n\r\n";
+        if(threat.isEmpty())
+            return "ICAP/1.0 204 No Content\r\n" + head + "Encapsulated: null-body=0\r\n\r\n";
+
+        // the blocked response replaces the scanned one
+        QByteArray blockedResponse = "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n";
+        return "ICAP/1.0 200 OK\r\n" + head + infectionHeader +
+               "Encapsulated: res-hdr=0, null-body=" + QByteArray::number(blockedResponse.size()) + "\r\n\r\n" + blockedResponse;
+    }
+
+    if(!scanned)
+        return "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\n\r\n";
+    if(threat.isEmpty())
+        return "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    return "HTTP/1.1 403 Forbidden\r\n" + infectionHeader + "Content-Length: 0\r\n\r\n";
+}
+
+// name of the threat found in the body, empty when it's clean
+QByteArray ScanServer::detect(const QByteArray& body) const {
+    if(body.contains(EICAR_SIGNATURE))
+        return "EICAR-Test-File";
+    for(int i = 0; i < m_signatures.size(); i++) {
+        if(body.contains(m_signatures.at(i)))
+            return "TrafficGenerator.Signature" + QByteArray::number(i);
+    }
+    return QByteArray();
+}
@@ -0,0 +1,59 @@
+#ifndef SCANSERVER_H
+#define SCANSERVER_H
+
+#include <QObject>
+#include <QThread>
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+
+#include <atomic>
+
+#include "scanprotocol.h"
+
+#define     EICAR_SIGNATURE             "X5O!P%@AP[4\\PZX54(P^)7CC)7}$EICAR-STANDARD-ANTIVIRUS-TEST-FILE!$H+H*"
+#define     MAX_SCANNED_BODY_SIZE       (64 * 1024 * 1024)
+
+// local stand-in for a scanner reached over ICAP or HTTP, to try network delivery
+// without an Investigator. Answers every request of a keep-alive connection in
+// order: a body holding the EICAR test string or one of the signatures (the
+// infected templates) is reported infected, anything else clean. Only the first
+// MAX_SCANNED_BODY_SIZE bytes of a body are looked at. Runs on its own thread.
+class ScanServer : public QObject {
+
+    Q_OBJECT
+
+    QThread m_thread;
+    QTcpServer* m_server{nullptr};
+    quint16 m_port{0};
+    QHash<QTcpSocket*, MessageParser*> m_parsers;
+    QVector<QByteArray> m_signatures;
+
+    std::atomic<qint64> m_requestsNb{0};
+    std::atomic<qint64> m_detectionsNb{0};
+
+    bool startListening(const QHostAddress& address, quint16 port);
+    void shutdown();
+
+    void acceptConnections();
+    void readRequests(QTcpSocket* socket);
+    QByteArray answer(const MessageParser& request);
+    QByteArray detect(const QByteArray& body) const;
+
+public:
+    ScanServer();
+    ~ScanServer();
+
+    // before listen(), the signatures are only read by the server thread afterwards
+    void loadSignatures(const QStringList& fileNames);
+    bool listen(const QHostAddress& address, quint16 port);
+
+    quint16 getPort() const;
+    qint64 getRequestsNb() const;
+    qint64 getDetectionsNb() const;
+};
+
+#endif // SCANSERVER_H
@@ -0,0 +1,358 @@
+#include "statsexporter.h"
+
+#include <QFileInfo>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+static const double latencyQuantiles[] = {0.5, 0.99, 0.999};
+static const int rateWindows[] = {1, 10, 60};
+
+static void appendHeader(QByteArray& out, const char* name, const char* type, const char* help) {
+    out += QByteArray("# HELP ") + name + ' ' + help + '\n';
+    out += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+}
+
+static void appendSample(QByteArray& out, const char* name, double value, const QByteArray& labels = QByteArray()) {
+    out += name;
+    if(!labels.isEmpty())
+        out += '{' + labels + '}';
+    out += ' ' + QByteArray::number(value, 'g', 15) + '\n';
+}
+
+StatsExporter::StatsExporter(const TrafficGenerator* trfGen): m_trfGen(trfGen) {
+    moveToThread(&m_thread);
+    m_thread.start();
+}
+
+StatsExporter::~StatsExporter() {
+    QMetaObject::invokeMethod(this, [this]{ shutdown(); }, Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+}
+
+// sockets and timers have to live in the exporter thread, so the public calls hop there and wait
+bool StatsExporter::listen(const QHostAddress& address, quint16 port) {
+    bool listening = false;
+    QMetaObject::invokeMethod(this, [&]{ listening = startListening(address, port); }, Qt::BlockingQueuedConnection);
+    return listening;
+}
+
+bool StatsExporter::openLog(const QString& fileName, int intervalInSecs) {
+    bool opened = false;
+    QMetaObject::invokeMethod(this, [&]{ opened = startLogging(fileName, intervalInSecs); }, Qt::BlockingQueuedConnection);
+    return opened;
+}
+
+quint16 StatsExporter::getPort() const {
+    return m_port;
+}
+
+QString StatsExporter::getLogFileName() const {
+    return m_logFile.fileName();
+}
+
+STATS_LOG_FORMAT StatsExporter::logFormatFor(const QString& fileName) {
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    return suffix == "jsonl" || suffix == "json" ? JSONL_LOG : CSV_LOG;
+}
+
+bool StatsExporter::startListening(const QHostAddress& address, quint16 port) {
+    delete m_server;
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection, this, &StatsExporter::acceptConnections);
+
+    if(!m_server->listen(address, port)) {
+        delete m_server;
+        m_server = nullptr;
+        m_port = 0;
+        return false;
+    }
+    m_port = m_server->serverPort();
+    return true;
+}
+
+bool StatsExporter::startLogging(const QString& fileName, int intervalInSecs) {
+    delete m_logTimer;
+    m_logTimer = nullptr;
+    m_logFile.close();
+
+    m_logFile.setFileName(fileName);
+    if(!m_logFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        return false;
+
+    m_logFormat = logFormatFor(fileName);
+    if(m_logFormat == CSV_LOG && !m_logFile.size()) {
+        m_logFile.write("timestamp,running,work_time_s,files,bytes,infected,failed,backlog,throttled_s,"
+                        "files_rate_1s,files_rate_10s,files_rate_60s,"
+                        "bytes_rate_1s,bytes_rate_10s,bytes_rate_60s,"
+                        "latency_p50_s,latency_p99_s,latency_p999_s,"
+                        "scan_latency_clean_p50_s,scan_latency_clean_p99_s,"
+                        "scan_latency_infected_p50_s,scan_latency_infected_p99_s,"
+                        "fsyncs,fsync_s,publishes,publish_s,detections,missed_detections,false_detections\n");
+        m_logFile.flush();
+    }
+
+    m_logTimer = new QTimer(this);
+    m_logTimer->setTimerType(Qt::PreciseTimer);
+    m_logTimer->setInterval(qMax(1, intervalInSecs) * 1000);
+    connect(m_logTimer, &QTimer::timeout, this, &StatsExporter::writeLogRecord);
+    m_logTimer->start();
+    return true;
+}
+
+void StatsExporter::shutdown() {
+    delete m_server;
+    m_server = nullptr;
+    m_port = 0;
+
+    if(m_logTimer) {
+        writeLogRecord();
+        delete m_logTimer;
+        m_logTimer = nullptr;
+    }
+    m_logFile.close();
+}
+
+void StatsExporter::acceptConnections() {
+    while(m_server->hasPendingConnections()) {
+        QTcpSocket* socket = m_server->nextPendingConnection();
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]{ readRequest(socket); });
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+// minimal HTTP/1.x: waits for the end of headers, answers and closes the connection
+void StatsExporter::readRequest(QTcpSocket* socket) {
+    QByteArray request = socket->peek(MAX_HTTP_REQUEST_SIZE);
+    if(!request.contains("\r\n\r\n") && !request.contains("\n\n")) {
+        if(request.size() >= MAX_HTTP_REQUEST_SIZE) {
+            socket->write("HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            socket->disconnectFromHost();
+        }
+        return;
+    }
+    socket->readAll();
+
+    QList<QByteArray> requestLine = request.left(request.indexOf('\n')).trimmed().split(' ');
+    QByteArray method = requestLine.value(0);
+    QByteArray path = requestLine.value(1);
+    path = path.left(path.indexOf('?') < 0 ? path.size() : path.indexOf('?'));
+
+    QByteArray status, contentType, body;
+    if(method != "GET" && method != "HEAD") {
+        status = "405 Method Not Allowed";
+        contentType = "text/plain";
+        body = "Method Not Allowed\n";
+    } else if(path == "/metrics") {
+        status = "200 OK";
+        contentType = "text/plain; version=0.0.4; charset=utf-8";
+        body = renderMetrics();
+    } else {
+        status = "404 Not Found";
+        contentType = "text/plain";
+        body = "Not Found\n";
+    }
+
+    QByteArray response = "HTTP/1.1 " + status + "\r\n"
+                          "Content-Type: " + contentType + "\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n";
+    if(method != "HEAD")
+        response += body;
+
+    socket->write(response);
+    socket->disconnectFromHost();
+}
+
+QByteArray StatsExporter::renderMetrics() const {
+    QByteArray out;
+    out.reserve(4096);
+
+    appendHeader(out, "trafficgen_running", "gauge", "Whether generation is running.");
+    appendSample(out, "trafficgen_running", m_trfGen->getWorkStatus() ? 1 : 0);
+
+    appendHeader(out, "trafficgen_work_time_seconds", "gauge", "Duration of the current or last run.");
+    appendSample(out, "trafficgen_work_time_seconds", m_trfGen->getWorkTimeInSecs());
+
+    appendHeader(out, "trafficgen_target_rate", "gauge", "Configured offered load, 0 means unlimited.");
+    appendSample(out, "trafficgen_target_rate", m_trfGen->getTargetRate(),
+                 m_trfGen->getRateUnit() == FILES_PER_SEC ? "unit=\"files\"" : "unit=\"bytes\"");
+
+    appendHeader(out, "trafficgen_files_total", "counter", "Files written to the destination.");
+    appendSample(out, "trafficgen_files_total", m_trfGen->getGlobalCnt());
+
+    appendHeader(out, "trafficgen_bytes_total", "counter", "Bytes written to the destination.");
+    appendSample(out, "trafficgen_bytes_total", m_trfGen->getTotalVolInBytes());
+
+    appendHeader(out, "trafficgen_infected_files_total", "counter", "Infected files written to the destination.");
+    appendSample(out, "trafficgen_infected_files_total", m_trfGen->getInfectedFilesNb());
+
+    appendHeader(out, "trafficgen_failed_files_total", "counter", "Files that could not be written.");
+    appendSample(out, "trafficgen_failed_files_total", m_trfGen->getFailedFilesNb());
+
+    // samples of one family have to stay together, so the roots are walked once per family
+    QStringList destinationDirs = m_trfGen->getDestinationDirs();
+    QVector<MetricsTotals> destinationTotals;
+    QVector<QByteArray> destinationLabels;
+    for(int rootIdx = 0; rootIdx < destinationDirs.size(); rootIdx++) {
+        destinationTotals << m_trfGen->getDestinationTotals(rootIdx);
+        destinationLabels << "root=\"" + destinationDirs.at(rootIdx).toUtf8().replace('\\', "\\\\").replace('"', "\\\"") + "\"";
+    }
+
+    appendHeader(out, "trafficgen_destination_files_total", "counter", "Files written to one destination root.");
+    for(int rootIdx = 0; rootIdx < destinationDirs.size(); rootIdx++) {
+        appendSample(out, "trafficgen_destination_files_total", destinationTotals.at(rootIdx).filesCnt, destinationLabels.at(rootIdx));
+    }
+
+    appendHeader(out, "trafficgen_destination_bytes_total", "counter", "Bytes written to one destination root.");
+    for(int rootIdx = 0; rootIdx < destinationDirs.size(); rootIdx++) {
+        appendSample(out, "trafficgen_destination_bytes_total", destinationTotals.at(rootIdx).bytes, destinationLabels.at(rootIdx));
+    }
+
+    appendHeader(out, "trafficgen_destination_failed_files_total", "counter", "Files that could not be written to one destination root.");
+    for(int rootIdx = 0; rootIdx < destinationDirs.size(); rootIdx++) {
+        appendSample(out, "trafficgen_destination_failed_files_total", destinationTotals.at(rootIdx).failedFilesCnt, destinationLabels.at(rootIdx));
+    }
+
+    appendHeader(out, "trafficgen_fsyncs_total", "counter", "fsync or batched syncfs calls made by the copy workers.");
+    appendSample(out, "trafficgen_fsyncs_total", m_trfGen->getSyncsNb());
+
+    appendHeader(out, "trafficgen_fsync_seconds_total", "counter", "Worker time spent syncing written files.");
+    appendSample(out, "trafficgen_fsync_seconds_total", m_trfGen->getSyncTimeInSecs());
+
+    appendHeader(out, "trafficgen_published_files_total", "counter", "Files renamed or linked into place by atomic publish.");
+    appendSample(out, "trafficgen_published_files_total", m_trfGen->getPublishesNb());
+
+    appendHeader(out, "trafficgen_publish_seconds_total", "counter", "Worker time spent renaming or linking files into place.");
+    appendSample(out, "trafficgen_publish_seconds_total", m_trfGen->getPublishTimeInSecs());
+
+    appendHeader(out, "trafficgen_verdicts_total", "counter", "Verdicts of a scan target reached over the network, by outcome.");
+    appendSample(out, "trafficgen_verdicts_total", m_trfGen->getDetectionsNb(), "verdict=\"detected\"");
+    appendSample(out, "trafficgen_verdicts_total", m_trfGen->getMissedDetectionsNb(), "verdict=\"missed\"");
+    appendSample(out, "trafficgen_verdicts_total", m_trfGen->getFalseDetectionsNb(), "verdict=\"false\"");
+
+    appendHeader(out, "trafficgen_backlog_files", "gauge", "Files waiting in the destination directory, in backpressure mode.");
+    appendSample(out, "trafficgen_backlog_files", m_trfGen->getBacklog());
+
+    appendHeader(out, "trafficgen_backlog_limit_files", "gauge", "Backpressure high-water mark, 0 when disabled.");
+    appendSample(out, "trafficgen_backlog_limit_files", m_trfGen->getMaxBacklog());
+
+    appendHeader(out, "trafficgen_throttled_seconds_total", "counter", "Time generation was paused by backpressure.");
+    appendSample(out, "trafficgen_throttled_seconds_total", m_trfGen->getThrottledTimeInSecs());
+
+    appendHeader(out, "trafficgen_scanned_files_total", "counter", "Generated files the scanner deleted or moved away.");
+    appendSample(out, "trafficgen_scanned_files_total", m_trfGen->getScannedFilesNb(CLEAN), "class=\"clean\"");
+    appendSample(out, "trafficgen_scanned_files_total", m_trfGen->getScannedFilesNb(INFECTED), "class=\"infected\"");
+
+    appendHeader(out, "trafficgen_scan_pending_files", "gauge", "Generated files still waiting for the scanner.");
+    appendSample(out, "trafficgen_scan_pending_files", m_trfGen->getPendingScanFilesNb());
+
+    // quantiles come with their _sum and _count, as a summary has to
+    appendHeader(out, "trafficgen_scan_latency_seconds", "summary", "Time from write completion until the scanner removes a file.");
+    for(int type = CLEAN; type <= INFECTED; type++) {
+        QByteArray classLabel = type == CLEAN ? "class=\"clean\"" : "class=\"infected\"";
+        for(double quantile : latencyQuantiles) {
+            appendSample(out, "trafficgen_scan_latency_seconds", m_trfGen->getScanLatencyInNsecs(FILE_TYPE(type), quantile) / 1e9,
+                         classLabel + ",quantile=\"" + QByteArray::number(quantile) + "\"");
+        }
+        appendSample(out, "trafficgen_scan_latency_seconds_sum", m_trfGen->getScanLatencySumInSecs(FILE_TYPE(type)), classLabel);
+        appendSample(out, "trafficgen_scan_latency_seconds_count", m_trfGen->getScannedFilesNb(FILE_TYPE(type)), classLabel);
+    }
+
+    appendHeader(out, "trafficgen_files_per_second", "gauge", "Files written per second over a sliding window.");
+    for(int window : rateWindows) {
+        appendSample(out, "trafficgen_files_per_second", m_trfGen->getFilesRate(window),
+                     "window=\"" + QByteArray::number(window) + "s\"");
+    }
+
+    appendHeader(out, "trafficgen_bytes_per_second", "gauge", "Bytes written per second over a sliding window.");
+    for(int window : rateWindows) {
+        appendSample(out, "trafficgen_bytes_per_second", m_trfGen->getBytesRate(window),
+                     "window=\"" + QByteArray::number(window) + "s\"");
+    }
+
+    appendHeader(out, "trafficgen_copy_latency_seconds", "summary", "Per-file write latency since start.");
+    for(double quantile : latencyQuantiles) {
+        appendSample(out, "trafficgen_copy_latency_seconds", m_trfGen->getCopyLatencyInNsecs(quantile) / 1e9,
+                     "quantile=\"" + QByteArray::number(quantile) + "\"");
+    }
+    qint64 copyLatencyCount = 0;
+    foreach(qint64 bucketCount, m_trfGen->getCopyLatencyBuckets()) {
+        copyLatencyCount += bucketCount;
+    }
+    appendSample(out, "trafficgen_copy_latency_seconds_sum", m_trfGen->getCopyLatencySumInSecs());
+    appendSample(out, "trafficgen_copy_latency_seconds_count", copyLatencyCount);
+
+    return out;
+}
+
+void StatsExporter::writeLogRecord() {
+    if(!m_logFile.isOpen())
+        return;
+
+    QString timestamp = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+    if(m_logFormat == JSONL_LOG) {
+        QJsonObject record;
+        record["timestamp"] = timestamp;
+        record["running"] = m_trfGen->getWorkStatus();
+        record["work_time_s"] = m_trfGen->getWorkTimeInSecs();
+        record["files"] = m_trfGen->getGlobalCnt();
+        record["bytes"] = m_trfGen->getTotalVolInBytes();
+        record["infected"] = m_trfGen->getInfectedFilesNb();
+        record["failed"] = m_trfGen->getFailedFilesNb();
+        record["backlog"] = m_trfGen->getBacklog();
+        record["throttled_s"] = m_trfGen->getThrottledTimeInSecs();
+        for(int window : rateWindows) {
+            record[QString("files_rate_%1s").arg(window)] = m_trfGen->getFilesRate(window);
+            record[QString("bytes_rate_%1s").arg(window)] = m_trfGen->getBytesRate(window);
+        }
+        record["latency_p50_s"] = m_trfGen->getCopyLatencyInNsecs(0.5) / 1e9;
+        record["latency_p99_s"] = m_trfGen->getCopyLatencyInNsecs(0.99) / 1e9;
+        record["latency_p999_s"] = m_trfGen->getCopyLatencyInNsecs(0.999) / 1e9;
+        record["scan_latency_clean_p50_s"] = m_trfGen->getScanLatencyInNsecs(CLEAN, 0.5) / 1e9;
+        record["scan_latency_clean_p99_s"] = m_trfGen->getScanLatencyInNsecs(CLEAN, 0.99) / 1e9;
+        record["scan_latency_infected_p50_s"] = m_trfGen->getScanLatencyInNsecs(INFECTED, 0.5) / 1e9;
+        record["scan_latency_infected_p99_s"] = m_trfGen->getScanLatencyInNsecs(INFECTED, 0.99) / 1e9;
+        record["fsyncs"] = m_trfGen->getSyncsNb();
+        record["fsync_s"] = m_trfGen->getSyncTimeInSecs();
+        record["publishes"] = m_trfGen->getPublishesNb();
+        record["publish_s"] = m_trfGen->getPublishTimeInSecs();
+        record["detections"] = m_trfGen->getDetectionsNb();
+        record["missed_detections"] = m_trfGen->getMissedDetectionsNb();
+        record["false_detections"] = m_trfGen->getFalseDetectionsNb();
+        m_logFile.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+    } else {
+        QStringList fields;
+        fields << timestamp
+               << QString::number(m_trfGen->getWorkStatus() ? 1 : 0)
+               << QString::number(m_trfGen->getWorkTimeInSecs(), 'f', 3)
+               << QString::number(m_trfGen->getGlobalCnt())
+               << QString::number(m_trfGen->getTotalVolInBytes(), 'f', 0)
+               << QString::number(m_trfGen->getInfectedFilesNb())
+               << QString::number(m_trfGen->getFailedFilesNb())
+               << QString::number(m_trfGen->getBacklog())
+               << QString::number(m_trfGen->getThrottledTimeInSecs(), 'f', 3);
+        for(int window : rateWindows) {
+            fields << QString::number(m_trfGen->getFilesRate(window), 'f', 2);
+        }
+        for(int window : rateWindows) {
+            fields << QString::number(m_trfGen->getBytesRate(window), 'f', 0);
+        }
+        for(double quantile : latencyQuantiles) {
+            fields << QString::number(m_trfGen->getCopyLatencyInNsecs(quantile) / 1e9, 'g', 6);
+        }
+        fields << QString::number(m_trfGen->getScanLatencyInNsecs(CLEAN, 0.5) / 1e9, 'g', 6)
+               << QString::number(m_trfGen->getScanLatencyInNsecs(CLEAN, 0.99) / 1e9, 'g', 6)
+               << QString::number(m_trfGen->getScanLatencyInNsecs(INFECTED, 0.5) / 1e9, 'g', 6)
+               << QString::number(m_trfGen->getScanLatencyInNsecs(INFECTED, 0.99) / 1e9, 'g', 6)
+               << QString::number(m_trfGen->getSyncsNb())
+               << QString::number(m_trfGen->getSyncTimeInSecs(), 'f', 6)
+               << QString::number(m_trfGen->getPublishesNb())
+               << QString::number(m_trfGen->getPublishTimeInSecs(), 'f', 6)
+               << QString::number(m_trfGen->getDetectionsNb())
+               << QString::number(m_trfGen->getMissedDetectionsNb())
+               << QString::number(m_trfGen->getFalseDetectionsNb());
+        m_logFile.write(fields.join(',').toUtf8() + '\n');
+    }
+    m_logFile.flush();
+}
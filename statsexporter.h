@@ -0,0 +1,64 @@
+#ifndef STATSEXPORTER_H
+#define STATSEXPORTER_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+
+#include "trafficgenerator.h"
+
+#define     DEFAULT_METRICS_ADDRESS         "127.0.0.1"
+#define     DEFAULT_STATS_LOG_INTERVAL      1
+#define     MAX_HTTP_REQUEST_SIZE           8192
+
+enum STATS_LOG_FORMAT {
+    CSV_LOG,
+    JSONL_LOG
+};
+
+// publishes generator statistics as a Prometheus /metrics endpoint and as a
+// time-series CSV/JSONL log. Runs on its own thread and reads the lock-free
+// counters, the atomic target rate and a copy of the destination roots taken
+// under their lock, so scrapes and disk writes never stall the copy workers.
+class StatsExporter : public QObject {
+
+    Q_OBJECT
+
+    const TrafficGenerator* m_trfGen;
+    QThread m_thread;
+
+    QTcpServer* m_server{nullptr};
+    quint16 m_port{0};
+
+    QTimer* m_logTimer{nullptr};
+    QFile m_logFile;
+    STATS_LOG_FORMAT m_logFormat{CSV_LOG};
+
+    bool startListening(const QHostAddress& address, quint16 port);
+    bool startLogging(const QString& fileName, int intervalInSecs);
+    void shutdown();
+
+    void acceptConnections();
+    void readRequest(QTcpSocket* socket);
+    void writeLogRecord();
+
+public:
+    explicit StatsExporter(const TrafficGenerator* trfGen);
+    ~StatsExporter();
+
+    bool listen(const QHostAddress& address, quint16 port);
+    bool openLog(const QString& fileName, int intervalInSecs = DEFAULT_STATS_LOG_INTERVAL);
+
+    quint16 getPort() const;
+    QString getLogFileName() const;
+
+    QByteArray renderMetrics() const;
+
+    static STATS_LOG_FORMAT logFormatFor(const QString& fileName);
+};
+
+#endif // STATSEXPORTER_H
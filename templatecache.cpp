@@ -0,0 +1,101 @@
+#include "templatecache.h"
+
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+TemplateCache::TemplateCache() {
+}
+
+TemplateCache::~TemplateCache() {
+    clear();
+}
+
+void TemplateCache::setBudgetInBytes(qint64 budgetInBytes) {
+    QWriteLocker locker(&m_lock);
+    m_budgetInBytes = qMax(qint64(0), budgetInBytes);
+}
+
+qint64 TemplateCache::getBudgetInBytes() const {
+    QReadLocker locker(&m_lock);
+    return m_budgetInBytes;
+}
+
+qint64 TemplateCache::getUsedInBytes() const {
+    QReadLocker locker(&m_lock);
+    return m_usedInBytes;
+}
+
+int TemplateCache::getTemplatesNb() const {
+    QReadLocker locker(&m_lock);
+    int templatesNb = 0;
+    foreach(const Entry& entry, m_entries) {
+        if(entry.data)
+            templatesNb++;
+    }
+    return templatesNb;
+}
+
+bool TemplateCache::isEnabled() const {
+    QReadLocker locker(&m_lock);
+    return m_budgetInBytes > 0;
+}
+
+const uchar* TemplateCache::acquire(const QString& path, qint64& size) {
+    {
+        QReadLocker locker(&m_lock);
+        QHash<QString, Entry>::const_iterator it = m_entries.constFind(path);
+        if(it != m_entries.constEnd()) {
+            size = it->size;
+            return it->data;
+        }
+    }
+
+    QWriteLocker locker(&m_lock);
+
+    // another worker could map the same template while we waited for the lock
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind(path);
+    if(it != m_entries.constEnd()) {
+        size = it->size;
+        return it->data;
+    }
+
+    // templates that don't fit are remembered with empty data, so workers
+    // don't reopen them on every copy
+    Entry entry;
+    QFile* file = new QFile(path);
+    if(!file->open(QIODevice::ReadOnly) || !file->size() ||
+       m_usedInBytes + file->size() > m_budgetInBytes) {
+        delete file;
+        m_entries.insert(path, entry);
+        return nullptr;
+    }
+
+    entry.size = file->size();
+    entry.data = file->map(0, entry.size);
+    if(!entry.data) {
+        delete file;
+        entry.size = 0;
+        m_entries.insert(path, entry);
+        return nullptr;
+    }
+    entry.file = file;
+#ifdef Q_OS_LINUX
+    ::madvise(const_cast<uchar*>(entry.data), size_t(entry.size), MADV_WILLNEED);
+#endif
+
+    m_usedInBytes += entry.size;
+    m_entries.insert(path, entry);
+
+    size = entry.size;
+    return entry.data;
+}
+
+void TemplateCache::clear() {
+    QWriteLocker locker(&m_lock);
+    foreach(const Entry& entry, m_entries) {
+        delete entry.file;
+    }
+    m_entries.clear();
+    m_usedInBytes = 0;
+}
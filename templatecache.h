@@ -0,0 +1,41 @@
+#ifndef TEMPLATECACHE_H
+#define TEMPLATECACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QFile>
+#include <QReadWriteLock>
+
+#define     DEFAULT_TEMPLATE_CACHE_BUDGET_MB    1024
+
+// each template is mapped into memory once and stays mapped until clear(),
+// so the pointers returned by acquire() are valid for the whole run
+class TemplateCache {
+
+    struct Entry {
+        QFile* file{nullptr};
+        const uchar* data{nullptr};
+        qint64 size{0};
+    };
+
+    qint64 m_budgetInBytes{qint64(DEFAULT_TEMPLATE_CACHE_BUDGET_MB) * 1024 * 1024};
+    qint64 m_usedInBytes{0};
+
+    QHash<QString, Entry> m_entries;
+    mutable QReadWriteLock m_lock;
+
+public:
+    TemplateCache();
+    ~TemplateCache();
+
+    void setBudgetInBytes(qint64 budgetInBytes);
+    qint64 getBudgetInBytes() const;
+    qint64 getUsedInBytes() const;
+    int getTemplatesNb() const;
+    bool isEnabled() const;
+
+    const uchar* acquire(const QString& path, qint64& size);
+    void clear();
+};
+
+#endif // TEMPLATECACHE_H
@@ -0,0 +1,221 @@
+#include "templateindexer.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QTextStream>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <functional>
+
+bool TemplateFilter::accepts(const QString& fileName, qint64 size) const {
+    if(size < minSize || (maxSize > 0 && size > maxSize))
+        return false;
+    if(extensions.isEmpty())
+        return true;
+
+    int dotIdx = fileName.lastIndexOf('.');
+    return dotIdx >= 0 && extensions.contains(fileName.mid(dotIdx + 1), Qt::CaseInsensitive);
+}
+
+// -----------------------------------------------------------------------------------------
+
+static bool pathLessThan(const TemplateEntry& left, const TemplateEntry& right) {
+    return left.path < right.path;
+}
+
+static void runThreads(int threadsNb, const std::function<void(int)>& work) {
+    QVector<QThread*> threads;
+    for(int i = 0; i < threadsNb; i++) {
+        threads << QThread::create([work, i]() { work(i); });
+        threads.last()->start();
+    }
+    foreach(QThread* thread, threads) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+TemplateIndexer::TemplateIndexer() {
+    m_threadsNb = qMax(1, QThread::idealThreadCount());
+}
+
+void TemplateIndexer::setThreadsNb(int threadsNb) {
+    m_threadsNb = qMax(1, threadsNb);
+}
+
+int TemplateIndexer::getThreadsNb() const {
+    return m_threadsNb;
+}
+
+void TemplateIndexer::setFilter(const TemplateFilter& filter) {
+    m_filter = filter;
+}
+
+const TemplateFilter& TemplateIndexer::getFilter() const {
+    return m_filter;
+}
+
+QVector<TemplateEntry> TemplateIndexer::scanDirs(const QStringList& dirs) const {
+    QStringList pendingDirs;
+    foreach(const QString& dir, dirs) {
+        pendingDirs << QDir(dir).absolutePath();
+    }
+
+    QMutex mutex;
+    QWaitCondition dirAvailable;
+    int busyThreadsNb = 0;
+    QVector<TemplateEntry> entries;
+
+    // a thread only quits when the queue is empty and nobody can refill it
+    runThreads(m_threadsNb, [&](int) {
+        QVector<TemplateEntry> found;
+        forever {
+            QString dir;
+            {
+                QMutexLocker locker(&mutex);
+                while(pendingDirs.isEmpty() && busyThreadsNb) {
+                    dirAvailable.wait(&mutex);
+                }
+                if(pendingDirs.isEmpty()) {
+                    entries << found;
+                    return;
+                }
+                dir = pendingDirs.takeLast();
+                busyThreadsNb++;
+            }
+
+            QStringList subDirs;
+            QDirIterator it(dir, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks | QDir::Hidden);
+            while(it.hasNext()) {
+                it.next();
+                QFileInfo fileInfo = it.fileInfo();
+                if(fileInfo.isDir()) {
+                    subDirs << fileInfo.filePath();
+                } else if(m_filter.accepts(fileInfo.fileName(), fileInfo.size())) {
+                    TemplateEntry entry;
+                    entry.path = fileInfo.filePath();
+                    entry.size = fileInfo.size();
+                    found << entry;
+                }
+            }
+
+            QMutexLocker locker(&mutex);
+            pendingDirs << subDirs;
+            busyThreadsNb--;
+            dirAvailable.wakeAll();
+        }
+    });
+
+    std::sort(entries.begin(), entries.end(), pathLessThan);
+    return entries;
+}
+
+// one template per line: "<path>" or "<path><TAB><weight>", relative paths start
+// at the manifest's directory, empty lines and lines starting with # are skipped
+QVector<TemplateEntry> TemplateIndexer::readManifest(const QString& fileName, bool* ok) const {
+    QVector<TemplateEntry> entries;
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        if(ok)
+            *ok = false;
+        return entries;
+    }
+
+    QDir baseDir = QFileInfo(fileName).absoluteDir();
+    QTextStream in(&file);
+    while(!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        TemplateEntry entry;
+        int tabIdx = line.lastIndexOf('\t');
+        if(tabIdx > 0) {
+            bool weightOk;
+            double weight = line.mid(tabIdx + 1).toDouble(&weightOk);
+            if(weightOk && weight >= 0.) {
+                entry.weight = weight;
+                line.truncate(tabIdx);
+            }
+        }
+        entry.path = QDir::cleanPath(baseDir.absoluteFilePath(line));
+        entries << entry;
+    }
+    if(ok)
+        *ok = true;
+
+    // stat the listed files in parallel, each thread takes an interleaved share
+    QVector<char> accepted(entries.size(), 0);
+    int threadsNb = qBound(1, entries.size(), m_threadsNb);
+    runThreads(threadsNb, [&](int threadIdx) {
+        for(int i = threadIdx; i < entries.size(); i += threadsNb) {
+            QFileInfo fileInfo(entries.at(i).path);
+            if(fileInfo.isFile() && m_filter.accepts(fileInfo.fileName(), fileInfo.size())) {
+                entries[i].size = fileInfo.size();
+                accepted[i] = 1;
+            }
+        }
+    });
+
+    QVector<TemplateEntry> acceptedEntries;
+    acceptedEntries.reserve(entries.size());
+    for(int i = 0; i < entries.size(); i++) {
+        if(accepted.at(i))
+            acceptedEntries << entries.at(i);
+    }
+    return acceptedEntries;
+}
+
+bool TemplateIndexer::saveIndex(const QString& fileName, const TemplatePool& pool) {
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << quint32(TEMPLATE_INDEX_MAGIC) << quint32(TEMPLATE_INDEX_VERSION)
+        << quint8(pool.getType()) << qint32(pool.size());
+    foreach(const TemplateEntry& entry, pool.getEntries()) {
+        out << entry.path << entry.size << entry.weight;
+    }
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool TemplateIndexer::loadIndex(const QString& fileName, TemplatePool& pool) {
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic, version;
+    quint8 type;
+    qint32 entriesNb;
+    in >> magic >> version >> type >> entriesNb;
+    if(in.status() != QDataStream::Ok || magic != TEMPLATE_INDEX_MAGIC || version != TEMPLATE_INDEX_VERSION ||
+       type != quint8(pool.getType()) || entriesNb < 0)
+        return false;
+
+    // the count comes from the file, a corrupt one mustn't size the allocation
+    QVector<TemplateEntry> entries;
+    entries.reserve(int(qMin(qint64(entriesNb), file.bytesAvailable() / MIN_INDEX_ENTRY_SIZE)));
+    for(int i = 0; i < entriesNb && in.status() == QDataStream::Ok; i++) {
+        TemplateEntry entry;
+        in >> entry.path >> entry.size >> entry.weight;
+        entries << entry;
+    }
+    if(in.status() != QDataStream::Ok)
+        return false;
+
+    pool.clear();
+    pool.addEntries(entries);
+    return true;
+}
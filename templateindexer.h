@@ -0,0 +1,51 @@
+#ifndef TEMPLATEINDEXER_H
+#define TEMPLATEINDEXER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "templatepool.h"
+
+#define     TEMPLATE_INDEX_MAGIC        0x54474958
+#define     TEMPLATE_INDEX_VERSION      1
+// path length, size and weight of an entry with an empty path
+#define     MIN_INDEX_ENTRY_SIZE        20
+
+// extensions are matched case-insensitively without the dot, an empty list
+// accepts everything, a zero max size means no limit
+struct TemplateFilter {
+    QStringList extensions;
+    qint64 minSize{0};
+    qint64 maxSize{0};
+
+    bool accepts(const QString& fileName, qint64 size) const;
+};
+
+// builds template lists from directory trees or manifest files. Directories are
+// walked by a pool of threads sharing one queue of pending directories, so
+// stat-bound scans of large trees are spread across cores/disks. Results are
+// sorted by path to keep runs reproducible whatever the scan order was.
+class TemplateIndexer {
+
+    int m_threadsNb;
+    TemplateFilter m_filter;
+
+public:
+    TemplateIndexer();
+
+    void setThreadsNb(int threadsNb);
+    int getThreadsNb() const;
+
+    void setFilter(const TemplateFilter& filter);
+    const TemplateFilter& getFilter() const;
+
+    QVector<TemplateEntry> scanDirs(const QStringList& dirs) const;
+    QVector<TemplateEntry> readManifest(const QString& fileName, bool* ok = nullptr) const;
+
+    // compact binary snapshot of a pool, reloaded without touching the templates
+    static bool saveIndex(const QString& fileName, const TemplatePool& pool);
+    static bool loadIndex(const QString& fileName, TemplatePool& pool);
+};
+
+#endif // TEMPLATEINDEXER_H
@@ -0,0 +1,135 @@
+#include "templatepool.h"
+
+#include <QFileInfo>
+
+TemplatePool::TemplatePool(FILE_TYPE type): m_type(type) {
+}
+
+FILE_TYPE TemplatePool::getType() const {
+    return m_type;
+}
+
+void TemplatePool::add(const QString& path, qint64 size, double weight) {
+    TemplateEntry entry;
+    entry.path = path;
+    entry.fileName = path.mid(path.lastIndexOf('/') + 1);
+    entry.size = size;
+    entry.type = m_type;
+    entry.weight = weight;
+
+    m_entries.append(entry);
+    if(weight != 1.)
+        m_uniform = false;
+    m_aliases.clear();
+}
+
+// one stat per file: QFileInfo caches existence, type and size together
+int TemplatePool::addFiles(const QStringList& fileNames) {
+    int addedNb = 0;
+    m_entries.reserve(m_entries.size() + fileNames.size());
+    foreach(const QString& fileName, fileNames) {
+        QFileInfo fileInfo(fileName);
+        if(fileInfo.isFile()) {
+            add(fileInfo.absoluteFilePath(), fileInfo.size());
+            addedNb++;
+        }
+    }
+    return addedNb;
+}
+
+void TemplatePool::addEntries(const QVector<TemplateEntry>& entries) {
+    m_entries.reserve(m_entries.size() + entries.size());
+    foreach(const TemplateEntry& entry, entries) {
+        add(entry.path, entry.size, entry.weight);
+    }
+}
+
+void TemplatePool::clear() {
+    m_entries.clear();
+    m_generation++;
+    m_uniform = true;
+    m_aliasProbabilities.clear();
+    m_aliases.clear();
+}
+
+int TemplatePool::size() const {
+    return m_entries.size();
+}
+
+quint64 TemplatePool::getGeneration() const {
+    return m_generation;
+}
+
+bool TemplatePool::isEmpty() const {
+    return m_entries.isEmpty();
+}
+
+const TemplateEntry& TemplatePool::at(int idx) const {
+    return m_entries.at(idx);
+}
+
+const QVector<TemplateEntry>& TemplatePool::getEntries() const {
+    return m_entries;
+}
+
+qint64 TemplatePool::getTotalSize() const {
+    qint64 totalSize = 0;
+    foreach(const TemplateEntry& entry, m_entries) {
+        totalSize += entry.size;
+    }
+    return totalSize;
+}
+
+// Vose's alias method, O(n) to build and O(1) per pick
+void TemplatePool::buildAliasTable() {
+    int entriesNb = m_entries.size();
+    m_aliasProbabilities.fill(1., entriesNb);
+    m_aliases.resize(entriesNb);
+    for(int i = 0; i < entriesNb; i++) {
+        m_aliases[i] = i;
+    }
+
+    if(m_uniform || !entriesNb)
+        return;
+
+    double totalWeight = 0.;
+    foreach(const TemplateEntry& entry, m_entries) {
+        totalWeight += entry.weight;
+    }
+    if(totalWeight <= 0.)
+        return;
+
+    QVector<double> scaled(entriesNb);
+    QVector<int> small, large;
+    small.reserve(entriesNb);
+    large.reserve(entriesNb);
+    for(int i = 0; i < entriesNb; i++) {
+        scaled[i] = m_entries.at(i).weight * entriesNb / totalWeight;
+        if(scaled[i] < 1.) {
+            small << i;
+        } else {
+            large << i;
+        }
+    }
+
+    while(!small.isEmpty() && !large.isEmpty()) {
+        int less = small.takeLast();
+        int more = large.last();
+
+        m_aliasProbabilities[less] = scaled[less];
+        m_aliases[less] = more;
+
+        scaled[more] = (scaled[more] + scaled[less]) - 1.;
+        if(scaled[more] < 1.) {
+            large.removeLast();
+            small << more;
+        }
+    }
+}
+
+int TemplatePool::pick(QRandomGenerator& rng) const {
+    int idx = int(rng.bounded(m_entries.size()));
+    if(m_uniform || m_aliases.size() != m_entries.size())
+        return idx;
+    return rng.generateDouble() < m_aliasProbabilities.at(idx) ? idx : m_aliases.at(idx);
+}
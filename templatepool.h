@@ -0,0 +1,56 @@
+#ifndef TEMPLATEPOOL_H
+#define TEMPLATEPOOL_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QRandomGenerator>
+
+enum FILE_TYPE {
+    CLEAN,
+    INFECTED
+};
+
+struct TemplateEntry {
+    QString path;
+    QString fileName;
+    qint64 size{0};
+    FILE_TYPE type{CLEAN};
+    double weight{1.};
+};
+
+// contiguous storage of one template class. Picking is an alias-method lookup,
+// so selection and classification don't depend on the pool size.
+class TemplatePool {
+
+    FILE_TYPE m_type;
+    QVector<TemplateEntry> m_entries;
+    // bumped whenever existing entries go away, appends leave it as is
+    quint64 m_generation{0};
+
+    bool m_uniform{true};
+    QVector<double> m_aliasProbabilities;
+    QVector<int> m_aliases;
+
+public:
+    explicit TemplatePool(FILE_TYPE type);
+
+    FILE_TYPE getType() const;
+
+    void add(const QString& path, qint64 size, double weight = 1.);
+    int addFiles(const QStringList& fileNames);
+    void addEntries(const QVector<TemplateEntry>& entries);
+    void clear();
+
+    int size() const;
+    bool isEmpty() const;
+    quint64 getGeneration() const;
+    const TemplateEntry& at(int idx) const;
+    const QVector<TemplateEntry>& getEntries() const;
+    qint64 getTotalSize() const;
+
+    void buildAliasTable();
+    int pick(QRandomGenerator& rng) const;
+};
+
+#endif // TEMPLATEPOOL_H
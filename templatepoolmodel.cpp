@@ -0,0 +1,58 @@
+#include "templatepoolmodel.h"
+
+TemplatePoolModel::TemplatePoolModel(const TemplatePool* pool, QObject* parent): QAbstractTableModel(parent), m_pool(pool) {
+    m_rowsNb = m_pool->size();
+    m_poolGeneration = m_pool->getGeneration();
+}
+
+int TemplatePoolModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : m_rowsNb;
+}
+
+int TemplatePoolModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : COLUMNS_NB;
+}
+
+QVariant TemplatePoolModel::data(const QModelIndex& index, int role) const {
+    if(!index.isValid() || index.row() >= m_rowsNb)
+        return QVariant();
+
+    const TemplateEntry& entry = m_pool->at(index.row());
+    switch(role) {
+        case Qt::DisplayRole:
+            return index.column() == FILE_NAME_COLUMN ? QVariant(entry.fileName) :
+                                                        QVariant(QString::number(entry.size / (1024. * 1024.), 'f', 2));
+        case Qt::ToolTipRole:
+            return entry.path;
+        case Qt::TextAlignmentRole:
+            return index.column() == FILE_SIZE_COLUMN ? QVariant(int(Qt::AlignRight | Qt::AlignVCenter)) : QVariant();
+        default:
+            return QVariant();
+    }
+}
+
+QVariant TemplatePoolModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if(role != Qt::DisplayRole)
+        return QVariant();
+
+    if(orientation == Qt::Vertical)
+        return section + 1;
+    return section == FILE_NAME_COLUMN ? "Файл" : "Размер\n(Мбайт)";
+}
+
+// pools only grow by appending or are cleared as a whole
+void TemplatePoolModel::sync() {
+    int poolSize = m_pool->size();
+    quint64 poolGeneration = m_pool->getGeneration();
+    if(poolGeneration != m_poolGeneration || poolSize < m_rowsNb) {
+        // the rows already shown were replaced, even if the size came out the same
+        beginResetModel();
+        m_rowsNb = poolSize;
+        m_poolGeneration = poolGeneration;
+        endResetModel();
+    } else if(poolSize > m_rowsNb) {
+        beginInsertRows(QModelIndex(), m_rowsNb, poolSize - 1);
+        m_rowsNb = poolSize;
+        endInsertRows();
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef TEMPLATEPOOLMODEL_H
+#define TEMPLATEPOOLMODEL_H
+
+#include <QAbstractTableModel>
+
+#include "templatepool.h"
+
+enum TEMPLATE_POOL_COLUMN {
+    FILE_NAME_COLUMN,
+    FILE_SIZE_COLUMN,
+    COLUMNS_NB
+};
+
+// read-only view of a template pool. Rows are produced on demand from the pool
+// entries (sizes are cached there at load time), sync() only reports the rows
+// appended since the previous call, so the cost doesn't grow with the pool. A
+// pool that was cleared in between resets the model.
+class TemplatePoolModel : public QAbstractTableModel {
+
+    Q_OBJECT
+
+    const TemplatePool* m_pool;
+    int m_rowsNb{0};
+    quint64 m_poolGeneration{0};
+
+public:
+    explicit TemplatePoolModel(const TemplatePool* pool, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    void sync();
+};
+
+#endif // TEMPLATEPOOLMODEL_H
@@ -0,0 +1,173 @@
+#include "tracefile.h"
+
+#include <QDateTime>
+
+#include "payloadgenerator.h"
+
+TraceReader::TraceReader() {
+}
+
+bool TraceReader::open(const QString& fileName) {
+    close();
+    m_file.setFileName(fileName);
+    m_lineNb = 0;
+    m_skippedLinesNb = 0;
+    return m_file.open(QIODevice::ReadOnly);
+}
+
+void TraceReader::close() {
+    m_file.close();
+}
+
+bool TraceReader::isOpen() const {
+    return m_file.isOpen();
+}
+
+bool TraceReader::next(TraceEvent& event) {
+    while(!m_file.atEnd()) {
+        QByteArray line = m_file.readLine().trimmed();
+        m_lineNb++;
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QList<QByteArray> fields = line.split('\t');
+        bool timeOk = false, sizeOk = false;
+        if(fields.size() >= 3) {
+            event.timeInUsecs = fields.at(0).toLongLong(&timeOk);
+            event.size = fields.at(1).toLongLong(&sizeOk);
+        }
+        if(!timeOk || !sizeOk || event.timeInUsecs < 0 || event.size < 0) {
+            m_skippedLinesNb++;
+            continue;
+        }
+
+        event.type = fields.at(2) == "i" ? INFECTED : CLEAN;
+        event.templatePath = fields.size() > 3 ? QString::fromUtf8(fields.at(3)) : QString();
+        return true;
+    }
+    return false;
+}
+
+qint64 TraceReader::getSkippedLinesNb() const {
+    return m_skippedLinesNb;
+}
+
+static bool parseTime(const QString& value, qint64& timeInUsecs) {
+    bool ok;
+    double timeInSecs = value.toDouble(&ok);
+    if(ok) {
+        timeInUsecs = qint64(timeInSecs * 1e6);
+        return true;
+    }
+
+    QDateTime dateTime = QDateTime::fromString(value, Qt::ISODateWithMs);
+    timeInUsecs = dateTime.toMSecsSinceEpoch() * 1000;
+    return dateTime.isValid();
+}
+
+qint64 TraceReader::import(const QString& logFileName, const QString& traceFileName,
+                           const QStringList& columns, QString* error) {
+    int timeColumn = columns.indexOf("time");
+    int sizeColumn = columns.indexOf("size");
+    int classColumn = columns.indexOf("class");
+    int templateColumn = columns.indexOf("template");
+
+    QFile logFile(logFileName);
+    TraceWriter writer;
+    QString errorText;
+    if(timeColumn < 0 || sizeColumn < 0) {
+        errorText = "the time and size columns are required";
+    } else if(!logFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        errorText = logFile.errorString();
+    } else if(!writer.open(traceFileName)) {
+        errorText = QString("can't write %1").arg(traceFileName);
+    }
+    if(!errorText.isEmpty()) {
+        if(error)
+            *error = errorText;
+        return -1;
+    }
+
+    qint64 eventsNb = 0;
+    qint64 firstTimeInUsecs = 0, lastTimeInUsecs = 0;
+    while(!logFile.atEnd()) {
+        QString line = QString::fromUtf8(logFile.readLine()).trimmed();
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList fields = line.split(line.contains('\t') ? '\t' : ',');
+        if(fields.size() < columns.size())
+            continue;
+
+        TraceEvent event;
+        bool sizeOk;
+        event.size = SizeDistribution::parseSize(fields.at(sizeColumn), &sizeOk);
+        if(!sizeOk || event.size < 0 || !parseTime(fields.at(timeColumn).trimmed(), event.timeInUsecs))
+            continue;
+
+        if(classColumn >= 0) {
+            QString type = fields.at(classColumn).trimmed().toLower();
+            event.type = type == "infected" || type == "i" || type == "1" || type == "true" ? INFECTED : CLEAN;
+        }
+        if(templateColumn >= 0)
+            event.templatePath = fields.at(templateColumn).trimmed();
+
+        if(!eventsNb)
+            firstTimeInUsecs = event.timeInUsecs;
+        event.timeInUsecs = qMax(event.timeInUsecs - firstTimeInUsecs, lastTimeInUsecs);
+        lastTimeInUsecs = event.timeInUsecs;
+
+        writer.write(event);
+        eventsNb++;
+    }
+    return eventsNb;
+}
+
+// -----------------------------------------------------------------------------------------
+
+TraceWriter::TraceWriter() {
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+bool TraceWriter::open(const QString& fileName) {
+    close();
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    m_buffer.reserve(TRACE_WRITE_BUFFER_SIZE);
+    m_buffer.append(TRACE_HEADER "\n");
+    return true;
+}
+
+void TraceWriter::close() {
+    if(m_file.isOpen()) {
+        flush();
+        m_file.close();
+    }
+}
+
+bool TraceWriter::isOpen() const {
+    return m_file.isOpen();
+}
+
+void TraceWriter::flush() {
+    m_file.write(m_buffer);
+    // clear() would drop the reserved capacity and reallocate on every flush
+    m_buffer.resize(0);
+}
+
+void TraceWriter::write(const TraceEvent& event) {
+    m_buffer.append(QByteArray::number(event.timeInUsecs)).append('\t')
+            .append(QByteArray::number(event.size)).append('\t')
+            .append(event.type == INFECTED ? 'i' : 'c');
+    if(!event.templatePath.isEmpty())
+        m_buffer.append('\t').append(event.templatePath.toUtf8());
+    m_buffer.append('\n');
+
+    if(m_buffer.size() >= TRACE_WRITE_BUFFER_SIZE)
+        flush();
+}
@@ -0,0 +1,67 @@
+#ifndef TRACEFILE_H
+#define TRACEFILE_H
+
+#include <QString>
+#include <QStringList>
+#include <QFile>
+
+#include "templatepool.h"
+
+#define     TRACE_HEADER                "# trafficgen-trace 1"
+#define     TRACE_WRITE_BUFFER_SIZE     (1024 * 1024)
+
+// one file arrival, the time is counted from the start of the trace
+struct TraceEvent {
+    qint64 timeInUsecs{0};
+    qint64 size{0};
+    FILE_TYPE type{CLEAN};
+    QString templatePath;
+};
+
+// Trace files are text, one event per line: "<usecs>\t<size>\t<c|i>[\t<template>]".
+// Lines starting with # are comments. They are read and written as streams, so a
+// trace of any length takes constant memory.
+class TraceReader {
+
+    QFile m_file;
+    qint64 m_lineNb{0};
+    qint64 m_skippedLinesNb{0};
+
+public:
+    TraceReader();
+
+    bool open(const QString& fileName);
+    void close();
+    bool isOpen() const;
+
+    // false at the end of the trace, malformed lines are skipped and counted
+    bool next(TraceEvent& event);
+    qint64 getSkippedLinesNb() const;
+
+    // converts a capture log to a trace. columns names the fields of a log line
+    // in order: time (seconds, possibly epoch, or ISO 8601), size, class
+    // (infected/1/true for infected files), template, or skip for the others.
+    // Times are made relative to the first event, ones going back are clamped.
+    static qint64 import(const QString& logFileName, const QString& traceFileName,
+                         const QStringList& columns, QString* error = nullptr);
+};
+
+class TraceWriter {
+
+    QFile m_file;
+    QByteArray m_buffer;
+
+    void flush();
+
+public:
+    TraceWriter();
+    ~TraceWriter();
+
+    bool open(const QString& fileName);
+    void close();
+    bool isOpen() const;
+
+    void write(const TraceEvent& event);
+};
+
+#endif // TRACEFILE_H
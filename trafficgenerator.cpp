@@ -0,0 +1,1033 @@
+#include "trafficgenerator.h"
+
+#include <algorithm>
+
+TrafficGenerator::TrafficGenerator() {
+    m_scheduler.setRate(m_targetRate.load(), m_rateUnit.load());
+}
+
+void TrafficGenerator::setWorkStatus(bool workStatus) {
+
+    if(!m_workStatus && workStatus) {
+        flushStatistic();
+        m_workStatus = true;
+    }
+
+    if(m_workStatus && !workStatus) {
+        m_endTime = QDateTime::currentDateTime();
+        m_endTimeInNsecs = Metrics::nowInNsecs();
+        m_workStatus = false;
+    }
+}
+
+bool TrafficGenerator::getWorkStatus() const {
+    return m_workStatus;
+}
+
+void TrafficGenerator::setCleanFilesDir(const QString& cleanFilesDir) {
+    m_cleanFilesDir = cleanFilesDir;
+}
+
+QString TrafficGenerator::getCleanFilesDir() const {
+    return m_cleanFilesDir;
+}
+
+TemplatePool& TrafficGenerator::getCleanFiles() {
+    return m_cleanFiles;
+}
+
+TemplatePool& TrafficGenerator::getInfectedFiles() {
+    return m_infectedFiles;
+}
+
+void TrafficGenerator::setInfectedFilesDir(const QString& infectedFilesDir) {
+    m_infectedFilesDir = infectedFilesDir;
+}
+
+QString TrafficGenerator::getInfectedFilesDir() const {
+    return m_infectedFilesDir;
+}
+
+void TrafficGenerator::setDestinationDir(const QString& destinationDir) {
+    QMutexLocker locker(&m_destinationDirsMutex);
+    m_destinationDirs = QStringList() << destinationDir;
+}
+
+// the first root
+QString TrafficGenerator::getDestinationDir() const {
+    QMutexLocker locker(&m_destinationDirsMutex);
+    return m_destinationDirs.value(0);
+}
+
+// files are spread round-robin over the roots, each root has its own copy workers
+void TrafficGenerator::setDestinationDirs(const QStringList& destinationDirs) {
+    QMutexLocker locker(&m_destinationDirsMutex);
+    m_destinationDirs = destinationDirs;
+}
+
+// the exporter's thread copies the list too, the copy is taken under the lock
+QStringList TrafficGenerator::getDestinationDirs() const {
+    QMutexLocker locker(&m_destinationDirsMutex);
+    return m_destinationDirs;
+}
+
+// fan-out of hashed subdirectories inside every root, 0 writes into the roots directly
+void TrafficGenerator::setSubdirsNb(int subdirsNb) {
+    m_subdirsNb = qBound(0, subdirsNb, MAX_SUBDIRS_NB);
+}
+
+int TrafficGenerator::getSubdirsNb() const {
+    return m_subdirsNb;
+}
+
+void TrafficGenerator::setGenerateInterval(int generateInterval) {
+    m_generateInterval = generateInterval;
+    applyIntervalRate();
+}
+
+int TrafficGenerator::getGenerateInterval() const {
+    return m_generateInterval;
+}
+
+void TrafficGenerator::setFilesPerInterval(int filesPerInterval) {
+    m_filesPerInterval = filesPerInterval;
+    applyIntervalRate();
+}
+
+int TrafficGenerator::getFilesPerInterval() const {
+    return m_filesPerInterval;
+}
+
+void TrafficGenerator::setIntervalRateUnit(RATE_UNIT rateUnit) {
+    m_intervalRateUnit = rateUnit;
+    applyIntervalRate();
+}
+
+RATE_UNIT TrafficGenerator::getIntervalRateUnit() const {
+    return m_intervalRateUnit;
+}
+
+void TrafficGenerator::applyIntervalRate() {
+    double amount = m_intervalRateUnit == BYTES_PER_SEC ? m_filesPerInterval * 1024. * 1024. : m_filesPerInterval;
+    setTargetRate(amount / m_generateInterval, m_intervalRateUnit);
+}
+
+void TrafficGenerator::setTargetRate(double targetRate, RATE_UNIT rateUnit) {
+    m_targetRate = targetRate;
+    m_rateUnit = rateUnit;
+    m_scheduler.setRate(targetRate, rateUnit);
+}
+
+double TrafficGenerator::getTargetRate() const {
+    return m_targetRate;
+}
+
+RATE_UNIT TrafficGenerator::getRateUnit() const {
+    return m_rateUnit;
+}
+
+void TrafficGenerator::setInfectedFileGenerateProbability(double infectedFileGenerateProbability) {
+    m_infectedFileGenerateProbability = infectedFileGenerateProbability;
+}
+
+void TrafficGenerator::setPayloadSource(PAYLOAD_SOURCE payloadSource) {
+    m_payloadSource = payloadSource;
+}
+
+PAYLOAD_SOURCE TrafficGenerator::getPayloadSource() const {
+    return m_payloadSource;
+}
+
+void TrafficGenerator::setSizeDistribution(const SizeDistribution& sizeDistribution) {
+    m_payloadGenerator.setSizeDistribution(sizeDistribution);
+}
+
+const SizeDistribution& TrafficGenerator::getSizeDistribution() const {
+    return m_payloadGenerator.getSizeDistribution();
+}
+
+// a fixed seed replays the same files, infection decisions and contents on every run
+void TrafficGenerator::setSeed(quint64 seed) {
+    m_seed = seed;
+    m_seedFixed = true;
+}
+
+// every run draws a new seed, getSeed() tells it afterwards
+void TrafficGenerator::resetSeed() {
+    m_seedFixed = false;
+}
+
+bool TrafficGenerator::isSeedFixed() const {
+    return m_seedFixed;
+}
+
+quint64 TrafficGenerator::getSeed() const {
+    return m_seed;
+}
+
+static QRandomGenerator streamGenerator(quint64 seed, RANDOM_STREAM stream) {
+    quint64 streamSeed = PayloadGenerator::deriveSeed(seed, stream);
+    quint32 seedWords[2] = {quint32(streamSeed), quint32(streamSeed >> 32)};
+    return QRandomGenerator(seedWords, seedWords + 2);
+}
+
+void TrafficGenerator::seedStreams() {
+    if(!m_seedFixed)
+        m_seed = QRandomGenerator::global()->generate64();
+
+    m_infectionRng = streamGenerator(m_seed, INFECTION_STREAM);
+    m_selectionRng = streamGenerator(m_seed, SELECTION_STREAM);
+    m_sizeRng = streamGenerator(m_seed, SIZE_STREAM);
+    m_signatureRng = streamGenerator(m_seed, SIGNATURE_STREAM);
+    m_contentSeed = PayloadGenerator::deriveSeed(m_seed, CONTENT_STREAM);
+}
+
+// submitted files are appended to the trace while the generator runs, empty disables recording
+void TrafficGenerator::setTraceRecordFile(const QString& traceRecordFile) {
+    m_traceRecordFile = traceRecordFile;
+}
+
+QString TrafficGenerator::getTraceRecordFile() const {
+    return m_traceRecordFile;
+}
+
+// a trace to replay replaces the rate and the random picks, empty disables replay
+void TrafficGenerator::setTraceReplay(const QString& traceReplayFile, double speedup) {
+    m_traceReplayFile = traceReplayFile;
+    m_traceSpeedup = speedup > 0. ? speedup : 1.;
+}
+
+QString TrafficGenerator::getTraceReplayFile() const {
+    return m_traceReplayFile;
+}
+
+double TrafficGenerator::getTraceSpeedup() const {
+    return m_traceSpeedup;
+}
+
+// an empty profile runs the constant rate set by hand
+void TrafficGenerator::setWorkloadProfile(const WorkloadProfile& workloadProfile) {
+    m_workloadProfile = workloadProfile;
+}
+
+const WorkloadProfile& TrafficGenerator::getWorkloadProfile() const {
+    return m_workloadProfile;
+}
+
+// -1 when no profile is running
+int TrafficGenerator::getWorkloadPhaseIdx() const {
+    return m_workloadPhaseIdx;
+}
+
+// the current phase is applied again with the new scale on the next file
+void TrafficGenerator::setWorkloadRateScale(double workloadRateScale) {
+    m_workloadRateScale = qMax(0., workloadRateScale);
+}
+
+double TrafficGenerator::getWorkloadRateScale() const {
+    return m_workloadRateScale;
+}
+
+void TrafficGenerator::addCleanFiles(QStringList fileNames) {
+    m_cleanFiles.addFiles(fileNames);
+    if(m_cleanFiles.size()) {
+        m_cleanFilesDir = QFileInfo(m_cleanFiles.at(m_cleanFiles.size() - 1).path).path();
+    }
+}
+
+void TrafficGenerator::addInfectedFiles(QStringList fileNames) {
+    m_infectedFiles.addFiles(fileNames);
+    if(m_infectedFiles.size()) {
+        m_infectedFilesDir = QFileInfo(m_infectedFiles.at(m_infectedFiles.size() - 1).path).path();
+    }
+}
+
+void TrafficGenerator::setTemplateFilter(const TemplateFilter& templateFilter) {
+    m_templateIndexer.setFilter(templateFilter);
+}
+
+const TemplateFilter& TrafficGenerator::getTemplateFilter() const {
+    return m_templateIndexer.getFilter();
+}
+
+TemplatePool& TrafficGenerator::getTemplates(FILE_TYPE type) {
+    return type == CLEAN ? m_cleanFiles : m_infectedFiles;
+}
+
+// walks the directory trees recursively, returns the number of added templates
+int TrafficGenerator::addTemplateDirs(FILE_TYPE type, const QStringList& dirs) {
+    QVector<TemplateEntry> entries = m_templateIndexer.scanDirs(dirs);
+    getTemplates(type).addEntries(entries);
+    if(!dirs.isEmpty()) {
+        (type == CLEAN ? m_cleanFilesDir : m_infectedFilesDir) = QDir(dirs.last()).absolutePath();
+    }
+    return entries.size();
+}
+
+// returns -1 if the manifest can't be read
+int TrafficGenerator::addTemplateManifest(FILE_TYPE type, const QString& manifestFile) {
+    bool ok;
+    QVector<TemplateEntry> entries = m_templateIndexer.readManifest(manifestFile, &ok);
+    if(!ok)
+        return -1;
+    getTemplates(type).addEntries(entries);
+    return entries.size();
+}
+
+static QString templateIndexFile(const QString& indexDir, FILE_TYPE type) {
+    return QDir(indexDir).filePath(type == CLEAN ? "clean.idx" : "infected.idx");
+}
+
+bool TrafficGenerator::saveTemplateIndex(const QString& indexDir) {
+    if(!QDir().mkpath(indexDir))
+        return false;
+    return TemplateIndexer::saveIndex(templateIndexFile(indexDir, CLEAN), m_cleanFiles)
+        && TemplateIndexer::saveIndex(templateIndexFile(indexDir, INFECTED), m_infectedFiles);
+}
+
+// both pools are replaced only if both index files are valid
+bool TrafficGenerator::loadTemplateIndex(const QString& indexDir) {
+    TemplatePool cleanFiles(CLEAN), infectedFiles(INFECTED);
+    if(!TemplateIndexer::loadIndex(templateIndexFile(indexDir, CLEAN), cleanFiles)
+       || !TemplateIndexer::loadIndex(templateIndexFile(indexDir, INFECTED), infectedFiles))
+        return false;
+
+    m_cleanFiles.clear();
+    m_cleanFiles.addEntries(cleanFiles.getEntries());
+    m_infectedFiles.clear();
+    m_infectedFiles.addEntries(infectedFiles.getEntries());
+    return true;
+}
+
+double TrafficGenerator::getInfectedFileGenerateProbability() const {
+    return m_infectedFileGenerateProbability;
+}
+
+void TrafficGenerator::setThreadsNb(int threadsNb) {
+    m_copyEngine.setThreadsNb(threadsNb);
+}
+
+int TrafficGenerator::getThreadsNb() const {
+    return m_copyEngine.getThreadsNb();
+}
+
+void TrafficGenerator::setIoBackend(IO_BACKEND ioBackend) {
+    m_copyEngine.setIoBackend(ioBackend);
+}
+
+IO_BACKEND TrafficGenerator::getIoBackend() const {
+    return m_copyEngine.getIoBackend();
+}
+
+void TrafficGenerator::setPublishMode(PUBLISH_MODE publishMode) {
+    m_copyEngine.setPublishMode(publishMode);
+}
+
+PUBLISH_MODE TrafficGenerator::getPublishMode() const {
+    return m_copyEngine.getPublishMode();
+}
+
+void TrafficGenerator::setFsyncPolicy(FSYNC_POLICY fsyncPolicy, int intervalInMsecs) {
+    m_copyEngine.setFsyncPolicy(fsyncPolicy, intervalInMsecs);
+}
+
+FSYNC_POLICY TrafficGenerator::getFsyncPolicy() const {
+    return m_copyEngine.getFsyncPolicy();
+}
+
+int TrafficGenerator::getFsyncIntervalInMsecs() const {
+    return m_copyEngine.getFsyncIntervalInMsecs();
+}
+
+void TrafficGenerator::setWritePolicy(const WritePolicy& writePolicy) {
+    m_copyEngine.setWritePolicy(writePolicy);
+}
+
+const WritePolicy& TrafficGenerator::getWritePolicy() const {
+    return m_copyEngine.getWritePolicy();
+}
+
+void TrafficGenerator::setMutator(const Mutator& mutator) {
+    m_copyEngine.setMutator(mutator);
+}
+
+const Mutator& TrafficGenerator::getMutator() const {
+    return m_copyEngine.getMutator();
+}
+
+void TrafficGenerator::setContainerBuilder(const ContainerBuilder& containerBuilder) {
+    m_copyEngine.setContainerBuilder(containerBuilder);
+}
+
+const ContainerBuilder& TrafficGenerator::getContainerBuilder() const {
+    return m_copyEngine.getContainerBuilder();
+}
+
+void TrafficGenerator::setScanTarget(const ScanTarget& scanTarget) {
+    m_copyEngine.setScanTarget(scanTarget);
+}
+
+const ScanTarget& TrafficGenerator::getScanTarget() const {
+    return m_copyEngine.getScanTarget();
+}
+
+void TrafficGenerator::setTemplateCacheBudgetInMb(int budgetInMb) {
+    m_copyEngine.setTemplateCacheBudgetInBytes(qint64(budgetInMb) * 1024 * 1024);
+}
+
+int TrafficGenerator::getTemplateCacheBudgetInMb() const {
+    return int(m_copyEngine.getTemplateCacheBudgetInBytes() / (1024 * 1024));
+}
+
+// 0 disables backpressure
+void TrafficGenerator::setMaxBacklog(qint64 maxBacklog) {
+    m_destinationMonitor.setHighWaterMark(maxBacklog);
+}
+
+qint64 TrafficGenerator::getMaxBacklog() const {
+    return m_destinationMonitor.getHighWaterMark();
+}
+
+void TrafficGenerator::setScanLatencyTracking(bool scanLatencyTracking) {
+    m_destinationMonitor.setScanLatencyTracking(scanLatencyTracking);
+}
+
+bool TrafficGenerator::isScanLatencyTracking() const {
+    return m_destinationMonitor.isScanLatencyTracking();
+}
+
+double TrafficGenerator::getCurrentSpeedInBytes() const {
+    return getBytesRate(1);
+}
+
+double TrafficGenerator::getAverageSpeedInBytes() const {
+    double workTimeInSecs = getWorkTimeInSecs();
+    return workTimeInSecs > 0. ? getTotalVolInBytes() / workTimeInSecs : 0.;
+}
+
+qint64 TrafficGenerator::getBacklog() const {
+    return m_destinationMonitor.getBacklog();
+}
+
+double TrafficGenerator::getThrottledTimeInSecs() const {
+    return m_destinationMonitor.getThrottledTimeInNsecs() / 1e9;
+}
+
+qint64 TrafficGenerator::getScannedFilesNb(FILE_TYPE type) const {
+    return m_destinationMonitor.getScannedFilesNb(type);
+}
+
+qint64 TrafficGenerator::getScanLatencyInNsecs(FILE_TYPE type, double percentile) const {
+    return m_destinationMonitor.getScanLatencyInNsecs(type, percentile);
+}
+
+double TrafficGenerator::getScanLatencySumInSecs(FILE_TYPE type) const {
+    return m_destinationMonitor.getScanLatencySumInNsecs(type) / 1e9;
+}
+
+qint64 TrafficGenerator::getPendingScanFilesNb() const {
+    return m_destinationMonitor.getPendingScanFilesNb();
+}
+
+MetricsTotals TrafficGenerator::getDestinationTotals(int rootIdx) const {
+    return m_copyEngine.getRootTotals(rootIdx);
+}
+
+qint64 TrafficGenerator::getDestinationLatencyInNsecs(int rootIdx, double percentile) const {
+    return m_copyEngine.getRootLatencyInNsecs(rootIdx, percentile);
+}
+
+int TrafficGenerator::getDestinationPendingJobsNb(int rootIdx) const {
+    return m_copyEngine.getPendingJobsNb(rootIdx);
+}
+
+qint64 TrafficGenerator::getReplayedEventsNb() const {
+    return m_replayedEventsNb;
+}
+
+// average delay of replayed files behind their scaled trace time
+qint64 TrafficGenerator::getReplayLateInNsecs() const {
+    qint64 replayedEventsNb = m_replayedEventsNb;
+    return replayedEventsNb ? m_replayLateInNsecs / replayedEventsNb : 0;
+}
+
+qint64 TrafficGenerator::getReplayMaxLateInNsecs() const {
+    return m_replayMaxLateInNsecs;
+}
+
+double TrafficGenerator::getFilesRate(int windowInSecs) const {
+    return m_copyEngine.getMetrics().getFilesRate(windowInSecs);
+}
+
+double TrafficGenerator::getBytesRate(int windowInSecs) const {
+    return m_copyEngine.getMetrics().getBytesRate(windowInSecs);
+}
+
+qint64 TrafficGenerator::getCopyLatencyInNsecs(double percentile) const {
+    return m_copyEngine.getMetrics().getLatencyPercentileInNsecs(percentile);
+}
+
+// the histogram behind the percentiles, so other processes' latencies can be merged in
+QVector<qint64> TrafficGenerator::getCopyLatencyBuckets() const {
+    return m_copyEngine.getMetrics().getLatencyBuckets();
+}
+
+// with the file count it gives the mean, the exporter's summaries need both
+double TrafficGenerator::getCopyLatencySumInSecs() const {
+    return m_copyEngine.getMetrics().getTotals().latencySumInNsecs / 1e9;
+}
+
+double TrafficGenerator::getTotalVolInBytes() const {
+    return m_copyEngine.getCopiedBytes();
+}
+
+qint64 TrafficGenerator::getGlobalCnt() const {
+    return m_copyEngine.getCopiedFilesCnt();
+}
+
+qint64 TrafficGenerator::getInfectedFilesNb() const {
+    return m_copyEngine.getInfectedFilesCnt();
+}
+
+qint64 TrafficGenerator::getFailedFilesNb() const {
+    return m_copyEngine.getFailedFilesCnt();
+}
+
+qint64 TrafficGenerator::getSyncsNb() const {
+    return m_copyEngine.getMetrics().getTotals().syncsNb;
+}
+
+// time the copy workers spent in fsync/syncfs, summed over the workers
+double TrafficGenerator::getSyncTimeInSecs() const {
+    return m_copyEngine.getMetrics().getTotals().syncTimeInNsecs / 1e9;
+}
+
+qint64 TrafficGenerator::getPublishesNb() const {
+    return m_copyEngine.getMetrics().getTotals().publishesNb;
+}
+
+// time spent renaming or linking files into place
+double TrafficGenerator::getPublishTimeInSecs() const {
+    return m_copyEngine.getMetrics().getTotals().publishTimeInNsecs / 1e9;
+}
+
+// verdicts are only known when files are sent to a scan target
+qint64 TrafficGenerator::getDetectionsNb() const {
+    return m_copyEngine.getMetrics().getTotals().detectionsNb;
+}
+
+qint64 TrafficGenerator::getMissedDetectionsNb() const {
+    return m_copyEngine.getMetrics().getTotals().missedDetectionsNb;
+}
+
+qint64 TrafficGenerator::getFalseDetectionsNb() const {
+    return m_copyEngine.getMetrics().getTotals().falseDetectionsNb;
+}
+
+void TrafficGenerator::flushStatistic() {
+    m_copyEngine.flushStatistic();
+    m_sequenceNb = 0;
+    m_startTime = QDateTime::currentDateTime();
+    m_endTime = QDateTime::currentDateTime();
+    m_startTimeInNsecs = Metrics::nowInNsecs();
+    m_endTimeInNsecs = m_startTimeInNsecs.load();
+}
+
+// lock-free for readers, retried while the generator thread is publishing
+StatsSnapshot TrafficGenerator::getStatsSnapshot() const {
+    for(;;) {
+        quint64 version = m_statsSnapshotVersion.load(std::memory_order_acquire);
+        if(version & 1)
+            continue;
+        StatsSnapshot snapshot = m_statsSnapshot.load();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(m_statsSnapshotVersion.load(std::memory_order_relaxed) == version)
+            return snapshot;
+    }
+}
+
+qint64 TrafficGenerator::getWorkTimeInNsecs() const {
+    return (m_workStatus ? Metrics::nowInNsecs() : m_endTimeInNsecs.load()) - m_startTimeInNsecs;
+}
+
+double TrafficGenerator::getWorkTimeInSecs() const {
+    return getWorkTimeInNsecs() / 1e9;
+}
+
+QDateTime TrafficGenerator::getStartTime() const {
+    return m_startTime;
+}
+
+QDateTime TrafficGenerator::getEndTime() const {
+    return m_endTime;
+}
+
+void TrafficGenerator::start() {
+    flushStatistic();
+
+    // infected synthetic files carry the infected templates as signatures
+    if(m_payloadSource == SYNTHETIC_PAYLOAD) {
+        QStringList signatureFiles;
+        foreach(const TemplateEntry& entry, m_infectedFiles.getEntries()) {
+            signatureFiles << entry.path;
+        }
+        m_payloadGenerator.loadSignatures(signatureFiles);
+    }
+
+    m_cleanFiles.buildAliasTable();
+    m_infectedFiles.buildAliasTable();
+    seedStreams();
+
+    // over the network nothing is written, so there is nothing to prepare or watch
+    bool networkDelivery = getScanTarget().isEnabled();
+    if(!networkDelivery && !prepareOutputDirs()) {
+        emit executeError(-5);
+        return;
+    }
+
+    m_replayedEventsNb = 0;
+    m_replayLateInNsecs = 0;
+    m_replayMaxLateInNsecs = 0;
+    if(!m_traceReplayFile.isEmpty()) {
+        if(!m_traceReader.open(m_traceReplayFile)) {
+            emit executeError(-4);
+            return;
+        }
+
+        // trace events name templates by path or fall back to the closest size
+        foreach(FILE_TYPE type, QList<FILE_TYPE>() << CLEAN << INFECTED) {
+            const QVector<TemplateEntry>& entries = getTemplates(type).getEntries();
+            m_templateIndices[type].clear();
+            m_templatesBySize[type].clear();
+            for(int i = 0; i < entries.size(); i++) {
+                m_templateIndices[type].insert(entries.at(i).path, i);
+                m_templatesBySize[type] << qMakePair(entries.at(i).size, i);
+            }
+            std::sort(m_templatesBySize[type].begin(), m_templatesBySize[type].end());
+        }
+    }
+
+    if(!m_traceRecordFile.isEmpty() && !m_traceWriter.open(m_traceRecordFile)) {
+        m_traceReader.close();
+        emit executeError(-3);
+        return;
+    }
+
+    // the destination is watched only for backpressure or scan latency
+    m_destinationMonitor.setAtomicPublish(getPublishMode() != DIRECT_PUBLISH);
+    if(!networkDelivery && (m_destinationMonitor.isEnabled() || m_destinationMonitor.isScanLatencyTracking()) &&
+       !m_destinationMonitor.startWatching(m_outputDirs)) {
+        m_traceReader.close();
+        m_traceWriter.close();
+        emit executeError(-2);
+        return;
+    }
+
+    m_copyEngine.setRootsNb(networkDelivery ? 1 : m_rootsNb);
+    m_copyEngine.start();
+    m_scheduler.reset();
+    m_workStatus = true;
+    QMetaObject::invokeMethod(this, [this]() { generate(); }, Qt::QueuedConnection);
+}
+
+// runs on the generator thread until stop(), the scheduler paces every file
+void TrafficGenerator::generate() {
+
+    QMutexLocker locker(&m_generateMutex);
+
+    if(!m_workStatus)
+        return;
+
+    if(m_payloadSource == TEMPLATE_PAYLOAD && !m_cleanFiles.size() && !m_infectedFiles.size()) {
+        locker.unlock();
+        emit executeError(-1);
+        stop();
+        return;
+    }
+
+    m_scheduler.reset();
+
+    // phases override the load set by hand only while the profile runs
+    double targetRate = m_targetRate;
+    RATE_UNIT rateUnit = m_rateUnit;
+    double infectedProbability = m_infectedFileGenerateProbability;
+    SizeDistribution sizeDistribution = m_payloadGenerator.getSizeDistribution();
+    bool workloadOver = false;
+    m_workloadStep = -1;
+    m_workloadTimer.start();
+
+    QElapsedTimer periodTimer;
+    periodTimer.start();
+    double periodStartVolume = getTotalVolInBytes();
+    qint64 periodStartCnt = getGlobalCnt();
+    int progress = 0;
+
+    // at low rates the loop sleeps between files, so snapshots come at most one file late
+    QElapsedTimer snapshotTimer;
+    snapshotTimer.start();
+    publishStatsSnapshot(progress);
+
+    while(m_workStatus) {
+        bool generated;
+        if(m_traceReader.isOpen()) {
+            TraceEvent event;
+            if(!m_traceReader.next(event)) {
+                workloadOver = true;
+                break;
+            }
+            generated = replayTraceEvent(event);
+        } else {
+            if(!m_workloadProfile.isEmpty() && !applyWorkloadProfile()) {
+                workloadOver = true;
+                break;
+            }
+
+            if(m_payloadSource == TEMPLATE_PAYLOAD && m_copyEngine.getContainerBuilder().isEnabled()) {
+                generated = generateContainer();
+            } else {
+                bool infected = m_infectionRng.generateDouble() < m_infectedFileGenerateProbability;
+                generated = m_payloadSource == SYNTHETIC_PAYLOAD ?
+                            generateSyntheticFile(infected) :
+                            generateFile((infected && m_infectedFiles.size()) || !m_cleanFiles.size() ? m_infectedFiles : m_cleanFiles);
+            }
+        }
+        // the phase ended while the file waited for its slot, the next phase picks a new one
+        if(!generated && m_workStatus && m_scheduler.isDeadlineReached())
+            continue;
+        if(!generated)
+            break;
+
+        if(periodTimer.elapsed() >= STATS_UPDATE_INTERVAL) {
+            double periodInSecs = periodTimer.nsecsElapsed() / 1e9;
+            double periodVolume = getTotalVolInBytes() - periodStartVolume;
+            double periodCnt = getGlobalCnt() - periodStartCnt;
+
+            // share of the target rate actually delivered during the period
+            double targetAmount = m_targetRate * periodInSecs;
+            double deliveredAmount = m_rateUnit == FILES_PER_SEC ? periodCnt : periodVolume;
+            progress = targetAmount > 0. ? qMin(100, int(deliveredAmount * 100 / targetAmount)) : 100;
+
+            periodTimer.restart();
+            periodStartVolume = getTotalVolInBytes();
+            periodStartCnt = getGlobalCnt();
+        }
+
+        if(snapshotTimer.elapsed() >= STATS_SNAPSHOT_INTERVAL) {
+            publishStatsSnapshot(progress);
+            snapshotTimer.restart();
+        }
+    }
+
+    if(!m_workloadProfile.isEmpty()) {
+        m_scheduler.setDeadline(-1.);
+        setTargetRate(targetRate, rateUnit);
+        m_infectedFileGenerateProbability = infectedProbability;
+        m_payloadGenerator.setSizeDistribution(sizeDistribution);
+        m_workloadPhaseIdx = -1;
+    }
+
+    if(workloadOver) {
+        locker.unlock();
+        stop();
+        emit workloadFinished();
+    }
+}
+
+bool TrafficGenerator::generateFile(const TemplatePool& sourcePool) {
+    return generateTemplateFile(sourcePool.at(sourcePool.pick(m_selectionRng)), true);
+}
+
+bool TrafficGenerator::generateTemplateFile(const TemplateEntry& entry, bool paced) {
+
+    CopyJob job;
+    job.sourcePath = entry.path;
+    placeFile(job, entry.fileName);
+    job.size = m_copyEngine.getMutator().getOutputSize(entry.size);
+    job.infected = entry.type == INFECTED;
+    // mutation bytes are per file like synthetic contents, so every copy differs
+    job.payloadSeed = PayloadGenerator::deriveSeed(m_contentSeed, quint64(m_sequenceNb));
+
+    return submitJob(job, paced);
+}
+
+// infected synthetic files need signatures, without them every file is clean.
+// A negative size is drawn from the size distribution.
+bool TrafficGenerator::generateSyntheticFile(bool infected, qint64 size, bool paced) {
+
+    CopyJob job;
+    job.synthetic = true;
+    job.size = size >= 0 ? size : m_payloadGenerator.getSizeDistribution().nextSize(m_sizeRng);
+    // per-file content seed: the same file gets the same bytes whichever worker writes it
+    job.payloadSeed = PayloadGenerator::deriveSeed(m_contentSeed, quint64(m_sequenceNb));
+
+    if(infected && m_payloadGenerator.getSignaturesNb()) {
+        job.signature = &m_payloadGenerator.getSignature(int(m_signatureRng.bounded(m_payloadGenerator.getSignaturesNb())));
+        job.size = qMax(job.size, qint64(job.signature->size()));
+        job.signatureOffset = qint64(m_signatureRng.bounded(double(job.size - job.signature->size() + 1)));
+        job.infected = true;
+    }
+
+    placeFile(job, QString::number(job.payloadSeed, 16));
+    return submitJob(job, paced);
+}
+
+// every member is drawn like a single file, infected ones with the container's ratio.
+// The container is built by the worker, so its size is only estimated here from the
+// members and the rate is paced on what goes in rather than on what is written.
+bool TrafficGenerator::generateContainer(bool paced) {
+
+    const ContainerBuilder& builder = m_copyEngine.getContainerBuilder();
+    double infectedRatio = builder.getInfectedRatio() >= 0. ? builder.getInfectedRatio() : m_infectedFileGenerateProbability.load();
+
+    CopyJob job;
+    job.size = 0;
+    for(int level = 0; level < builder.getDepth(); level++) {
+        for(int i = 0; i < builder.getMembersNb(); i++) {
+            bool infected = m_infectionRng.generateDouble() < infectedRatio;
+            const TemplatePool& sourcePool = (infected && m_infectedFiles.size()) || !m_cleanFiles.size() ? m_infectedFiles : m_cleanFiles;
+            const TemplateEntry& entry = sourcePool.at(sourcePool.pick(m_selectionRng));
+
+            ContainerMember member;
+            member.sourcePath = entry.path;
+            member.name = QString("%1_%2").arg(i).arg(entry.fileName);
+            job.members << member;
+            job.size += entry.size;
+            job.infected = job.infected || entry.type == INFECTED;
+        }
+
+        // the nested container closes its parent level, its own members follow it
+        if(level + 1 < builder.getDepth()) {
+            ContainerMember nested;
+            nested.name = QString("nested%1.%2").arg(level + 1).arg(builder.getExtension());
+            nested.membersNb = builder.getMembersNb() + (level + 2 < builder.getDepth() ? 1 : 0);
+            job.members << nested;
+        }
+    }
+    job.payloadSeed = PayloadGenerator::deriveSeed(m_contentSeed, quint64(m_sequenceNb));
+
+    placeFile(job, QString("%1.%2").arg(QString::number(job.payloadSeed, 16)).arg(builder.getExtension()));
+    return submitJob(job, paced);
+}
+
+// waits for the event's time scaled by the speed-up, then writes a file of its class and size
+bool TrafficGenerator::replayTraceEvent(const TraceEvent& event) {
+    qint64 lateInNsecs;
+    if(!m_scheduler.waitUntil(event.timeInUsecs / 1e6 / m_traceSpeedup, lateInNsecs))
+        return false;
+
+    m_replayedEventsNb++;
+    m_replayLateInNsecs += lateInNsecs;
+    if(lateInNsecs > m_replayMaxLateInNsecs)
+        m_replayMaxLateInNsecs = lateInNsecs;
+
+    if(m_payloadSource == SYNTHETIC_PAYLOAD)
+        return generateSyntheticFile(event.type == INFECTED, event.size, false);
+
+    FILE_TYPE type = (event.type == INFECTED && m_infectedFiles.size()) || !m_cleanFiles.size() ? INFECTED : CLEAN;
+    return generateTemplateFile(getTemplates(type).at(findTemplate(type, event)), false);
+}
+
+// the named template if the pool has it, otherwise the one closest in size
+int TrafficGenerator::findTemplate(FILE_TYPE type, const TraceEvent& event) const {
+    if(!event.templatePath.isEmpty()) {
+        QHash<QString, int>::const_iterator it = m_templateIndices[type].constFind(event.templatePath);
+        if(it != m_templateIndices[type].constEnd())
+            return it.value();
+    }
+
+    const QVector<QPair<qint64, int>>& templatesBySize = m_templatesBySize[type];
+    int upperIdx = int(std::lower_bound(templatesBySize.begin(), templatesBySize.end(), qMakePair(event.size, 0)) - templatesBySize.begin());
+    if(upperIdx == templatesBySize.size() ||
+       (upperIdx > 0 && event.size - templatesBySize.at(upperIdx - 1).first < templatesBySize.at(upperIdx).first - event.size))
+        upperIdx--;
+    return templatesBySize.at(upperIdx).second;
+}
+
+// one output directory per root and subdirectory, all created before the run
+// so the workers never have to
+bool TrafficGenerator::prepareOutputDirs() {
+    QStringList destinationDirs = getDestinationDirs();
+    m_outputDirs.clear();
+    m_rootsNb = destinationDirs.size();
+    if(destinationDirs.isEmpty())
+        return false;
+
+    int subdirNameWidth = QString::number(qMax(0, m_subdirsNb - 1), 16).size();
+    foreach(const QString& destinationDir, destinationDirs) {
+        if(!m_subdirsNb) {
+            m_outputDirs << destinationDir;
+            continue;
+        }
+        for(int i = 0; i < m_subdirsNb; i++) {
+            QString outputDir = QString("%1/%2").arg(destinationDir).arg(i, subdirNameWidth, 16, QChar('0'));
+            if(!QDir().mkpath(outputDir))
+                return false;
+            m_outputDirs << outputDir;
+        }
+    }
+    return true;
+}
+
+// roots take turns, inside a root the subdirectory is a hash of the sequence number.
+// A scan target only gets the name.
+void TrafficGenerator::placeFile(CopyJob& job, const QString& fileName) const {
+    if(getScanTarget().isEnabled()) {
+        job.rootIdx = 0;
+        job.destinationPath = QString("%1_%2").arg(QString::number(m_sequenceNb)).arg(fileName);
+        return;
+    }
+
+    int subdirsNb = qMax(1, m_subdirsNb);
+    job.rootIdx = int(m_sequenceNb % m_rootsNb);
+    int subdirIdx = int(PayloadGenerator::deriveSeed(quint64(m_sequenceNb), 0) % quint64(subdirsNb));
+    job.destinationPath = QString("%1/%2_%3").arg(m_outputDirs.at(job.rootIdx * subdirsNb + subdirIdx)).
+                                              arg(QString::number(m_sequenceNb)).
+                                              arg(fileName);
+}
+
+// paced jobs wait for the rate scheduler, replayed ones were already timed by the trace
+bool TrafficGenerator::submitJob(const CopyJob& job, bool paced) {
+    if(!m_copyEngine.waitForCapacity(job.rootIdx) ||
+       !m_destinationMonitor.waitForRoom([this]{ return qint64(m_copyEngine.getPendingJobsNb()); }) ||
+       (paced && !m_scheduler.acquire(job.size)))
+        return false;
+
+    m_destinationMonitor.track(job.destinationPath.mid(job.destinationPath.lastIndexOf('/') + 1),
+                               job.size, job.infected ? INFECTED : CLEAN);
+    m_copyEngine.enqueue(job);
+    m_sequenceNb++;
+
+    if(m_traceWriter.isOpen()) {
+        TraceEvent event;
+        event.timeInUsecs = (Metrics::nowInNsecs() - m_startTimeInNsecs) / 1000;
+        event.size = job.size;
+        event.type = job.infected ? INFECTED : CLEAN;
+        event.templatePath = job.sourcePath;
+        m_traceWriter.write(event);
+    }
+    return true;
+}
+
+// switches the offered load when the run enters the next phase, false once the profile is over
+bool TrafficGenerator::applyWorkloadProfile() {
+    int step;
+    double phaseElapsedInSecs;
+    if(!m_workloadProfile.locate(m_workloadTimer.nsecsElapsed() / 1e9, step, phaseElapsedInSecs))
+        return false;
+    double rateScale = m_workloadRateScale;
+    if(step == m_workloadStep && rateScale == m_appliedWorkloadRateScale)
+        return true;
+
+    int phaseIdx = step % m_workloadProfile.getPhasesNb();
+    const WorkloadPhase& phase = m_workloadProfile.getPhase(phaseIdx);
+
+    if(phase.isRamp()) {
+        // a phase entered late starts its ramp where it would be by now
+        double phaseLeftInSecs = phase.durationInSecs - phaseElapsedInSecs;
+        double fromRate = phase.rampFromRate + (phase.rate - phase.rampFromRate) * phaseElapsedInSecs / phase.durationInSecs;
+        m_targetRate = phase.rate * rateScale;
+        m_rateUnit = phase.rateUnit;
+        m_scheduler.setRamp(fromRate * rateScale, phase.rate * rateScale, phaseLeftInSecs, phase.rateUnit);
+    } else if(phase.isPause()) {
+        m_targetRate = 0.;
+        m_rateUnit = phase.rateUnit;
+        m_scheduler.pause();
+    } else if(phase.rate >= 0.) {
+        setTargetRate(phase.rate * rateScale, phase.rateUnit);
+    }
+    m_appliedWorkloadRateScale = rateScale;
+
+    // a slot past the end of the phase is given up instead of overrunning it
+    m_scheduler.setDeadline(phase.durationInSecs - phaseElapsedInSecs);
+
+    if(phase.infectedProbability >= 0.)
+        m_infectedFileGenerateProbability = phase.infectedProbability;
+    if(phase.hasSizeDistribution)
+        m_payloadGenerator.setSizeDistribution(phase.sizeDistribution);
+
+    bool phaseChanged = step != m_workloadStep;
+    m_workloadStep = step;
+    m_workloadPhaseIdx = phaseIdx;
+    if(phaseChanged)
+        emit workloadPhaseChanged(phaseIdx);
+    return true;
+}
+
+void TrafficGenerator::stop() {
+    m_workStatus = false;
+    m_scheduler.cancel();
+    m_destinationMonitor.cancel();
+    m_copyEngine.stop();
+    m_destinationMonitor.stopWatching();
+
+    // wait for generate() to leave its loop
+    QMutexLocker locker(&m_generateMutex);
+    m_traceReader.close();
+    m_traceWriter.close();
+    m_endTime = QDateTime::currentDateTime();
+    m_endTimeInNsecs = Metrics::nowInNsecs();
+    publishStatsSnapshot(0);
+}
+
+// single writer seqlock: the version is odd while the snapshot is rewritten. Writers
+// hold m_generateMutex, generate() for its whole loop and stop() once it's left.
+void TrafficGenerator::publishStatsSnapshot(int progress) {
+    StatsSnapshot snapshot;
+    MetricsTotals totals = m_copyEngine.getMetrics().getTotals();
+    QVector<qint64> latencyBuckets = m_copyEngine.getMetrics().getLatencyBuckets();
+
+    snapshot.workStatus = m_workStatus;
+    snapshot.startTimeInMsecs = m_startTime.isValid() ? m_startTime.toMSecsSinceEpoch() : 0;
+    snapshot.endTimeInMsecs = m_endTime.isValid() ? m_endTime.toMSecsSinceEpoch() : 0;
+    snapshot.filesCnt = totals.filesCnt;
+    snapshot.infectedFilesCnt = totals.infectedFilesCnt;
+    snapshot.failedFilesCnt = totals.failedFilesCnt;
+    snapshot.bytes = totals.bytes;
+    snapshot.currentSpeedInBytes = getCurrentSpeedInBytes();
+    double workTimeInSecs = getWorkTimeInSecs();
+    snapshot.averageSpeedInBytes = workTimeInSecs > 0. ? totals.bytes / workTimeInSecs : 0.;
+    snapshot.latencyP50InNsecs = Metrics::latencyPercentileInNsecs(latencyBuckets, 0.5);
+    snapshot.latencyP99InNsecs = Metrics::latencyPercentileInNsecs(latencyBuckets, 0.99);
+    snapshot.latencyP999InNsecs = Metrics::latencyPercentileInNsecs(latencyBuckets, 0.999);
+    snapshot.progress = progress;
+
+    quint64 version = m_statsSnapshotVersion.load(std::memory_order_relaxed);
+    m_statsSnapshotVersion.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_statsSnapshot.store(snapshot);
+    m_statsSnapshotVersion.store(version + 2, std::memory_order_release);
+}
+
+void SharedStatsSnapshot::store(const StatsSnapshot& snapshot) {
+    workStatus.store(snapshot.workStatus, std::memory_order_relaxed);
+    startTimeInMsecs.store(snapshot.startTimeInMsecs, std::memory_order_relaxed);
+    endTimeInMsecs.store(snapshot.endTimeInMsecs, std::memory_order_relaxed);
+    filesCnt.store(snapshot.filesCnt, std::memory_order_relaxed);
+    infectedFilesCnt.store(snapshot.infectedFilesCnt, std::memory_order_relaxed);
+    failedFilesCnt.store(snapshot.failedFilesCnt, std::memory_order_relaxed);
+    bytes.store(snapshot.bytes, std::memory_order_relaxed);
+    currentSpeedInBytes.store(snapshot.currentSpeedInBytes, std::memory_order_relaxed);
+    averageSpeedInBytes.store(snapshot.averageSpeedInBytes, std::memory_order_relaxed);
+    latencyP50InNsecs.store(snapshot.latencyP50InNsecs, std::memory_order_relaxed);
+    latencyP99InNsecs.store(snapshot.latencyP99InNsecs, std::memory_order_relaxed);
+    latencyP999InNsecs.store(snapshot.latencyP999InNsecs, std::memory_order_relaxed);
+    progress.store(snapshot.progress, std::memory_order_relaxed);
+}
+
+StatsSnapshot SharedStatsSnapshot::load() const {
+    StatsSnapshot snapshot;
+    snapshot.workStatus = workStatus.load(std::memory_order_relaxed);
+    snapshot.startTimeInMsecs = startTimeInMsecs.load(std::memory_order_relaxed);
+    snapshot.endTimeInMsecs = endTimeInMsecs.load(std::memory_order_relaxed);
+    snapshot.filesCnt = filesCnt.load(std::memory_order_relaxed);
+    snapshot.infectedFilesCnt = infectedFilesCnt.load(std::memory_order_relaxed);
+    snapshot.failedFilesCnt = failedFilesCnt.load(std::memory_order_relaxed);
+    snapshot.bytes = bytes.load(std::memory_order_relaxed);
+    snapshot.currentSpeedInBytes = currentSpeedInBytes.load(std::memory_order_relaxed);
+    snapshot.averageSpeedInBytes = averageSpeedInBytes.load(std::memory_order_relaxed);
+    snapshot.latencyP50InNsecs = latencyP50InNsecs.load(std::memory_order_relaxed);
+    snapshot.latencyP99InNsecs = latencyP99InNsecs.load(std::memory_order_relaxed);
+    snapshot.latencyP999InNsecs = latencyP999InNsecs.load(std::memory_order_relaxed);
+    snapshot.progress = progress.load(std::memory_order_relaxed);
+    return snapshot;
+}
@@ -0,0 +1,330 @@
+#ifndef TRAFFICGENERATOR_H
+#define TRAFFICGENERATOR_H
+
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QHash>
+
+#include <QDebug>
+
+#include <atomic>
+
+#include "copyengine.h"
+#include "ratescheduler.h"
+#include "payloadgenerator.h"
+#include "templatepool.h"
+#include "templateindexer.h"
+#include "destinationmonitor.h"
+#include "workloadprofile.h"
+#include "tracefile.h"
+
+#define     VERSION               "v1.2.21"
+
+#define     DEFAULT_GENERATE_INTERVAL           3
+#define     DEFAULT_FILES_NB_PER_INTERVAL       5
+#define     DEFAULT_INFECTED_FILE_PROBABILITY   0.2
+#define     STATS_UPDATE_INTERVAL               1000
+#define     STATS_SNAPSHOT_INTERVAL             100
+#define     MAX_SUBDIRS_NB                      65536
+
+// every random decision of a run draws from its own stream derived from the
+// run seed, so changing one knob doesn't shift the others
+enum RANDOM_STREAM {
+    INFECTION_STREAM,
+    SELECTION_STREAM,
+    SIZE_STREAM,
+    SIGNATURE_STREAM,
+    CONTENT_STREAM
+};
+
+// what the GUI shows, published by the generator thread as a whole so readers
+// never see counters from different moments. Trivially copyable for the seqlock.
+struct StatsSnapshot {
+    bool workStatus{false};
+    // since the epoch, 0 before the first run
+    qint64 startTimeInMsecs{0};
+    qint64 endTimeInMsecs{0};
+    qint64 filesCnt{0};
+    qint64 infectedFilesCnt{0};
+    qint64 failedFilesCnt{0};
+    qint64 bytes{0};
+    double currentSpeedInBytes{0.};
+    double averageSpeedInBytes{0.};
+    qint64 latencyP50InNsecs{0};
+    qint64 latencyP99InNsecs{0};
+    qint64 latencyP999InNsecs{0};
+    int progress{0};
+};
+
+// the copy a seqlock guards: every field is a relaxed atomic, so a reader racing
+// the writer gets a mix of old and new values it then throws away, never a race
+struct SharedStatsSnapshot {
+    std::atomic<bool> workStatus{false};
+    std::atomic<qint64> startTimeInMsecs{0};
+    std::atomic<qint64> endTimeInMsecs{0};
+    std::atomic<qint64> filesCnt{0};
+    std::atomic<qint64> infectedFilesCnt{0};
+    std::atomic<qint64> failedFilesCnt{0};
+    std::atomic<qint64> bytes{0};
+    std::atomic<double> currentSpeedInBytes{0.};
+    std::atomic<double> averageSpeedInBytes{0.};
+    std::atomic<qint64> latencyP50InNsecs{0};
+    std::atomic<qint64> latencyP99InNsecs{0};
+    std::atomic<qint64> latencyP999InNsecs{0};
+    std::atomic<int> progress{0};
+
+    void store(const StatsSnapshot& snapshot);
+    StatsSnapshot load() const;
+};
+
+const static QDir::Filters usingFilters = QDir::Files | QDir::NoSymLinks;
+
+class TrafficGenerator : public QObject {
+
+    Q_OBJECT
+
+    std::atomic<bool> m_workStatus{false};
+
+    TemplatePool m_cleanFiles{CLEAN};
+    QString m_cleanFilesDir;
+
+    TemplatePool m_infectedFiles{INFECTED};
+    QString m_infectedFilesDir;
+
+    TemplateIndexer m_templateIndexer;
+
+    QStringList m_destinationDirs;
+    mutable QMutex m_destinationDirsMutex;
+    int m_subdirsNb{0};
+    // taken from m_destinationDirs at start, the hot path reads only these
+    QStringList m_outputDirs;
+    int m_rootsNb{0};
+
+    int m_generateInterval{DEFAULT_GENERATE_INTERVAL};
+    int m_filesPerInterval{DEFAULT_FILES_NB_PER_INTERVAL};
+    RATE_UNIT m_intervalRateUnit{FILES_PER_SEC};
+
+    // profiles change it on the generation thread while the GUI and the exporter read it
+    std::atomic<double> m_targetRate{double(DEFAULT_FILES_NB_PER_INTERVAL) / DEFAULT_GENERATE_INTERVAL};
+    std::atomic<RATE_UNIT> m_rateUnit{FILES_PER_SEC};
+    RateScheduler m_scheduler;
+    QMutex m_generateMutex;
+
+    qint64 m_sequenceNb{NULL};
+
+    CopyEngine m_copyEngine;
+    DestinationMonitor m_destinationMonitor;
+
+    bool m_seedFixed{false};
+    quint64 m_seed{0};
+    QRandomGenerator m_infectionRng;
+    QRandomGenerator m_selectionRng;
+    QRandomGenerator m_sizeRng;
+    QRandomGenerator m_signatureRng;
+    quint64 m_contentSeed{0};
+
+    WorkloadProfile m_workloadProfile;
+    QElapsedTimer m_workloadTimer;
+    int m_workloadStep{-1};
+    std::atomic<int> m_workloadPhaseIdx{-1};
+    // a cluster agent runs its share of the profile, set from the agent's thread
+    std::atomic<double> m_workloadRateScale{1.};
+    double m_appliedWorkloadRateScale{1.};
+
+    QString m_traceRecordFile;
+    TraceWriter m_traceWriter;
+    QString m_traceReplayFile;
+    double m_traceSpeedup{1.};
+    TraceReader m_traceReader;
+    QHash<QString, int> m_templateIndices[2];
+    QVector<QPair<qint64, int>> m_templatesBySize[2];
+    std::atomic<qint64> m_replayedEventsNb{0};
+    std::atomic<qint64> m_replayLateInNsecs{0};
+    std::atomic<qint64> m_replayMaxLateInNsecs{0};
+
+    PAYLOAD_SOURCE m_payloadSource{TEMPLATE_PAYLOAD};
+    PayloadGenerator m_payloadGenerator;
+
+    // phases change it on the generation thread, the GUI sets it between runs
+    std::atomic<double> m_infectedFileGenerateProbability{DEFAULT_INFECTED_FILE_PROBABILITY};
+
+    QDateTime m_startTime;
+    QDateTime m_endTime;
+    std::atomic<qint64> m_startTimeInNsecs{0};
+    std::atomic<qint64> m_endTimeInNsecs{0};
+
+    SharedStatsSnapshot m_statsSnapshot;
+    std::atomic<quint64> m_statsSnapshotVersion{0};
+
+public:
+    TrafficGenerator();
+
+    void setWorkStatus(bool workStatus);
+    bool getWorkStatus() const;
+
+    void setCleanFilesDir(const QString& cleanFilesDir);
+    QString getCleanFilesDir() const;
+
+    TemplatePool& getCleanFiles();
+    TemplatePool& getInfectedFiles();
+
+    QString getInfectedFilesDir() const;
+    void setInfectedFilesDir(const QString& infectedFilesDir);
+
+    void setDestinationDir(const QString& destinationDir);
+    QString getDestinationDir() const;
+    void setDestinationDirs(const QStringList& destinationDirs);
+    QStringList getDestinationDirs() const;
+    void setSubdirsNb(int subdirsNb);
+    int getSubdirsNb() const;
+
+    void setGenerateInterval(int generateInterval);
+    int getGenerateInterval() const;
+
+    void setFilesPerInterval(int filesPerInterval);
+    int getFilesPerInterval() const;
+    // the amount per interval is counted in files or in MB
+    void setIntervalRateUnit(RATE_UNIT rateUnit);
+    RATE_UNIT getIntervalRateUnit() const;
+
+    void setTargetRate(double targetRate, RATE_UNIT rateUnit);
+    double getTargetRate() const;
+    RATE_UNIT getRateUnit() const;
+
+    double getInfectedFileGenerateProbability() const;
+    void setInfectedFileGenerateProbability(double infectedFileGenerateProbability);
+
+    void setThreadsNb(int threadsNb);
+    int getThreadsNb() const;
+
+    void setIoBackend(IO_BACKEND ioBackend);
+    IO_BACKEND getIoBackend() const;
+
+    void setPublishMode(PUBLISH_MODE publishMode);
+    PUBLISH_MODE getPublishMode() const;
+    void setFsyncPolicy(FSYNC_POLICY fsyncPolicy, int intervalInMsecs = DEFAULT_FSYNC_INTERVAL);
+    FSYNC_POLICY getFsyncPolicy() const;
+    int getFsyncIntervalInMsecs() const;
+    void setWritePolicy(const WritePolicy& writePolicy);
+    const WritePolicy& getWritePolicy() const;
+
+    void setMutator(const Mutator& mutator);
+    const Mutator& getMutator() const;
+
+    void setContainerBuilder(const ContainerBuilder& containerBuilder);
+    const ContainerBuilder& getContainerBuilder() const;
+
+    void setScanTarget(const ScanTarget& scanTarget);
+    const ScanTarget& getScanTarget() const;
+
+    void setTemplateCacheBudgetInMb(int budgetInMb);
+    int getTemplateCacheBudgetInMb() const;
+
+    void setMaxBacklog(qint64 maxBacklog);
+    qint64 getMaxBacklog() const;
+
+    void setScanLatencyTracking(bool scanLatencyTracking);
+    bool isScanLatencyTracking() const;
+
+    void setPayloadSource(PAYLOAD_SOURCE payloadSource);
+    PAYLOAD_SOURCE getPayloadSource() const;
+    void setSizeDistribution(const SizeDistribution& sizeDistribution);
+    const SizeDistribution& getSizeDistribution() const;
+
+    void setSeed(quint64 seed);
+    void resetSeed();
+    bool isSeedFixed() const;
+    quint64 getSeed() const;
+
+    void setWorkloadProfile(const WorkloadProfile& workloadProfile);
+    const WorkloadProfile& getWorkloadProfile() const;
+    int getWorkloadPhaseIdx() const;
+    void setWorkloadRateScale(double workloadRateScale);
+    double getWorkloadRateScale() const;
+
+    void setTraceRecordFile(const QString& traceRecordFile);
+    QString getTraceRecordFile() const;
+    void setTraceReplay(const QString& traceReplayFile, double speedup);
+    QString getTraceReplayFile() const;
+    double getTraceSpeedup() const;
+
+    void addCleanFiles(QStringList fileNames);
+    void addInfectedFiles(QStringList fileNames);
+
+    void setTemplateFilter(const TemplateFilter& templateFilter);
+    const TemplateFilter& getTemplateFilter() const;
+    TemplatePool& getTemplates(FILE_TYPE type);
+    int addTemplateDirs(FILE_TYPE type, const QStringList& dirs);
+    int addTemplateManifest(FILE_TYPE type, const QString& manifestFile);
+    bool saveTemplateIndex(const QString& indexDir);
+    bool loadTemplateIndex(const QString& indexDir);
+
+// statistics
+    double getCurrentSpeedInBytes() const;
+    double getAverageSpeedInBytes() const;
+    double getFilesRate(int windowInSecs) const;
+    double getBytesRate(int windowInSecs) const;
+    qint64 getCopyLatencyInNsecs(double percentile) const;
+    QVector<qint64> getCopyLatencyBuckets() const;
+    double getCopyLatencySumInSecs() const;
+    double getTotalVolInBytes() const;
+    qint64 getGlobalCnt() const;
+    qint64 getInfectedFilesNb() const;
+    qint64 getFailedFilesNb() const;
+    qint64 getSyncsNb() const;
+    double getSyncTimeInSecs() const;
+    qint64 getPublishesNb() const;
+    double getPublishTimeInSecs() const;
+    qint64 getDetectionsNb() const;
+    qint64 getMissedDetectionsNb() const;
+    qint64 getFalseDetectionsNb() const;
+    qint64 getBacklog() const;
+    double getThrottledTimeInSecs() const;
+    qint64 getScannedFilesNb(FILE_TYPE type) const;
+    qint64 getScanLatencyInNsecs(FILE_TYPE type, double percentile) const;
+    double getScanLatencySumInSecs(FILE_TYPE type) const;
+    qint64 getPendingScanFilesNb() const;
+    MetricsTotals getDestinationTotals(int rootIdx) const;
+    qint64 getDestinationLatencyInNsecs(int rootIdx, double percentile) const;
+    int getDestinationPendingJobsNb(int rootIdx) const;
+    qint64 getReplayedEventsNb() const;
+    qint64 getReplayLateInNsecs() const;
+    qint64 getReplayMaxLateInNsecs() const;
+    void flushStatistic();
+    StatsSnapshot getStatsSnapshot() const;
+
+    qint64 getWorkTimeInNsecs() const;
+    double getWorkTimeInSecs() const;
+    QDateTime getStartTime() const;
+    QDateTime getEndTime() const;
+
+// core
+    void start();
+    void generate();
+    bool generateFile(const TemplatePool& sourcePool);
+    bool generateTemplateFile(const TemplateEntry& entry, bool paced);
+    bool generateSyntheticFile(bool infected, qint64 size = -1, bool paced = true);
+    bool generateContainer(bool paced = true);
+    bool replayTraceEvent(const TraceEvent& event);
+    int findTemplate(FILE_TYPE type, const TraceEvent& event) const;
+    void placeFile(CopyJob& job, const QString& fileName) const;
+    bool prepareOutputDirs();
+    bool submitJob(const CopyJob& job, bool paced = true);
+    void seedStreams();
+    void applyIntervalRate();
+    bool applyWorkloadProfile();
+    void publishStatsSnapshot(int progress);
+    void stop();
+
+signals:
+    void executeError(int code);
+    void workloadPhaseChanged(int phaseIdx);
+    void workloadFinished();
+};
+
+#endif // TRAFFICGENERATOR_H
@@ -1,229 +1,28 @@
 #include "widget.h"
 #include "ui_widget.h"
 
-TrafficGenerator::TrafficGenerator() {
-}
-
-void TrafficGenerator::setWorkStatus(bool workStatus) {
-
-    if(!m_workStatus && workStatus) {
-        flushStatistic();
-        m_workStatus = true;
-    }
-
-    if(m_workStatus && !workStatus) {
-        m_endTime = QDateTime::currentDateTime();
-        m_workStatus = false;
-    }
-}
-
-bool TrafficGenerator::getWorkStatus() const {
-    return m_workStatus;
-}
-
-void TrafficGenerator::setCleanFilesDir(const QString& cleanFilesDir) {
-    m_cleanFilesDir = cleanFilesDir;
-}
-
-QString TrafficGenerator::getCleanFilesDir() const {
-    return m_cleanFilesDir;
-}
-
-void TrafficGenerator::setCleanFiles(const QFileInfoList& cleanFiles) {
-    m_cleanFiles = cleanFiles;
-}
-
-QFileInfoList& TrafficGenerator::getCleanFiles() {
-    return m_cleanFiles;
-}
-
-void TrafficGenerator::setInfectedFiles(const QFileInfoList& infectedFiles) {
-    m_infectedFiles = infectedFiles;
-}
-
-QFileInfoList& TrafficGenerator::getInfectedFiles() {
-    return m_infectedFiles;
-}
-
-void TrafficGenerator::setInfectedFilesDir(const QString& infectedFilesDir) {
-    m_infectedFilesDir = infectedFilesDir;
-}
-
-QString TrafficGenerator::getInfectedFilesDir() const {
-    return m_infectedFilesDir;
-}
-
-void TrafficGenerator::setDestinationDir(const QString& destinationDir) {
-    m_destinationDir = destinationDir;
-}
-
-QString TrafficGenerator::getDestinationDir() const {
-    return m_destinationDir;
-}
-
-void TrafficGenerator::setGenerateInterval(int generateInterval) {
-    m_generateInterval = generateInterval;
-}
-
-int TrafficGenerator::getGenerateInterval() const {
-    return m_generateInterval;
-}
-
-void TrafficGenerator::setFilesPerInterval(int filesPerInterval) {
-    m_filesPerInterval = filesPerInterval;
-}
-
-int TrafficGenerator::getFilesPerInterval() const {
-    return m_filesPerInterval;
-}
-
-void TrafficGenerator::setInfectedFileGenerateProbability(double infectedFileGenerateProbability) {
-    m_infectedFileGenerateProbability = infectedFileGenerateProbability;
-}
-
-void TrafficGenerator::addCleanFiles(QStringList fileNames) {
-    foreach(QString fileName, fileNames) {
-        if(QFile(fileName).exists()) {
-            m_cleanFiles << QFileInfo(fileName);
-        }
-    }
-    if(m_cleanFiles.size()) {
-        m_cleanFilesDir = m_cleanFiles.last().dir().path();
-    }
-}
-
-void TrafficGenerator::addInfectedFiles(QStringList fileNames) {
-    foreach(QString fileName, fileNames) {
-        if(QFile(fileName).exists()) {
-            m_infectedFiles << QFileInfo(fileName);
-        }
-    }
-    if(m_infectedFiles.size()) {
-        m_infectedFilesDir = m_infectedFiles.last().dir().path();
-    }
-}
-
-double TrafficGenerator::getInfectedFileGenerateProbability() const {
-    return m_infectedFileGenerateProbability;
-}
-
-double TrafficGenerator::getCurrentSpeedInBytes() const {
-    return m_currentSpeedInBytes;
-}
-
-double TrafficGenerator::getAverageSpeedInBytes() const {
-    return m_averageSpeedInBytes;
-}
-
-double TrafficGenerator::getTotalVolInBytes() const {
-    return m_totalVolInBytes;
-}
-
-int TrafficGenerator::getGlobalCnt() const {
-    return m_globalCnt;
-}
-
-int TrafficGenerator::getInfectedFilesNb() const {
-    return m_infectedFilesCnt;
-}
-
-void TrafficGenerator::flushStatistic() {
-    m_totalVolInBytes = 0.;
-    m_averageSpeedInBytes = 0;
-    m_globalCnt = 0;
-    m_infectedFilesCnt = 0;
-    m_startTime = QDateTime::currentDateTime();
-    m_endTime = QDateTime::currentDateTime();
-}
-
-qint64 TrafficGenerator::getWorkTimeInSecs() {
-    if(m_workStatus)
-        m_endTime = QDateTime::currentDateTime();
-    return m_startTime.secsTo(m_endTime) + 1;
-}
-
-QDateTime TrafficGenerator::getStartTime() const {
-    return m_startTime;
-}
-
-QDateTime TrafficGenerator::getEndTime() const {
-    return m_endTime;
-}
-
-void TrafficGenerator::start() {
-    flushStatistic();
-    m_workStatus = true;
-    generate();
-}
-
-void TrafficGenerator::generate() {
-
-    if(m_workStatus) {
-
-        if(!m_cleanFiles.size() && !m_infectedFiles.size()) {
-            emit executeError(-1);
-            stop();
-        } else {
-            m_volumePerPeriodInBytes = 0;
-
-            for(int i = 0; i < m_filesPerInterval; i++) {
-                generateFile(QRandomGenerator::global()->generateDouble() < m_infectedFileGenerateProbability ?
-                                 m_infectedFiles : m_cleanFiles);
-                emit updateProgressBar((i + 1) * 100 / m_filesPerInterval);
-            }
-            m_currentSpeedInBytes = m_volumePerPeriodInBytes / m_generateInterval;
-            m_totalVolInBytes += m_volumePerPeriodInBytes;
-            m_averageSpeedInBytes = m_totalVolInBytes / getWorkTimeInSecs();
-            emit updateUi();
-        }
-    }
-}
-
-void TrafficGenerator::generateFile(QFileInfoList& sourceList) {
-    if(sourceList.size()) {
-
-        int randIdx = int(QRandomGenerator::global()->bounded(sourceList.size()));
-        QFile::copy(sourceList.at(randIdx).absoluteFilePath(),
-                       QString("%1/%2_%3").arg(m_destinationDir).
-                                           arg(QString::number(m_globalCnt)).
-                                           arg(sourceList.at(randIdx).fileName()));
-        m_volumePerPeriodInBytes += sourceList.at(randIdx).size();
-        m_globalCnt++;
-
-        if(m_infectedFiles.contains(sourceList.at(randIdx))) {
-            m_infectedFilesCnt++;
-        }
-    }
-}
-
-void TrafficGenerator::stop() {
-    m_endTime = QDateTime::currentDateTime();
-    m_workStatus = false;
-    emit updateUi();
-}
-
-// -----------------------------------------------------------------------------------------
-
 Widget::Widget(QWidget *parent): QWidget(parent), ui(new Ui::Widget), settings("FeZar97", "TrafficGenerator"){
     ui->setupUi(this);
     setLayout(ui->mainLayout);
     setWindowTitle(QString("Traffic Generator ") + VERSION);
 
-    m_updateTimer.setInterval(1000);
-    connect(&m_updateTimer, &QTimer::timeout, this, &Widget::updateUi);
+    // statistics are redrawn at a fixed frame rate from the published snapshot,
+    // whatever the generation rate
+    m_updateTimer.setInterval(UI_FRAME_INTERVAL);
+    connect(&m_updateTimer, &QTimer::timeout, this, &Widget::updateStats);
     m_updateTimer.start();
 
-    connect(&m_generateTimer, &QTimer::timeout, &trfGen, &TrafficGenerator::generate);
-
     prepareTables();
 
-    connect(&trfGen, &TrafficGenerator::updateProgressBar,  this->ui->generationProgressBar, &QProgressBar::setValue);
-    connect(&trfGen, &TrafficGenerator::updateUi,           this,                            &Widget::updateUi);
     connect(&trfGen, &TrafficGenerator::executeError,       this,                            &Widget::executeError);
+    connect(&trfGen, &TrafficGenerator::workloadPhaseChanged, this,                          &Widget::showWorkloadPhase);
+    connect(&trfGen, &TrafficGenerator::workloadFinished,   this,                            [this]() { showWorkloadPhase(-1); });
 
     restoreGeometry(settings.value("geometry").toByteArray());
     setGenerationInterval(settings.value("generateInterval",      DEFAULT_GENERATE_INTERVAL).toInt());
-    trfGen.setDestinationDir(settings.value("destinationDir",     QDir::tempPath()).toString());
+    trfGen.setDestinationDirs(QStringList() << settings.value("destinationDir", QDir::tempPath()).toString()
+                                            << settings.value("extraDestinationDirs").toStringList());
+    trfGen.setSubdirsNb(settings.value("subdirsNb",               0).toInt());
 
     trfGen.setCleanFilesDir(settings.value("cleanFilesDir",       QDir::tempPath()).toString());
     trfGen.setInfectedFilesDir(settings.value("infectedFilesDir", QDir::tempPath()).toString());
@@ -231,12 +30,135 @@ Widget::Widget(QWidget *parent): QWidget(parent), ui(new Ui::Widget), settings("
     trfGen.setInfectedFileGenerateProbability(settings.value("infectedFileProbability", DEFAULT_INFECTED_FILE_PROBABILITY).toDouble());
 
     trfGen.setFilesPerInterval(settings.value("filesPerInterval", DEFAULT_FILES_NB_PER_INTERVAL).toInt());
+    trfGen.setIntervalRateUnit(settings.value("rateUnit").toString() == "bytes" ? BYTES_PER_SEC : FILES_PER_SEC);
+    trfGen.setThreadsNb(settings.value("threadsNb",               DEFAULT_THREADS_NB).toInt());
+
+    // the options below are set only through the settings file, values that don't parse
+    // keep their defaults and are listed in one warning instead of being dropped silently
+    QStringList invalidSettings;
+    IO_BACKEND ioBackend = SYNC_IO_BACKEND;
+    if(!IoBackend::parse(settings.value("ioBackend", IoBackend::toString(SYNC_IO_BACKEND)).toString(), ioBackend))
+        invalidSettings << "ioBackend";
+    trfGen.setIoBackend(ioBackend);
+    PUBLISH_MODE publishMode = DIRECT_PUBLISH;
+    if(!OutputFile::parse(settings.value("publishMode", OutputFile::toString(DIRECT_PUBLISH)).toString(), publishMode))
+        invalidSettings << "publishMode";
+    trfGen.setPublishMode(publishMode);
+    FSYNC_POLICY fsyncPolicy = NO_FSYNC;
+    if(!OutputFile::parse(settings.value("fsyncPolicy", OutputFile::toString(NO_FSYNC)).toString(), fsyncPolicy))
+        invalidSettings << "fsyncPolicy";
+    bool fsyncIntervalOk;
+    int fsyncInterval = settings.value("fsyncInterval", DEFAULT_FSYNC_INTERVAL).toInt(&fsyncIntervalOk);
+    if(!fsyncIntervalOk || fsyncInterval < 1) {
+        invalidSettings << "fsyncInterval";
+        fsyncInterval = DEFAULT_FSYNC_INTERVAL;
+    }
+    trfGen.setFsyncPolicy(fsyncPolicy, fsyncInterval);
+    WritePolicy writePolicy;
+    QString writePolicySpec = settings.value("writePolicy", "none").toString();
+    if(WritePolicy::isSupported()) {
+        if(!writePolicy.parse(writePolicySpec))
+            invalidSettings << "writePolicy";
+        bool writeChunkOk;
+        qint64 writeChunk = settings.value("writeChunk", 0).toLongLong(&writeChunkOk);
+        if(!writeChunkOk || writeChunk < 0 || writeChunk > MAX_WRITE_CHUNK_SIZE) {
+            invalidSettings << "writeChunk";
+            writeChunk = 0;
+        }
+        writePolicy.setChunkSize(writeChunk);
+    } else if(!writePolicySpec.trimmed().isEmpty() && writePolicySpec.trimmed() != "none") {
+        invalidSettings << "writePolicy";
+    }
+    trfGen.setWritePolicy(writePolicy);
+    Mutator mutator;
+    if(!mutator.parse(settings.value("mutation", "none").toString()))
+        invalidSettings << "mutation";
+    trfGen.setMutator(mutator);
+    ContainerBuilder containerBuilder;
+    if(!containerBuilder.parse(settings.value("container", "none").toString()))
+        invalidSettings << "container";
+    // -1 takes the infected file probability
+    bool containerInfectedRatioOk;
+    double containerInfectedRatio = settings.value("containerInfectedRatio", -1.).toDouble(&containerInfectedRatioOk);
+    if(!containerInfectedRatioOk || (containerInfectedRatio != -1. && (containerInfectedRatio < 0. || containerInfectedRatio > 1.))) {
+        invalidSettings << "containerInfectedRatio";
+        containerInfectedRatio = -1.;
+    }
+    containerBuilder.setInfectedRatio(containerInfectedRatio);
+    trfGen.setContainerBuilder(containerBuilder);
+    ScanTarget scanTarget;
+    if(!scanTarget.parse(settings.value("scanTarget", "none").toString()))
+        invalidSettings << "scanTarget";
+    bool pipelineDepthOk;
+    int pipelineDepth = settings.value("pipelineDepth", DEFAULT_PIPELINE_DEPTH).toInt(&pipelineDepthOk);
+    if(!pipelineDepthOk || pipelineDepth < 1 || pipelineDepth > MAX_PIPELINE_DEPTH) {
+        invalidSettings << "pipelineDepth";
+        pipelineDepth = DEFAULT_PIPELINE_DEPTH;
+    }
+    scanTarget.setPipelineDepth(pipelineDepth);
+    trfGen.setScanTarget(scanTarget);
+    bool templateCacheBudgetOk;
+    int templateCacheBudget = settings.value("templateCacheBudgetMb", DEFAULT_TEMPLATE_CACHE_BUDGET_MB).toInt(&templateCacheBudgetOk);
+    if(!templateCacheBudgetOk || templateCacheBudget < 0) {
+        invalidSettings << "templateCacheBudgetMb";
+        templateCacheBudget = DEFAULT_TEMPLATE_CACHE_BUDGET_MB;
+    }
+    trfGen.setTemplateCacheBudgetInMb(templateCacheBudget);
+    trfGen.setMaxBacklog(settings.value("maxBacklog",             0).toLongLong());
+    trfGen.setScanLatencyTracking(settings.value("scanLatencyTracking", false).toBool());
 
     ui->currentSpeedUnitCB->setCurrentIndex(settings.value("currentSpeedUnitIdx", DEFAULT_UNIT).toInt());
     ui->averageSpeedUnitCB->setCurrentIndex(settings.value("averageSpeedUnitIdx", DEFAULT_UNIT).toInt());
     ui->totalVolumeUnitCB->setCurrentIndex(settings.value("totalVolumeUnitIdx",   DEFAULT_UNIT).toInt());
     ui->infectedFileProbabilityDSB->setValue(trfGen.getInfectedFileGenerateProbability());
 
+    // export is configured only through the settings file: metricsPort 0 and empty statsLogFile disable it
+    int metricsPort = settings.value("metricsPort", 0).toInt();
+    if(metricsPort > 0 && !statsExporter.listen(QHostAddress(settings.value("metricsAddress", DEFAULT_METRICS_ADDRESS).toString()), quint16(metricsPort))) {
+        QMessageBox::warning(nullptr, "Ошибка", QString("Не удалось открыть порт %1 для метрик!").arg(metricsPort), QMessageBox::Ok, QMessageBox::Ok);
+    }
+    QString statsLogFile = settings.value("statsLogFile").toString();
+    if(!statsLogFile.isEmpty() && !statsExporter.openLog(statsLogFile, settings.value("statsLogInterval", DEFAULT_STATS_LOG_INTERVAL).toInt())) {
+        QMessageBox::warning(nullptr, "Ошибка", QString("Не удалось открыть файл %1 для статистики!").arg(statsLogFile), QMessageBox::Ok, QMessageBox::Ok);
+    }
+
+    // a number in seed makes runs repeatable, empty draws a new seed every run
+    bool seedOk;
+    QString seedText = settings.value("seed").toString();
+    quint64 seed = seedText.toULongLong(&seedOk, 0);
+    if(seedOk)
+        trfGen.setSeed(seed);
+    else if(!seedText.isEmpty())
+        invalidSettings << "seed";
+
+    // like the export, the profile is set only through the settings file, empty workloadProfile runs the spin box load
+    QString workloadProfileFile = settings.value("workloadProfile").toString();
+    if(!workloadProfileFile.isEmpty()) {
+        WorkloadProfile workloadProfile;
+        QString error;
+        if(workloadProfile.load(workloadProfileFile, &error)) {
+            trfGen.setWorkloadProfile(workloadProfile);
+        } else {
+            QMessageBox::warning(nullptr, "Ошибка", QString("Не удалось загрузить профиль нагрузки %1: %2").arg(workloadProfileFile).arg(error), QMessageBox::Ok, QMessageBox::Ok);
+        }
+    }
+
+    // traces too: traceRecordFile records every run, traceReplayFile replays instead of generating
+    trfGen.setTraceRecordFile(settings.value("traceRecordFile").toString());
+    bool traceSpeedupOk;
+    double traceSpeedup = settings.value("traceSpeedup", 1.).toDouble(&traceSpeedupOk);
+    if(!traceSpeedupOk || traceSpeedup <= 0.)
+        invalidSettings << "traceSpeedup";
+    trfGen.setTraceReplay(settings.value("traceReplayFile").toString(), traceSpeedup);
+
+    if(!invalidSettings.isEmpty()) {
+        QMessageBox::warning(nullptr, "Ошибка", QString("Неверные значения настроек, используются значения по умолчанию: %1").arg(invalidSettings.join(", ")),
+                             QMessageBox::Ok, QMessageBox::Ok);
+    }
+
+    // templates of the previous session come back from the index without rescanning
+    trfGen.loadTemplateIndex(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+
     trfGen.moveToThread(&trafficThread);
     trafficThread.start();
 
@@ -248,14 +170,39 @@ Widget::~Widget() {
 
     settings.setValue("generateInterval",        trfGen.getGenerateInterval());
     settings.setValue("destinationDir",          trfGen.getDestinationDir());
+    settings.setValue("extraDestinationDirs",    trfGen.getDestinationDirs().mid(1));
+    settings.setValue("subdirsNb",               trfGen.getSubdirsNb());
     settings.setValue("cleanFilesDir",           trfGen.getCleanFilesDir());
     settings.setValue("infectedFilesDir",        trfGen.getInfectedFilesDir());
     settings.setValue("filesPerInterval",        trfGen.getFilesPerInterval());
+    settings.setValue("rateUnit",                trfGen.getIntervalRateUnit() == BYTES_PER_SEC ? "bytes" : "files");
     settings.setValue("infectedFileProbability", trfGen.getInfectedFileGenerateProbability());
+    settings.setValue("threadsNb",               trfGen.getThreadsNb());
+    settings.setValue("ioBackend",               IoBackend::toString(trfGen.getIoBackend()));
+    settings.setValue("publishMode",             OutputFile::toString(trfGen.getPublishMode()));
+    settings.setValue("fsyncPolicy",             OutputFile::toString(trfGen.getFsyncPolicy()));
+    settings.setValue("fsyncInterval",           trfGen.getFsyncIntervalInMsecs());
+    settings.setValue("writePolicy",             trfGen.getWritePolicy().toString());
+    settings.setValue("writeChunk",              trfGen.getWritePolicy().getChunkSize());
+    settings.setValue("mutation",                trfGen.getMutator().toString());
+    settings.setValue("container",               trfGen.getContainerBuilder().toString());
+    settings.setValue("containerInfectedRatio",  trfGen.getContainerBuilder().getInfectedRatio());
+    settings.setValue("scanTarget",              trfGen.getScanTarget().toString());
+    settings.setValue("pipelineDepth",           trfGen.getScanTarget().getPipelineDepth());
+    settings.setValue("templateCacheBudgetMb",   trfGen.getTemplateCacheBudgetInMb());
+    settings.setValue("maxBacklog",              trfGen.getMaxBacklog());
+    settings.setValue("scanLatencyTracking",     trfGen.isScanLatencyTracking());
+    settings.setValue("traceRecordFile",         trfGen.getTraceRecordFile());
+    settings.setValue("traceReplayFile",         trfGen.getTraceReplayFile());
+    settings.setValue("traceSpeedup",            trfGen.getTraceSpeedup());
+    settings.setValue("seed",                    trfGen.isSeedFixed() ? QString::number(trfGen.getSeed()) : QString());
     settings.setValue("currentSpeedUnitIdx",     ui->currentSpeedUnitCB->currentIndex());
     settings.setValue("averageSpeedUnitIdx",     ui->averageSpeedUnitCB->currentIndex());
     settings.setValue("totalVolumeUnitIdx",      ui->totalVolumeUnitCB->currentIndex());
 
+    trfGen.saveTemplateIndex(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+
+    trfGen.stop();
     trafficThread.quit();
     trafficThread.wait();
 
@@ -263,72 +210,140 @@ Widget::~Widget() {
 }
 
 void Widget::updateUi() {
+    updateControls();
+    updateStats();
+}
+
+// controls and settings, redrawn on user actions and when a run starts or stops
+void Widget::updateControls() {
+
+    bool workStatus = trfGen.getWorkStatus();
+    m_shownWorkStatus = workStatus;
+
+    ui->startButton->setEnabled(!workStatus);
+    ui->stopButton->setEnabled(workStatus);
+    ui->threadsNbSB->setEnabled(!workStatus);
+    // the rate and the destination belong to the run once it started
+    ui->generationFileNbSB->setEnabled(!workStatus);
+    ui->generationIntervalSB->setEnabled(!workStatus);
+    ui->rateUnitCB->setEnabled(!workStatus);
+    ui->infectedFileProbabilityDSB->setEnabled(!workStatus);
+    ui->destinationDirButton->setEnabled(!workStatus);
+    ui->cleanFilesAddButton->setEnabled(!workStatus);
+    ui->cleanFilesAddDirButton->setEnabled(!workStatus);
+    ui->cleanFilesClearButton->setEnabled(!workStatus);
+    ui->infectedFilesAddButton->setEnabled(!workStatus);
+    ui->infectedFilesAddDirButton->setEnabled(!workStatus);
+    ui->infectedFilesClearButton->setEnabled(!workStatus);
+
+    // redrawing isn't a user edit, it mustn't come back as one
+    QSignalBlocker fileNbBlocker(ui->generationFileNbSB);
+    QSignalBlocker intervalBlocker(ui->generationIntervalSB);
+    QSignalBlocker rateUnitBlocker(ui->rateUnitCB);
+    QSignalBlocker threadsNbBlocker(ui->threadsNbSB);
+    QSignalBlocker probabilityBlocker(ui->infectedFileProbabilityDSB);
+    ui->destinationDirLE->setText(trfGen.getDestinationDir());
+    ui->generationFileNbSB->setValue(trfGen.getFilesPerInterval());
+    ui->generationIntervalSB->setValue(trfGen.getGenerateInterval());
+    ui->rateUnitCB->setCurrentIndex(trfGen.getIntervalRateUnit() == BYTES_PER_SEC ? 1 : 0);
+    ui->threadsNbSB->setValue(trfGen.getThreadsNb());
+    ui->infectedFileProbabilityDSB->setValue(trfGen.getInfectedFileGenerateProbability());
+
+    m_cleanFilesModel.sync();
+    m_infectedFilesModel.sync();
+}
+
+// statistics only read the snapshot, so the GUI thread never touches what the workers update
+void Widget::updateStats() {
 
-    m_endDateTime = trfGen.getWorkStatus() ? QDateTime::currentDateTime() : m_endDateTime;
+    if(trfGen.getWorkStatus() != m_shownWorkStatus)
+        updateControls();
 
-    ui->startButton->setEnabled(!trfGen.getWorkStatus());
-    ui->stopButton->setEnabled(trfGen.getWorkStatus());
+    StatsSnapshot snapshot = trfGen.getStatsSnapshot();
 
-    ui->currentSpeedInfoLabel->setText(QString::number(convert(trfGen.getCurrentSpeedInBytes(),
+    QDateTime startDateTime = snapshot.startTimeInMsecs ? QDateTime::fromMSecsSinceEpoch(snapshot.startTimeInMsecs) : QDateTime();
+    if(snapshot.workStatus) {
+        m_endDateTime = QDateTime::currentDateTime();
+    } else if(snapshot.endTimeInMsecs) {
+        m_endDateTime = QDateTime::fromMSecsSinceEpoch(snapshot.endTimeInMsecs);
+    }
+
+    ui->generationProgressBar->setValue(snapshot.progress);
+
+    ui->currentSpeedInfoLabel->setText(QString::number(convert(snapshot.currentSpeedInBytes,
                                                                ui->currentSpeedUnitCB->currentIndex()), 'f', 2));
-    ui->averageSpeedInfoLabel->setText(QString::number(convert(trfGen.getAverageSpeedInBytes(),
+    ui->averageSpeedInfoLabel->setText(QString::number(convert(snapshot.averageSpeedInBytes,
                                                                ui->averageSpeedUnitCB->currentIndex()), 'f', 2));
 
-    ui->virusNbInfoLabel->setText(QString::number(trfGen.getInfectedFilesNb()));
-    ui->destinationDirLE->setText(trfGen.getDestinationDir());
-    ui->generationFileNbSB->setValue(trfGen.getFilesPerInterval());
-    ui->generationIntervalSB->setValue(trfGen.getGenerateInterval());
-    ui->generationProgressInfoLabel->setText(QString::number(trfGen.getGlobalCnt()));
+    ui->virusNbInfoLabel->setText(QString::number(snapshot.infectedFilesCnt));
+    ui->generationProgressInfoLabel->setText(QString::number(snapshot.filesCnt));
 
     qint64 days;
-    if( QDate(trfGen.getStartTime().date()).daysTo(m_endDateTime.date()) == 0 ) {
+    if( QDate(startDateTime.date()).daysTo(m_endDateTime.date()) == 0 ) {
         days = 0;
     } else {
-        if(m_endDateTime.time() >= trfGen.getStartTime().time()) {
-            days = QDate(trfGen.getStartTime().date()).daysTo(m_endDateTime.date());
+        if(m_endDateTime.time() >= startDateTime.time()) {
+            days = QDate(startDateTime.date()).daysTo(m_endDateTime.date());
         } else {
-            days = QDate(trfGen.getStartTime().date()).daysTo(m_endDateTime.date()) - 1;
+            days = QDate(startDateTime.date()).daysTo(m_endDateTime.date()) - 1;
         }
     }
 
     ui->workTimeInfoLabel->setText(QString("%1 дней ").arg( days ) +
-                                   QTime(0,0,0,0).addSecs(QTime(trfGen.getStartTime().time()).secsTo(m_endDateTime.time())).toString("hh ч. mm мин. ss сек."));
+                                   QTime(0,0,0,0).addSecs(QTime(startDateTime.time()).secsTo(m_endDateTime.time())).toString("hh ч. mm мин. ss сек."));
 
-    ui->totalVolumeInfoLabel->setText(QString::number(convert(trfGen.getTotalVolInBytes(),
-                                                              ui->totalVolumeUnitCB->currentIndex())));
-
-    for(int i = 0; i < trfGen.getCleanFiles().size(); i++) {
-        m_cleanFilesModel.setItem(i, 0, new QStandardItem(trfGen.getCleanFiles().at(i).fileName()));
-        m_cleanFilesModel.setItem(i, 1, new QStandardItem(QString::number(trfGen.getCleanFiles().at(i).size() / (1024. * 1024.), 'f', 2)));
-    }
+    ui->latencyInfoLabel->setText(QString("%1 / %2 / %3")
+                                  .arg(snapshot.latencyP50InNsecs / 1e6, 0, 'f', 2)
+                                  .arg(snapshot.latencyP99InNsecs / 1e6, 0, 'f', 2)
+                                  .arg(snapshot.latencyP999InNsecs / 1e6, 0, 'f', 2));
 
-    for(int i = 0; i < trfGen.getInfectedFiles().size(); i++) {
-        m_infectedFilesModel.setItem(i, 0, new QStandardItem(trfGen.getInfectedFiles().at(i).fileName()));
-        m_infectedFilesModel.setItem(i, 1, new QStandardItem(QString::number(trfGen.getInfectedFiles().at(i).size() / (1024. * 1024.), 'f', 2)));
-    }
+    ui->totalVolumeInfoLabel->setText(QString::number(convert(snapshot.bytes,
+                                                              ui->totalVolumeUnitCB->currentIndex())));
 }
 
 void Widget::prepareTables() {
 
-    m_cleanFilesModel.setHorizontalHeaderLabels(QStringList() << "Файл" << "Размер\n(Мбайт)");
+    // fixed row heights and a stretched name column keep the views from measuring every row
     ui->cleanFilesTableView->setModel(&m_cleanFilesModel);
 
-    ui->cleanFilesTableView->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
-    ui->cleanFilesTableView->verticalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    ui->cleanFilesTableView->horizontalHeader()->setSectionResizeMode(FILE_NAME_COLUMN, QHeaderView::Stretch);
+    ui->cleanFilesTableView->horizontalHeader()->setSectionResizeMode(FILE_SIZE_COLUMN, QHeaderView::ResizeToContents);
+    ui->cleanFilesTableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     ui->cleanFilesTableView->setEditTriggers(QAbstractItemView::NoEditTriggers);
     ui->cleanFilesTableView->setSelectionMode(QAbstractItemView::NoSelection);
 
-    m_infectedFilesModel.setHorizontalHeaderLabels(QStringList() << "Файл" << "Размер\n(Мбайт)");
     ui->infectedFilesTableView->setModel(&m_infectedFilesModel);
 
-    ui->infectedFilesTableView->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
-    ui->infectedFilesTableView->verticalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    ui->infectedFilesTableView->horizontalHeader()->setSectionResizeMode(FILE_NAME_COLUMN, QHeaderView::Stretch);
+    ui->infectedFilesTableView->horizontalHeader()->setSectionResizeMode(FILE_SIZE_COLUMN, QHeaderView::ResizeToContents);
+    ui->infectedFilesTableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     ui->infectedFilesTableView->setEditTriggers(QAbstractItemView::NoEditTriggers);
     ui->infectedFilesTableView->setSelectionMode(QAbstractItemView::NoSelection);
 }
 
+void Widget::showWorkloadPhase(int phaseIdx) {
+    QString title = QString("Traffic Generator ") + VERSION;
+    if(phaseIdx >= 0) {
+        title += QString(" - %1 (фаза %2 из %3)").arg(trfGen.getWorkloadProfile().getPhase(phaseIdx).name)
+                                                 .arg(phaseIdx + 1)
+                                                 .arg(trfGen.getWorkloadProfile().getPhasesNb());
+    }
+    setWindowTitle(title);
+}
+
+// the whole tree is scanned, so large trees block the window for a while
+void Widget::addTemplateDir(FILE_TYPE type, const QString& caption, const QString& startDir) {
+    QString dir = QFileDialog::getExistingDirectory(this, caption, startDir);
+    if(dir.isEmpty())
+        return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    trfGen.addTemplateDirs(type, QStringList() << dir);
+    QApplication::restoreOverrideCursor();
+    updateUi();
+}
+
 void Widget::setGenerationInterval(int secs) {
-    m_generateTimer.setInterval(secs * 1000);
     trfGen.setGenerateInterval(secs);
 }
 
@@ -338,6 +353,18 @@ void Widget::executeError(int code) {
         case -1:
             QMessageBox::critical(nullptr, "Ошибка", "Не выбраны файлы-шаблоны для генерации!", QMessageBox::Ok, QMessageBox::Ok);
             break;
+        case -2:
+            QMessageBox::critical(nullptr, "Ошибка", "Не удалось отслеживать директорию назначения!", QMessageBox::Ok, QMessageBox::Ok);
+            break;
+        case -3:
+            QMessageBox::critical(nullptr, "Ошибка", "Не удалось открыть файл для записи трассы!", QMessageBox::Ok, QMessageBox::Ok);
+            break;
+        case -4:
+            QMessageBox::critical(nullptr, "Ошибка", "Не удалось открыть трассу для воспроизведения!", QMessageBox::Ok, QMessageBox::Ok);
+            break;
+        case -5:
+            QMessageBox::critical(nullptr, "Ошибка", "Не удалось создать подкаталоги в папке назначения!", QMessageBox::Ok, QMessageBox::Ok);
+            break;
         default:
             break;
     }
@@ -351,22 +378,32 @@ void Widget::on_generationIntervalSB_valueChanged(int newVal) {
     setGenerationInterval(newVal);
 }
 
+void Widget::on_rateUnitCB_currentIndexChanged(int index) {
+    trfGen.setIntervalRateUnit(index ? BYTES_PER_SEC : FILES_PER_SEC);
+}
+
 void Widget::on_destinationDirButton_clicked() {
     QString dir = QFileDialog::getExistingDirectory(this,
                                                     QString("Выбор папки назначения"),
                                                     trfGen.getDestinationDir());
-    trfGen.setDestinationDir(dir);
+    // a cancelled dialog returns an empty path
+    if(dir.isEmpty())
+        return;
+    // the chosen directory replaces the first root, extra roots come from the settings
+    QStringList destinationDirs = trfGen.getDestinationDirs();
+    destinationDirs[0] = dir;
+    trfGen.setDestinationDirs(destinationDirs);
+    updateUi();
 }
 
 void Widget::on_startButton_clicked() {
     trfGen.start();
     m_startDateTime = QDateTime::currentDateTime();
-    m_generateTimer.start();
 }
 
 void Widget::on_stopButton_clicked() {
     trfGen.stop();
-    m_generateTimer.stop();
+    showWorkloadPhase(-1);
 }
 
 void Widget::on_cleanFilesAddButton_clicked() {
@@ -377,10 +414,12 @@ void Widget::on_cleanFilesAddButton_clicked() {
     updateUi();
 }
 
+void Widget::on_cleanFilesAddDirButton_clicked() {
+    addTemplateDir(CLEAN, "Выбор каталога с чистыми файлами-образцами", trfGen.getCleanFilesDir());
+}
+
 void Widget::on_cleanFilesClearButton_clicked() {
     trfGen.getCleanFiles().clear();
-    if(m_cleanFilesModel.rowCount() > 0)
-        m_cleanFilesModel.removeRows(0, m_cleanFilesModel.rowCount());
     updateUi();
 }
 
@@ -392,10 +431,12 @@ void Widget::on_infectedFilesAddButton_clicked() {
     updateUi();
 }
 
+void Widget::on_infectedFilesAddDirButton_clicked() {
+    addTemplateDir(INFECTED, "Выбор каталога с зараженными файлами-образцами", trfGen.getInfectedFilesDir());
+}
+
 void Widget::on_infectedFilesClearButton_clicked() {
     trfGen.getInfectedFiles().clear();
-    if(m_infectedFilesModel.rowCount() > 1)
-        m_infectedFilesModel.removeRows(0, m_infectedFilesModel.rowCount());
     updateUi();
 }
 
@@ -418,6 +459,10 @@ void Widget::on_infectedFileProbabilityDSB_valueChanged(double probability) {
     trfGen.setInfectedFileGenerateProbability(probability);
 }
 
+void Widget::on_threadsNbSB_valueChanged(int newVal) {
+    trfGen.setThreadsNb(newVal);
+}
+
 double convert(double bytes, int outType) {
     switch(outType) {
         case 0: // bits
@@ -0,0 +1,203 @@
+#include "workloadprofile.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonArray>
+
+#include <cmath>
+
+bool WorkloadPhase::isRamp() const {
+    return rampFromRate >= 0.;
+}
+
+// unlike the rate set by hand, 0 in a phase is no files rather than no limit
+bool WorkloadPhase::isPause() const {
+    return rate == 0.;
+}
+
+// -----------------------------------------------------------------------------------------
+
+static bool parseDuration(const QJsonValue& value, double& durationInSecs) {
+    if(value.isDouble()) {
+        durationInSecs = value.toDouble();
+        return durationInSecs > 0.;
+    }
+
+    QString text = value.toString().trimmed().toLower();
+    double multiplier = 1.;
+    if(text.endsWith("h")) {
+        multiplier = 3600.;
+    } else if(text.endsWith("m")) {
+        multiplier = 60.;
+    }
+    if(text.endsWith("h") || text.endsWith("m") || text.endsWith("s"))
+        text.chop(1);
+
+    bool ok;
+    durationInSecs = text.toDouble(&ok) * multiplier;
+    return ok && durationInSecs > 0.;
+}
+
+static bool parseRate(const QJsonValue& value, RATE_UNIT rateUnit, double& rate) {
+    bool ok = value.isDouble();
+    if(ok) {
+        rate = value.toDouble();
+    } else if(rateUnit == BYTES_PER_SEC) {
+        rate = double(SizeDistribution::parseSize(value.toString(), &ok));
+    } else {
+        rate = value.toString().toDouble(&ok);
+    }
+    return ok && rate >= 0.;
+}
+
+WorkloadProfile::WorkloadProfile() {
+}
+
+bool WorkloadProfile::parsePhase(const QJsonObject& object, WorkloadPhase& phase, QString& error) {
+    phase.name = object.value("name").toString(QString("phase %1").arg(m_phases.size() + 1));
+
+    if(!parseDuration(object.value("duration"), phase.durationInSecs)) {
+        error = "invalid or missing duration";
+        return false;
+    }
+
+    if(object.contains("rate") && object.contains("byte_rate")) {
+        error = "rate and byte_rate are mutually exclusive";
+        return false;
+    }
+    if(object.contains("rate") || object.contains("byte_rate")) {
+        phase.rateUnit = object.contains("rate") ? FILES_PER_SEC : BYTES_PER_SEC;
+        if(!parseRate(object.value(phase.rateUnit == FILES_PER_SEC ? "rate" : "byte_rate"), phase.rateUnit, phase.rate)) {
+            error = "invalid rate";
+            return false;
+        }
+    }
+
+    if(object.contains("ramp_from")) {
+        if(phase.rate <= 0. || !parseRate(object.value("ramp_from"), phase.rateUnit, phase.rampFromRate)) {
+            error = "a ramp needs a positive target rate and a valid ramp_from";
+            return false;
+        }
+    }
+
+    if(object.contains("infected_probability")) {
+        phase.infectedProbability = object.value("infected_probability").toDouble(-1.);
+        if(phase.infectedProbability < 0. || phase.infectedProbability > 1.) {
+            error = "invalid infected_probability";
+            return false;
+        }
+    }
+
+    if(object.contains("sizes")) {
+        phase.hasSizeDistribution = phase.sizeDistribution.parse(object.value("sizes").toString());
+        if(!phase.hasSizeDistribution) {
+            error = "invalid sizes";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WorkloadProfile::load(const QString& fileName, QString* error) {
+    clear();
+
+    QString errorText;
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly)) {
+        errorText = file.errorString();
+    } else {
+        QJsonParseError parseError;
+        QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+        QJsonObject root = document.object();
+
+        if(parseError.error != QJsonParseError::NoError) {
+            errorText = parseError.errorString();
+        } else if(!root.value("phases").isArray() || root.value("phases").toArray().isEmpty()) {
+            errorText = "no phases";
+        } else {
+            m_name = root.value("name").toString();
+            m_repeatsNb = root.value("repeat").toInt(1);
+            if(m_repeatsNb < 0)
+                errorText = "invalid repeat";
+
+            foreach(const QJsonValue& value, root.value("phases").toArray()) {
+                if(!errorText.isEmpty())
+                    break;
+
+                WorkloadPhase phase;
+                QString phaseError;
+                if(!parsePhase(value.toObject(), phase, phaseError)) {
+                    errorText = QString("phase %1: %2").arg(m_phases.size() + 1).arg(phaseError);
+                    break;
+                }
+                m_phases << phase;
+                m_cycleDurationInSecs += phase.durationInSecs;
+            }
+        }
+    }
+
+    if(!errorText.isEmpty()) {
+        clear();
+        if(error)
+            *error = errorText;
+        return false;
+    }
+    return true;
+}
+
+void WorkloadProfile::clear() {
+    m_name.clear();
+    m_phases.clear();
+    m_repeatsNb = 1;
+    m_cycleDurationInSecs = 0.;
+}
+
+bool WorkloadProfile::isEmpty() const {
+    return m_phases.isEmpty();
+}
+
+QString WorkloadProfile::getName() const {
+    return m_name;
+}
+
+int WorkloadProfile::getPhasesNb() const {
+    return m_phases.size();
+}
+
+const WorkloadPhase& WorkloadProfile::getPhase(int idx) const {
+    return m_phases.at(idx);
+}
+
+int WorkloadProfile::getRepeatsNb() const {
+    return m_repeatsNb;
+}
+
+// 0 for profiles repeated until stopped
+double WorkloadProfile::getDurationInSecs() const {
+    return m_cycleDurationInSecs * m_repeatsNb;
+}
+
+bool WorkloadProfile::locate(double elapsedInSecs, int& step, double& phaseElapsedInSecs) const {
+    if(isEmpty())
+        return false;
+
+    double cyclesNb = std::floor(elapsedInSecs / m_cycleDurationInSecs);
+    if(m_repeatsNb && cyclesNb >= m_repeatsNb)
+        return false;
+
+    phaseElapsedInSecs = elapsedInSecs - cyclesNb * m_cycleDurationInSecs;
+    step = int(cyclesNb) * m_phases.size();
+    foreach(const WorkloadPhase& phase, m_phases) {
+        if(phaseElapsedInSecs < phase.durationInSecs)
+            break;
+        phaseElapsedInSecs -= phase.durationInSecs;
+        step++;
+    }
+
+    // rounding may leave the remainder at the very end of the cycle
+    if(step % m_phases.size() == 0 && step / m_phases.size() > cyclesNb) {
+        step--;
+        phaseElapsedInSecs = m_phases.last().durationInSecs;
+    }
+    return true;
+}
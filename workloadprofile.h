@@ -0,0 +1,70 @@
+#ifndef WORKLOADPROFILE_H
+#define WORKLOADPROFILE_H
+
+#include <QString>
+#include <QVector>
+#include <QJsonObject>
+
+#include "ratescheduler.h"
+#include "payloadgenerator.h"
+
+// a stretch of the run with its own offered load, fields left out of the
+// profile keep the values set before (rate < 0, probability < 0)
+struct WorkloadPhase {
+    QString name;
+    double durationInSecs{0.};
+
+    double rate{-1.};
+    RATE_UNIT rateUnit{FILES_PER_SEC};
+    double rampFromRate{-1.};
+
+    double infectedProbability{-1.};
+
+    bool hasSizeDistribution{false};
+    SizeDistribution sizeDistribution;
+
+    bool isRamp() const;
+    bool isPause() const;
+};
+
+// JSON workload definition:
+// {
+//     "name": "capacity", "repeat": 1,
+//     "phases": [
+//         {"name": "ramp",  "duration": "5m", "byte_rate": "2G", "ramp_from": 0},
+//         {"name": "soak",  "duration": "1h", "byte_rate": "2G", "infected_probability": 0.05},
+//         {"name": "spike", "duration": 30,   "rate": 20000, "sizes": "fixed:4K"}
+//     ]
+// }
+// durations are seconds or s/m/h suffixed strings, "rate" is in files/s and
+// "byte_rate" in bytes/s with K/M/G suffixes, "ramp_from" starts a linear ramp
+// in the same unit, a rate of 0 pauses the generation until the phase ends,
+// "sizes" is a synthetic size distribution. The phases are
+// played "repeat" times, 0 repeats them until the generator is stopped.
+class WorkloadProfile {
+
+    QString m_name;
+    QVector<WorkloadPhase> m_phases;
+    int m_repeatsNb{1};
+    double m_cycleDurationInSecs{0.};
+
+    bool parsePhase(const QJsonObject& object, WorkloadPhase& phase, QString& error);
+
+public:
+    WorkloadProfile();
+
+    bool load(const QString& fileName, QString* error = nullptr);
+    void clear();
+
+    bool isEmpty() const;
+    QString getName() const;
+    int getPhasesNb() const;
+    const WorkloadPhase& getPhase(int idx) const;
+    int getRepeatsNb() const;
+    double getDurationInSecs() const;
+
+    // step counts phases across repeats, false once the profile is over
+    bool locate(double elapsedInSecs, int& step, double& phaseElapsedInSecs) const;
+};
+
+#endif // WORKLOADPROFILE_H